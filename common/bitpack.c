@@ -0,0 +1,351 @@
+/* bitpack.c - CS50 'bitpack' module
+ *
+ * Bit-packed integer frames with scalar, SSE4.1 and AVX2 unpack kernels.
+ * See bitpack.h for documentation.
+ *
+ * A frame holds BITPACK_BLOCK values in LANES interleaved lanes of 32-bit
+ * words: word j of lane l is at word index j*LANES + l, and holds the
+ * next bits of values l, l+8, l+16, ... packed low bits first. A lane
+ * holds 16 values, so it needs ceil(16*bits/32) words.
+ *
+ * Kyrylo Bakumenko, 23 April 2023
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bitpack.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITPACK_X86
+#include <immintrin.h>
+#endif
+
+/**************** file-local constants ****************/
+static const int LANES = 8;                             // interleaved lanes
+static const int PER_LANE = BITPACK_BLOCK / 8;          // values per lane
+
+/**************** file-local types ****************/
+typedef struct kernel {
+    const char* name;
+    void (*unpack)(const uint8_t* in, const int bits, const uint32_t add, uint32_t* out);
+    void (*prefix)(uint32_t* values, const uint32_t base);
+} kernel_t;
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static void scalar_unpack(const uint8_t* in, const int bits, const uint32_t add, uint32_t* out);
+static void scalar_prefix(uint32_t* values, const uint32_t base);
+static const kernel_t* kernel_best(void);
+static bool kernel_supported(const kernel_t* kernel);
+static uint32_t load_word(const uint8_t* in, const int word);
+
+#ifdef BITPACK_X86
+static void sse4_unpack(const uint8_t* in, const int bits, const uint32_t add, uint32_t* out);
+static void sse4_prefix(uint32_t* values, const uint32_t base);
+static void avx2_unpack(const uint8_t* in, const int bits, const uint32_t add, uint32_t* out);
+static void avx2_prefix(uint32_t* values, const uint32_t base);
+#endif
+
+/**************** file-local global variables ****************/
+static const kernel_t kernels[] = {
+    { "scalar", scalar_unpack, scalar_prefix },
+#ifdef BITPACK_X86
+    { "sse4.1", sse4_unpack, sse4_prefix },
+    { "avx2", avx2_unpack, avx2_prefix },
+#endif
+};
+static const int NUM_KERNELS = sizeof(kernels) / sizeof(kernels[0]);
+
+// chosen on first use; see bitpack_select
+static const kernel_t* kernel = NULL;
+
+/**************** bitpack_bits() ****************/
+/* see bitpack.h for description */
+int
+bitpack_bits(const uint32_t* values)
+{
+    uint32_t all = 0;
+    for (int i = 0; i < BITPACK_BLOCK; i++) {
+        all |= values[i];
+    }
+    int bits = 0;
+    while (bits < 32 && (all >> bits) != 0) {
+        bits++;
+    }
+    return bits;
+}
+
+/**************** bitpack_size() ****************/
+/* see bitpack.h for description */
+size_t
+bitpack_size(const int bits)
+{
+    size_t wordsPerLane = (PER_LANE * bits + 31) / 32;
+    return wordsPerLane * LANES * sizeof(uint32_t);
+}
+
+/**************** bitpack_pack() ****************/
+/* see bitpack.h for description */
+void
+bitpack_pack(const uint32_t* values, const int bits, uint8_t* out)
+{
+    for (int lane = 0; lane < LANES; lane++) {
+        uint64_t acc = 0;       // bits not yet written
+        int have = 0;           // number of bits in acc
+        int word = 0;
+        for (int i = 0; i < PER_LANE; i++) {
+            acc |= (uint64_t)values[i * LANES + lane] << have;
+            have += bits;
+            if (have >= 32) {
+                uint32_t w = (uint32_t)acc;
+                memcpy(&out[(word++ * LANES + lane) * 4], &w, 4);
+                acc >>= 32;
+                have -= 32;
+            }
+        }
+        if (have > 0) {
+            uint32_t w = (uint32_t)acc;
+            memcpy(&out[(word * LANES + lane) * 4], &w, 4);
+        }
+    }
+}
+
+/**************** bitpack_unpack() ****************/
+/* see bitpack.h for description */
+void
+bitpack_unpack(const uint8_t* in, const int bits, const uint32_t add, uint32_t* out)
+{
+    if (kernel == NULL) {
+        kernel = kernel_best();
+    }
+    kernel->unpack(in, bits, add, out);
+}
+
+/**************** bitpack_prefix() ****************/
+/* see bitpack.h for description */
+void
+bitpack_prefix(uint32_t* values, const uint32_t base)
+{
+    if (kernel == NULL) {
+        kernel = kernel_best();
+    }
+    kernel->prefix(values, base);
+}
+
+/**************** bitpack_select() ****************/
+/* see bitpack.h for description */
+bool
+bitpack_select(const char* name)
+{
+    if (name == NULL) {
+        return false;
+    }
+    if (strcmp(name, "auto") == 0) {
+        kernel = kernel_best();
+        return true;
+    }
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        if (strcmp(name, kernels[k].name) == 0 && kernel_supported(&kernels[k])) {
+            kernel = &kernels[k];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************** bitpack_name() ****************/
+/* see bitpack.h for description */
+const char*
+bitpack_name(void)
+{
+    if (kernel == NULL) {
+        kernel = kernel_best();
+    }
+    return kernel->name;
+}
+
+/**************** kernel_supported() ****************/
+/* asks the CPU (cpuid) whether it has the kernel's instructions */
+static bool
+kernel_supported(const kernel_t* k)
+{
+#ifdef BITPACK_X86
+    __builtin_cpu_init();
+    if (k->unpack == avx2_unpack) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (k->unpack == sse4_unpack) {
+        return __builtin_cpu_supports("sse4.1");
+    }
+#endif
+    return true;
+}
+
+/**************** kernel_best() ****************/
+/* the last (widest) supported kernel */
+static const kernel_t*
+kernel_best(void)
+{
+    const kernel_t* best = &kernels[0];
+    for (int k = 1; k < NUM_KERNELS; k++) {
+        if (kernel_supported(&kernels[k])) {
+            best = &kernels[k];
+        }
+    }
+    return best;
+}
+
+/**************** load_word() ****************/
+/* unaligned load of the word-th 32-bit word of in */
+static uint32_t
+load_word(const uint8_t* in, const int word)
+{
+    uint32_t w;
+    memcpy(&w, &in[word * 4], 4);
+    return w;
+}
+
+/**************** scalar kernels ****************/
+static void
+scalar_unpack(const uint8_t* in, const int bits, const uint32_t add, uint32_t* out)
+{
+    const uint64_t mask = (bits == 32) ? 0xffffffffu : ((uint64_t)1 << bits) - 1;
+    for (int lane = 0; lane < LANES; lane++) {
+        uint64_t acc = 0;       // bits not yet consumed
+        int have = 0;           // number of bits in acc
+        int word = 0;
+        for (int i = 0; i < PER_LANE; i++) {
+            if (have < bits) {
+                acc |= (uint64_t)load_word(in, word++ * LANES + lane) << have;
+                have += 32;
+            }
+            out[i * LANES + lane] = (uint32_t)(acc & mask) + add;
+            acc >>= bits;
+            have -= bits;
+        }
+    }
+}
+
+static void
+scalar_prefix(uint32_t* values, const uint32_t base)
+{
+    uint32_t sum = base;
+    for (int i = 0; i < BITPACK_BLOCK; i++) {
+        sum += values[i];
+        values[i] = sum;
+    }
+}
+
+#ifdef BITPACK_X86
+/**************** SSE4.1 kernels ****************/
+/* lanes 0-3 and then lanes 4-7 of the frame, 4 values at a time */
+__attribute__((target("sse4.1")))
+static void
+sse4_unpack(const uint8_t* in, const int bits, const uint32_t add, uint32_t* out)
+{
+    const __m128i addv = _mm_set1_epi32(add);
+    if (bits == 0) {
+        for (int i = 0; i < BITPACK_BLOCK; i += 4) {
+            _mm_storeu_si128((__m128i*)&out[i], addv);
+        }
+        return;
+    }
+    const __m128i mask = _mm_set1_epi32(bits == 32 ? 0xffffffffu : (1u << bits) - 1);
+    for (int half = 0; half < LANES; half += 4) {
+        const uint8_t* src = in + half * 4;
+        __m128i cur = _mm_loadu_si128((const __m128i*)src);
+        int word = 1;
+        int shift = 0;          // bits of cur already consumed
+        for (int i = 0; i < PER_LANE; i++) {
+            __m128i v = _mm_srl_epi32(cur, _mm_cvtsi32_si128(shift));
+            if (shift + bits > 32) {
+                // value straddles into the next word
+                cur = _mm_loadu_si128((const __m128i*)(src + word++ * LANES * 4));
+                v = _mm_or_si128(v, _mm_sll_epi32(cur, _mm_cvtsi32_si128(32 - shift)));
+                shift += bits - 32;
+            } else if (shift + bits == 32) {
+                if (i + 1 < PER_LANE) {
+                    cur = _mm_loadu_si128((const __m128i*)(src + word++ * LANES * 4));
+                }
+                shift = 0;
+            } else {
+                shift += bits;
+            }
+            v = _mm_add_epi32(_mm_and_si128(v, mask), addv);
+            _mm_storeu_si128((__m128i*)&out[i * LANES + half], v);
+        }
+    }
+}
+
+__attribute__((target("sse4.1")))
+static void
+sse4_prefix(uint32_t* values, const uint32_t base)
+{
+    __m128i carry = _mm_set1_epi32(base);
+    for (int i = 0; i < BITPACK_BLOCK; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)&values[i]);
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, carry);
+        _mm_storeu_si128((__m128i*)&values[i], x);
+        carry = _mm_set1_epi32(_mm_extract_epi32(x, 3));
+    }
+}
+
+/**************** AVX2 kernels ****************/
+/* all 8 lanes of the frame, 8 values at a time */
+__attribute__((target("avx2")))
+static void
+avx2_unpack(const uint8_t* in, const int bits, const uint32_t add, uint32_t* out)
+{
+    const __m256i addv = _mm256_set1_epi32(add);
+    if (bits == 0) {
+        for (int i = 0; i < BITPACK_BLOCK; i += 8) {
+            _mm256_storeu_si256((__m256i*)&out[i], addv);
+        }
+        return;
+    }
+    const __m256i mask = _mm256_set1_epi32(bits == 32 ? 0xffffffffu : (1u << bits) - 1);
+    __m256i cur = _mm256_loadu_si256((const __m256i*)in);
+    int word = 1;
+    int shift = 0;              // bits of cur already consumed
+    for (int i = 0; i < PER_LANE; i++) {
+        __m256i v = _mm256_srl_epi32(cur, _mm_cvtsi32_si128(shift));
+        if (shift + bits > 32) {
+            // value straddles into the next word
+            cur = _mm256_loadu_si256((const __m256i*)(in + word++ * LANES * 4));
+            v = _mm256_or_si256(v, _mm256_sll_epi32(cur, _mm_cvtsi32_si128(32 - shift)));
+            shift += bits - 32;
+        } else if (shift + bits == 32) {
+            if (i + 1 < PER_LANE) {
+                cur = _mm256_loadu_si256((const __m256i*)(in + word++ * LANES * 4));
+            }
+            shift = 0;
+        } else {
+            shift += bits;
+        }
+        v = _mm256_add_epi32(_mm256_and_si256(v, mask), addv);
+        _mm256_storeu_si256((__m256i*)&out[i * LANES], v);
+    }
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_prefix(uint32_t* values, const uint32_t base)
+{
+    __m256i carry = _mm256_set1_epi32(base);
+    const __m256i last = _mm256_set1_epi32(7);
+    for (int i = 0; i < BITPACK_BLOCK; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)&values[i]);
+        // running sums within each 128-bit half
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+        // carry the low half's total into the high half
+        __m256i low = _mm256_shuffle_epi32(x, 0xff);
+        x = _mm256_add_epi32(x, _mm256_permute2x128_si256(low, low, 0x08));
+        x = _mm256_add_epi32(x, carry);
+        _mm256_storeu_si256((__m256i*)&values[i], x);
+        carry = _mm256_permutevar8x32_epi32(x, last);
+    }
+}
+#endif // BITPACK_X86
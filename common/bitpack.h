@@ -0,0 +1,74 @@
+/*
+ * bitpack.h    Kyrylo Bakumenko    23 April, 2023
+ *
+ * Bit-packed frames of BITPACK_BLOCK unsigned integers, all stored with
+ * the same bit width, and the kernels that unpack them. The frame is
+ * laid out as 8 interleaved 32-bit lanes: value i lives in lane i % 8,
+ * so that SSE and AVX2 kernels unpack 4 or 8 values per instruction
+ * with the same shifts, and a scalar kernel reads the same bytes.
+ *
+ * The unpack kernel is chosen at startup from what the CPU supports
+ * (AVX2, then SSE4.1, then scalar) and may be overridden by name.
+ */
+
+#ifndef __BITPACK_H
+#define __BITPACK_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**************** global constants ****************/
+#define BITPACK_BLOCK 128       // values per frame
+
+/**************** functions ****************/
+
+/**************** bitpack_bits ****************/
+/* Return the number of bits (0..32) needed for the largest of
+ * the BITPACK_BLOCK values.
+ */
+int bitpack_bits(const uint32_t* values);
+
+/**************** bitpack_size ****************/
+/* Return the number of bytes of a frame packed with bits bits. */
+size_t bitpack_size(const int bits);
+
+/**************** bitpack_pack ****************/
+/* Pack the BITPACK_BLOCK values, each of which must fit in bits bits,
+ * into out, which must hold bitpack_size(bits) bytes.
+ */
+void bitpack_pack(const uint32_t* values, const int bits, uint8_t* out);
+
+/**************** bitpack_unpack ****************/
+/* Unpack a frame of bits-bit values from in (no alignment required),
+ * adding add to each, into out[0..BITPACK_BLOCK-1].
+ */
+void bitpack_unpack(const uint8_t* in, const int bits, const uint32_t add, uint32_t* out);
+
+/**************** bitpack_prefix ****************/
+/* Replace out[0..BITPACK_BLOCK-1] by its running sum, starting from base:
+ * out[i] = base + values[0] + ... + values[i]. Turns docID gaps into docIDs.
+ */
+void bitpack_prefix(uint32_t* values, const uint32_t base);
+
+/**************** bitpack_select ****************/
+/* Choose the kernel used by bitpack_unpack and bitpack_prefix:
+ * "auto", "scalar", "sse4.1" or "avx2".
+ *
+ * We return:
+ *   true if selected; false if the name is unknown or the CPU
+ *   lacks the instructions, in which case nothing changes.
+ */
+bool bitpack_select(const char* name);
+
+/**************** bitpack_name ****************/
+/* Return the name of the kernel currently in use, choosing it ("auto")
+ * if none has been yet.
+ *
+ * The kernel is chosen on first use and not locked: a program that
+ * decodes on several threads calls this (or bitpack_select) before
+ * starting them.
+ */
+const char* bitpack_name(void);
+
+#endif // __BITPACK_H
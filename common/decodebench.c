@@ -0,0 +1,172 @@
+/* decodebench.c    Kyrylo Bakumenko    23 April, 2023
+ *
+ * Microbenchmark for postings decoding. Checks that every unpack kernel
+ * the CPU supports agrees with the scalar kernel at every bit width, times
+ * building the list as the indexer does, one postings_add per occurrence
+ * (so mostly the O(1) "same document as last" increment), then times
+ * decoding with each kernel, reporting integers decoded per second:
+ *   frames  - bitpack_unpack + bitpack_prefix over packed frames alone
+ *   cursor  - a full cursor scan of a postings list (docIDs and counts)
+ *
+ * usage: ./decodebench [numPostings [meanGap]]
+ *
+ * Exit codes: 1 -> invalid arguments
+ *             2 -> a kernel disagrees with the scalar kernel
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "index.h"
+#include "bitpack.h"
+#include "mem.h"
+
+// kernels to try, slowest first
+static const char* KERNELS[] = { "scalar", "sse4.1", "avx2", NULL };
+
+static double now(void);
+static bool verify(void);
+
+/* ***************************
+ *  main function
+ *  Accepts 0-2 arguments: numPostings, meanGap
+ */
+int main(int argc, char* argv[])
+{
+    int numPostings = 10000000;
+    int meanGap = 8;
+    if (argc > 3 || (argc > 1 && (numPostings = atoi(argv[1])) <= 0)
+        || (argc > 2 && (meanGap = atoi(argv[2])) <= 0)) {
+        fprintf(stderr, "usage: %s [numPostings [meanGap]]\n", argv[0]);
+        exit(1);
+    }
+    if (!verify()) {
+        exit(2);
+    }
+
+    // a postings list with random gaps averaging meanGap, and counts
+    // mostly 1; drawn first, so that only postings_add is timed
+    srand(1);
+    int* gaps = mem_malloc_assert(2 * numPostings * sizeof(int), "gaps");
+    long numAdds = 0;
+    for (int i = 0; i < numPostings; i++) {
+        gaps[2*i] = 1 + rand() % (2 * meanGap - 1);
+        gaps[2*i + 1] = 1 + (rand() % 8 == 0 ? rand() % 20 : 0);
+        numAdds += gaps[2*i + 1];
+    }
+    double start = now();
+    postings_t* postings = postings_new();
+    int docID = 0;
+    for (int i = 0; i < numPostings; i++) {
+        docID += gaps[2*i];
+        for (int c = 0; c < gaps[2*i + 1]; c++) {
+            postings_add(postings, docID);
+        }
+    }
+    double buildSecs = now() - start;
+    mem_free(gaps);
+
+    // the same gaps as standalone frames
+    int numFrames = numPostings / BITPACK_BLOCK;
+    uint32_t values[BITPACK_BLOCK];
+    for (int i = 0; i < BITPACK_BLOCK; i++) {
+        values[i] = rand() % (2 * meanGap - 1);
+    }
+    int bits = bitpack_bits(values);
+    uint8_t* frames = mem_malloc_assert(bitpack_size(bits) * (numFrames + 1), "frames");
+    for (int f = 0; f < numFrames; f++) {
+        bitpack_pack(values, bits, &frames[f * bitpack_size(bits)]);
+    }
+
+    printf("%d postings, mean gap %d, %d-bit frames\n", numPostings, meanGap, bits);
+    printf("build    %8.1f M postings_add/s   %.2f bytes per pair\n",
+           numAdds / buildSecs / 1e6, (double)postings_bytes(postings) / numPostings);
+    for (int k = 0; KERNELS[k] != NULL; k++) {
+        if (!bitpack_select(KERNELS[k])) {
+            printf("%-8s not supported by this CPU\n", KERNELS[k]);
+            continue;
+        }
+
+        start = now();
+        uint32_t out[BITPACK_BLOCK];
+        uint32_t check = 0;
+        for (int f = 0; f < numFrames; f++) {
+            bitpack_unpack(&frames[f * bitpack_size(bits)], bits, 1, out);
+            bitpack_prefix(out, check);
+            check = out[BITPACK_BLOCK - 1];
+        }
+        double frameSecs = now() - start;
+
+        start = now();
+        cursor_t* cursor = postings_open(postings);
+        long sum = 0;
+        while (cursor_next(cursor)) {
+            sum += cursor_docID(cursor) + cursor_count(cursor);
+        }
+        cursor_delete(cursor);
+        double cursorSecs = now() - start;
+
+        printf("%-8s frames %8.1f M ints/s   cursor %8.1f M ints/s   (check %u %ld)\n",
+               bitpack_name(),
+               (double)numFrames * BITPACK_BLOCK / frameSecs / 1e6,
+               2.0 * numPostings / cursorSecs / 1e6, check, sum);
+    }
+
+    mem_free(frames);
+    postings_delete(postings);
+    return 0;
+}
+
+/**************** now() ****************/
+/* wall-clock seconds */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** verify() ****************/
+/* every supported kernel matches scalar at every bit width */
+static bool
+verify(void)
+{
+    uint32_t values[BITPACK_BLOCK];
+    uint32_t expect[BITPACK_BLOCK];
+    uint32_t got[BITPACK_BLOCK];
+    uint8_t frame[BITPACK_BLOCK * 4];
+
+    srand(2);
+    for (int bits = 0; bits <= 32; bits++) {
+        for (int i = 0; i < BITPACK_BLOCK; i++) {
+            uint32_t r = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+            values[i] = bits == 32 ? r : r & ((1u << bits) - 1);
+        }
+        bitpack_pack(values, bits, frame);
+        bitpack_select("scalar");
+        bitpack_unpack(frame, bits, 1, expect);
+        for (int i = 0; i < BITPACK_BLOCK; i++) {
+            if (expect[i] != values[i] + 1) {
+                fprintf(stderr, "ERROR: scalar kernel does not round trip at %d bits\n", bits);
+                return false;
+            }
+        }
+        bitpack_prefix(expect, 7);
+        for (int k = 0; KERNELS[k] != NULL; k++) {
+            if (!bitpack_select(KERNELS[k])) {
+                continue;
+            }
+            bitpack_unpack(frame, bits, 1, got);
+            bitpack_prefix(got, 7);
+            if (memcmp(got, expect, sizeof(got)) != 0) {
+                fprintf(stderr, "ERROR: %s kernel differs at %d bits\n", KERNELS[k], bits);
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,320 @@
+/* doctable.c - CS50 'doctable' module
+ *
+ * Document table: docID -> (URL, depth, length), built in memory by the
+ * indexer and mapped from pageDirectory/.docs by the querier.
+ * See doctable.h for documentation.
+ *
+ * Kyrylo Bakumenko, 15 May 2023
+ */
+
+#define _POSIX_C_SOURCE 200809L // fileno, mmap, fstat
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "doctable.h"
+#include "mem.h"
+
+/**************** file format ****************/
+/* All integers are in host byte order. The file is laid out as
+ *
+ *   header | entries | URLs
+ *
+ * with entry docID - 1 pointing into the URLs block.
+ */
+static const char DOCTABLE_MAGIC[8] = "TSEDOCS";
+static const uint32_t DOCTABLE_VERSION = 2;
+static const char* DOCTABLE_FILE = "/.docs";
+static const char* CRAWLER_FILE = "/.crawler";
+
+typedef struct docheader {
+    char magic[8];              // DOCTABLE_MAGIC
+    uint32_t version;           // DOCTABLE_VERSION
+    uint32_t numDocs;           // number of entries
+    uint64_t urlsOffset;        // byte offset of the URLs block
+    uint64_t fileSize;          // total size, to detect truncation
+    uint64_t crawlSize;         // size of .crawler when saved
+    int64_t crawlTime;          // its mtime then, in nanoseconds
+} docheader_t;
+
+typedef struct docentry {
+    uint64_t urlOffset;         // byte offset into URLs block
+    uint32_t depth;             // crawl depth of the page
+    uint32_t length;            // size of the page file in bytes
+} docentry_t;
+
+/**************** global types ****************/
+typedef struct doctable {
+    const docentry_t* entries;  // numDocs entries
+    const char* urls;           // NUL-terminated URLs
+    int numDocs;
+
+    // a table being built owns growable buffers
+    docentry_t* ownEntries;
+    char* ownUrls;
+    int capacity;               // entries allocated
+    size_t urlsLen;             // bytes used in ownUrls
+    size_t urlsCap;             // bytes allocated for ownUrls
+
+    // a table opened from a file is a read-only mapping
+    void* map;
+    size_t mapSize;
+} doctable_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see doctable.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static char* doctable_path(const char* pageDirectory, const char* file);
+static void doctable_crawl(const char* pageDirectory, uint64_t* size, int64_t* time);
+
+/**************** doctable_new() ****************/
+doctable_t*
+doctable_new(void)
+{
+    doctable_t* table = mem_malloc(sizeof(doctable_t));
+    if (table == NULL) {
+        return NULL;
+    }
+    memset(table, 0, sizeof(doctable_t));
+    return table;
+}
+
+/**************** doctable_add() ****************/
+bool
+doctable_add(doctable_t* table, const int docID, const char* url,
+             const int depth, const size_t length)
+{
+    if (table == NULL || table->map != NULL || url == NULL
+        || docID != table->numDocs + 1 || depth < 0) {
+        return false;
+    }
+
+    // grow both buffers geometrically
+    size_t urlLen = strlen(url) + 1;
+    if (table->numDocs == table->capacity) {
+        int capacity = table->capacity == 0 ? 64 : 2 * table->capacity;
+        docentry_t* entries = mem_malloc(capacity * sizeof(docentry_t));
+        if (entries == NULL) {
+            return false;
+        }
+        if (table->ownEntries != NULL) {
+            memcpy(entries, table->ownEntries, table->numDocs * sizeof(docentry_t));
+            mem_free(table->ownEntries);
+        }
+        table->ownEntries = entries;
+        table->capacity = capacity;
+    }
+    if (table->urlsLen + urlLen > table->urlsCap) {
+        size_t cap = table->urlsCap == 0 ? 4096 : table->urlsCap;
+        while (cap < table->urlsLen + urlLen) {
+            cap *= 2;
+        }
+        char* urls = mem_malloc(cap);
+        if (urls == NULL) {
+            return false;
+        }
+        if (table->ownUrls != NULL) {
+            memcpy(urls, table->ownUrls, table->urlsLen);
+            mem_free(table->ownUrls);
+        }
+        table->ownUrls = urls;
+        table->urlsCap = cap;
+    }
+
+    docentry_t* entry = &table->ownEntries[table->numDocs];
+    entry->urlOffset = table->urlsLen;
+    entry->depth = depth;
+    entry->length = length;
+    memcpy(&table->ownUrls[table->urlsLen], url, urlLen);
+    table->urlsLen += urlLen;
+    table->numDocs++;
+    table->entries = table->ownEntries;
+    table->urls = table->ownUrls;
+    return true;
+}
+
+/**************** doctable_save() ****************/
+bool
+doctable_save(doctable_t* table, const char* pageDirectory)
+{
+    if (table == NULL || pageDirectory == NULL) {
+        return false;
+    }
+    char* path = doctable_path(pageDirectory, DOCTABLE_FILE);
+    FILE* fp = fopen(path, "w");
+    mem_free(path);
+    if (fp == NULL) {
+        return false;
+    }
+
+    // a mapped table is written back as it is
+    size_t urlsLen = table->urlsLen;
+    if (table->map != NULL) {
+        const docheader_t* header = table->map;
+        urlsLen = header->fileSize - header->urlsOffset;
+    }
+
+    docheader_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DOCTABLE_MAGIC, sizeof(header.magic));
+    header.version = DOCTABLE_VERSION;
+    header.numDocs = table->numDocs;
+    header.urlsOffset = sizeof(header) + (uint64_t)table->numDocs * sizeof(docentry_t);
+    header.fileSize = header.urlsOffset + urlsLen;
+    doctable_crawl(pageDirectory, &header.crawlSize, &header.crawlTime);
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (table->numDocs > 0) {
+        ok = ok && fwrite(table->entries, sizeof(docentry_t), table->numDocs, fp) == (size_t)table->numDocs;
+        ok = ok && fwrite(table->urls, 1, urlsLen, fp) == urlsLen;
+    }
+    return fclose(fp) == 0 && ok;
+}
+
+/**************** doctable_open() ****************/
+doctable_t*
+doctable_open(const char* pageDirectory)
+{
+    if (pageDirectory == NULL) {
+        return NULL;
+    }
+    char* path = doctable_path(pageDirectory, DOCTABLE_FILE);
+    FILE* fp = fopen(path, "r");
+    mem_free(path);
+    if (fp == NULL) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || st.st_size < sizeof(docheader_t)) {
+        fclose(fp);
+        return NULL;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    // the mapping stays valid after the file is closed
+    fclose(fp);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    // validate header before trusting any offsets; a table saved
+    // before .crawler was last written is from another crawl
+    const docheader_t* header = map;
+    uint64_t entriesEnd = sizeof(docheader_t) + (uint64_t)header->numDocs * sizeof(docentry_t);
+    uint64_t crawlSize;
+    int64_t crawlTime;
+    doctable_crawl(pageDirectory, &crawlSize, &crawlTime);
+    if (memcmp(header->magic, DOCTABLE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != DOCTABLE_VERSION
+        || header->crawlSize != crawlSize
+        || header->crawlTime != crawlTime
+        || header->fileSize != (uint64_t)st.st_size
+        || header->urlsOffset != entriesEnd
+        || header->urlsOffset > header->fileSize
+        || (header->numDocs > 0 && ((const char*)map)[st.st_size - 1] != '\0')) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    doctable_t* table = doctable_new();
+    if (table == NULL) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    table->map = map;
+    table->mapSize = st.st_size;
+    table->numDocs = header->numDocs;
+    table->entries = (const docentry_t*)((const char*)map + sizeof(docheader_t));
+    table->urls = (const char*)map + header->urlsOffset;
+    table->urlsLen = header->fileSize - header->urlsOffset;
+    return table;
+}
+
+/**************** doctable getters ****************/
+int
+doctable_size(const doctable_t* table)
+{
+    return table == NULL ? 0 : table->numDocs;
+}
+
+const char*
+doctable_url(const doctable_t* table, const int docID)
+{
+    if (table == NULL || docID < 1 || docID > table->numDocs
+        || table->entries[docID - 1].urlOffset >= table->urlsLen) {
+        return NULL;
+    }
+    return &table->urls[table->entries[docID - 1].urlOffset];
+}
+
+int
+doctable_depth(const doctable_t* table, const int docID)
+{
+    if (table == NULL || docID < 1 || docID > table->numDocs) {
+        return 0;
+    }
+    return table->entries[docID - 1].depth;
+}
+
+size_t
+doctable_length(const doctable_t* table, const int docID)
+{
+    if (table == NULL || docID < 1 || docID > table->numDocs) {
+        return 0;
+    }
+    return table->entries[docID - 1].length;
+}
+
+/**************** doctable_delete() ****************/
+void
+doctable_delete(doctable_t* table)
+{
+    if (table == NULL) {
+        return;
+    }
+    if (table->map != NULL) {
+        munmap(table->map, table->mapSize);
+    }
+    if (table->ownEntries != NULL) {
+        mem_free(table->ownEntries);
+    }
+    if (table->ownUrls != NULL) {
+        mem_free(table->ownUrls);
+    }
+    mem_free(table);
+}
+
+/**************** doctable_path() ****************/
+/* returns pageDirectory followed by file, to be mem_free'd */
+static char*
+doctable_path(const char* pageDirectory, const char* file)
+{
+    char* path = mem_malloc_assert(strlen(pageDirectory) + strlen(file) + 1, "doctable path");
+    strcpy(path, pageDirectory);
+    strcat(path, file);
+    return path;
+}
+
+/**************** doctable_crawl() ****************/
+/* sets *size and *time to the size and mtime (ns) of       */
+/* pageDirectory/.crawler, which every crawl rewrites; both */
+/* are 0 if it is missing                                   */
+static void
+doctable_crawl(const char* pageDirectory, uint64_t* size, int64_t* time)
+{
+    char* path = doctable_path(pageDirectory, CRAWLER_FILE);
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        *size = st.st_size;
+        *time = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    } else {
+        *size = 0;
+        *time = 0;
+    }
+    mem_free(path);
+}
@@ -0,0 +1,88 @@
+/*
+ * doctable.h    Kyrylo Bakumenko    15 May, 2023
+ *
+ * A document table maps each docID of a crawler directory to the URL,
+ * depth and size of its page. The indexer builds it while reading the
+ * pages and saves it as pageDirectory/.docs; the querier maps that file
+ * once at startup, so finding a result's URL is an array lookup instead
+ * of opening the page file.
+ *
+ * The file holds a header, an array of (urlOffset, depth, length)
+ * entries indexed by docID - 1, and the NUL-terminated URLs. The header
+ * records the size and modification time of the directory's .crawler
+ * when the table was saved; every crawl rewrites .crawler, so a table
+ * whose record no longer matches is from an earlier crawl.
+ */
+
+#ifndef __DOCTABLE_H
+#define __DOCTABLE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct doctable doctable_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** doctable_new ****************/
+/* Create a new (empty) document table.
+ *
+ * We return:
+ *   pointer to a new table; NULL if error.
+ * Caller is responsible for:
+ *   later calling doctable_delete.
+ */
+doctable_t* doctable_new(void);
+
+/**************** doctable_add ****************/
+/* Add the next document to the table.
+ *
+ * Caller provides:
+ *   valid table pointer, docID one more than the last docID added
+ *   (1 for the first), the page's URL, depth, and size in bytes.
+ * We return:
+ *   true on success; false if any argument is invalid, docID is out of
+ *   order, or the table was opened from a file (it is then read-only).
+ */
+bool doctable_add(doctable_t* table, const int docID, const char* url,
+                  const int depth, const size_t length);
+
+/**************** doctable_save ****************/
+/* Write the table to pageDirectory/.docs.
+ *
+ * We return:
+ *   true if the file was completely written.
+ */
+bool doctable_save(doctable_t* table, const char* pageDirectory);
+
+/**************** doctable_open ****************/
+/* Map pageDirectory/.docs into memory for reading.
+ *
+ * We return:
+ *   pointer to a read-only table; NULL if the file does not exist,
+ *   is not a document table, or is of another version or truncated,
+ *   or if .crawler has been written since it was saved (a re-crawl).
+ * Caller is responsible for:
+ *   later calling doctable_delete.
+ */
+doctable_t* doctable_open(const char* pageDirectory);
+
+/**************** doctable_size ****************/
+/* Return the number of documents, i.e. the largest docID; 0 if NULL. */
+int doctable_size(const doctable_t* table);
+
+/**************** doctable_url, doctable_depth, doctable_length ****************/
+/* Return the URL, depth or size in bytes of document docID;
+ * NULL (or 0) if table is NULL or docID is not in the table.
+ * The URL belongs to the table and is valid until doctable_delete.
+ */
+const char* doctable_url(const doctable_t* table, const int docID);
+int doctable_depth(const doctable_t* table, const int docID);
+size_t doctable_length(const doctable_t* table, const int docID);
+
+/**************** doctable_delete ****************/
+/* Free the table, or unmap its file. */
+void doctable_delete(doctable_t* table);
+
+#endif // __DOCTABLE_H
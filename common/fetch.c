@@ -0,0 +1,997 @@
+/* fetch.c    Kyrylo Bakumenko    24 May, 2023
+ *
+ * Page fetching for the crawler. See fetch.h for documentation.
+ *
+ * Each connection of a fetch loop is a conn_t: connecting (a non-blocking
+ * connect, watched for EPOLLOUT), then sending its requests and reading
+ * their responses, in order. A connection is kept open after a response
+ * that allows it (HTTP/1.1 without "Connection: close", or HTTP/1.0 with
+ * "Connection: keep-alive") and that is delimited by Content-Length or
+ * chunked encoding rather than by EOF; an idle connection to a host is
+ * taken before a new one is opened. Once a connection has been kept
+ * alive, up to the fetch loop's pipeline depth of requests may be sent
+ * on it before their responses arrive.
+ *
+ * A response is read, as much as the socket holds at a time, into one
+ * buffer doubled as needed; the header is parsed once its blank line
+ * arrives, a chunked body is decoded in place as its chunks arrive, and
+ * the body is then moved to the front of the buffer, which becomes the
+ * page's html. Bytes read past the end of a response are the start of
+ * the next, and move to a new buffer.
+ *
+ * A fetch whose connection fails before its response starts (a refused
+ * connect, or a kept-alive connection the server has closed meanwhile)
+ * is queued again, up to 3 attempts in all.
+ */
+
+#define _POSIX_C_SOURCE 200809L // getaddrinfo, clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "fetch.h"
+#include "mem.h"
+
+// attempts at a fetch, as webpage_fetch makes attempts to connect
+static const int MAX_TRY = 3;
+
+// seconds a server may leave us waiting
+static const double TIMEOUT = 30;
+
+// first size of a response buffer, doubled as needed
+static const size_t BUF_MIN = 65536;
+
+// largest response body taken, and largest buffer for one response
+// (BUF_MIN doubled, room for such a body and its header); a fetch whose
+// response is larger fails
+static const long long BODY_MAX = 64LL << 20;
+static const size_t BUF_MAX = 128 << 20;
+
+// events taken from epoll at once
+#define MAX_EVENTS 64
+
+// most requests outstanding on one connection
+#define PIPELINE_MAX 16
+
+// where the decoding of a chunked body is
+enum { CHUNK_SIZE, CHUNK_DATA, CHUNK_END, CHUNK_TRAILER };
+
+/**************** local types ****************/
+typedef struct peer {
+    char* name;                 // "host:port"
+    struct addrinfo* addrs;     // its addresses; NULL if not resolved
+    struct addrinfo* addr;      // the one to connect to next
+    bool noPipeline;            // it dropped pipelined requests
+    struct peer* next;
+} peer_t;
+
+typedef struct queued {
+    const char* url;
+    void* item;
+    int tries;                  // attempts made
+} queued_t;
+
+typedef struct conn {
+    int fd;                     // -1 if the connection is free
+    peer_t* peer;
+    bool connected;
+    uint32_t events;            // watched for
+    int served;                 // responses read on it
+    queued_t pipe[PIPELINE_MAX];  // its fetches, oldest first,
+    int first;                  //   from pipe[first],
+    int count;                  //   count of them; 0 if idle
+    char* out;                  // requests to send, malloc'd
+    size_t outLen;
+    size_t outCap;
+    size_t sent;                // bytes of out sent
+    double deadline;            // when the server has kept us waiting too long
+    // the response to pipe[first]
+    char* buf;                  // read so far, malloc'd
+    size_t len;
+    size_t cap;
+    size_t scanned;             // bytes of buf searched for the blank line
+    size_t bodyStart;           // 0 until the header is in
+    long long bodyLen;          // from Content-Length; -1 if none
+    int status;
+    bool keepAlive;             // the server will keep the connection
+    bool chunked;
+    int chunkState;             // CHUNK_*
+    size_t parsed;              // bytes of buf decoded, if chunked
+    size_t bodyEnd;             // end of the body decoded so far
+    unsigned long long chunkLeft;  // bytes of the chunk yet to come
+} conn_t;
+
+/**************** global types ****************/
+typedef struct fetch {
+    int epfd;
+    int maxConns;
+    int pipeline;               // most requests outstanding on a connection
+    int assigned;               // fetches given to a connection
+    conn_t* conns;              // maxConns of them
+    queued_t* queue;            // fetches not started, queue[head..tail)
+    int head;
+    int tail;
+    int capacity;
+    peer_t* peers;              // every peer resolved
+    char* connectHost;          // from connectTo, or NULL
+    int connectPort;
+} fetch_t;
+
+/**************** local functions ****************/
+static bool fetchQueue(fetch_t* fetch, const queued_t next);
+static int fetchFill(fetch_t* fetch, fetch_done_t done, void* arg);
+static conn_t* fetchPlace(fetch_t* fetch, peer_t* peer);
+static bool fetchConnect(fetch_t* fetch, conn_t* conn, peer_t* peer);
+static bool fetchRequest(fetch_t* fetch, conn_t* conn, const queued_t next,
+                         const char* host, const char* path);
+static bool fetchWrite(fetch_t* fetch, conn_t* conn);
+static void fetchWatch(fetch_t* fetch, conn_t* conn, const uint32_t events);
+static int fetchStep(fetch_t* fetch, conn_t* conn, fetch_done_t done, void* arg);
+static int fetchParse(conn_t* conn);
+static int fetchChunks(conn_t* conn);
+static int fetchComplete(fetch_t* fetch, conn_t* conn, fetch_done_t done, void* arg);
+static int fetchDrop(fetch_t* fetch, conn_t* conn, const bool failFirst,
+                     fetch_done_t done, void* arg);
+static void fetchClose(fetch_t* fetch, conn_t* conn);
+static void fetchReset(conn_t* conn);
+static bool fetchHas(const char* value, const char* token);
+static peer_t* fetchPeer(fetch_t* fetch, const char* host, const int port);
+static void fetchOne(void* arg, const char* url, void* item, char* html);
+static double now(void);
+
+/**************** fetch_new() ****************/
+fetch_t*
+fetch_new(const int maxConns, const char* connectTo)
+{
+    if (maxConns <= 0) {
+        return NULL;
+    }
+    fetch_t* fetch = mem_malloc(sizeof(fetch_t));
+    if (fetch == NULL) {
+        return NULL;
+    }
+    fetch->maxConns = maxConns;
+    fetch->pipeline = 1;
+    fetch->assigned = 0;
+    fetch->queue = NULL;
+    fetch->head = fetch->tail = fetch->capacity = 0;
+    fetch->peers = NULL;
+    fetch->connectHost = NULL;
+    fetch->connectPort = 0;
+    fetch->epfd = -1;
+    fetch->conns = mem_malloc(maxConns * sizeof(conn_t));
+    if (fetch->conns == NULL) {
+        fetch_delete(fetch);
+        return NULL;
+    }
+    // every conn is closed and empty before fetch_delete may see it
+    for (int c = 0; c < maxConns; c++) {
+        conn_t* conn = &fetch->conns[c];
+        conn->fd = -1;
+        conn->count = 0;
+        conn->out = NULL;
+        conn->outLen = conn->outCap = conn->sent = 0;
+        conn->buf = NULL;
+        conn->len = conn->cap = 0;
+    }
+    if ((fetch->epfd = epoll_create1(0)) < 0) {
+        fetch_delete(fetch);
+        return NULL;
+    }
+
+    if (connectTo != NULL) {
+        const char* colon = strrchr(connectTo, ':');
+        if (colon == NULL || colon == connectTo || (fetch->connectPort = atoi(colon + 1)) <= 0
+            || (fetch->connectHost = mem_malloc(colon - connectTo + 1)) == NULL) {
+            fetch_delete(fetch);
+            return NULL;
+        }
+        memcpy(fetch->connectHost, connectTo, colon - connectTo);
+        fetch->connectHost[colon - connectTo] = '\0';
+    }
+    return fetch;
+}
+
+/**************** fetch_pipeline() ****************/
+void
+fetch_pipeline(fetch_t* fetch, const int depth)
+{
+    if (fetch != NULL) {
+        fetch->pipeline = depth < 1 ? 1 : depth > PIPELINE_MAX ? PIPELINE_MAX : depth;
+    }
+}
+
+/**************** fetch_add() ****************/
+bool
+fetch_add(fetch_t* fetch, const char* url, void* item)
+{
+    if (fetch == NULL || url == NULL) {
+        return false;
+    }
+    queued_t next = { url, item, 0 };
+    return fetchQueue(fetch, next);
+}
+
+/**************** fetch_run() ****************/
+int
+fetch_run(fetch_t* fetch, const int timeout, fetch_done_t done, void* arg)
+{
+    if (fetch == NULL || done == NULL) {
+        return 0;
+    }
+    double until = timeout < 0 ? -1 : now() + timeout / 1000.0;
+    int completed = 0;
+    while (true) {
+        completed += fetchFill(fetch, done, arg);
+        if (completed > 0 || (fetch->assigned == 0 && fetch->head == fetch->tail && timeout < 0)) {
+            return completed;
+        }
+
+        // wait until the timeout, or until a connection times out
+        double wake = until;
+        for (int c = 0; c < fetch->maxConns; c++) {
+            conn_t* conn = &fetch->conns[c];
+            if (conn->count > 0 && (wake < 0 || conn->deadline < wake)) {
+                wake = conn->deadline;
+            }
+        }
+        int wait = -1;
+        if (wake >= 0) {
+            double ms = (wake - now()) * 1000;
+            wait = ms <= 0 ? 0 : (int)ms + 1;
+        }
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(fetch->epfd, events, MAX_EVENTS, wait);
+        for (int e = 0; e < n; e++) {
+            completed += fetchStep(fetch, events[e].data.ptr, done, arg);
+        }
+
+        double t = now();
+        for (int c = 0; c < fetch->maxConns; c++) {
+            conn_t* conn = &fetch->conns[c];
+            if (conn->count > 0 && t >= conn->deadline) {
+                completed += fetchDrop(fetch, conn, true, done, arg);
+            }
+        }
+        if (completed > 0 || (until >= 0 && t >= until)) {
+            return completed;
+        }
+    }
+}
+
+/**************** fetch_pending() ****************/
+int
+fetch_pending(fetch_t* fetch)
+{
+    return fetch == NULL ? 0 : fetch->assigned + fetch->tail - fetch->head;
+}
+
+/**************** fetch_delete() ****************/
+void
+fetch_delete(fetch_t* fetch)
+{
+    if (fetch == NULL) {
+        return;
+    }
+    if (fetch->conns != NULL) {
+        for (int c = 0; c < fetch->maxConns; c++) {
+            conn_t* conn = &fetch->conns[c];
+            if (conn->fd >= 0) {
+                close(conn->fd);
+            }
+            free(conn->out);
+            free(conn->buf);
+        }
+        mem_free(fetch->conns);
+    }
+    if (fetch->epfd >= 0) {
+        close(fetch->epfd);
+    }
+    if (fetch->queue != NULL) {
+        mem_free(fetch->queue);
+    }
+    while (fetch->peers != NULL) {
+        peer_t* next = fetch->peers->next;
+        if (fetch->peers->addrs != NULL) {
+            freeaddrinfo(fetch->peers->addrs);
+        }
+        mem_free(fetch->peers->name);
+        mem_free(fetch->peers);
+        fetch->peers = next;
+    }
+    if (fetch->connectHost != NULL) {
+        mem_free(fetch->connectHost);
+    }
+    mem_free(fetch);
+}
+
+/**************** fetch_page() ****************/
+char*
+fetch_page(fetch_t* fetch, const char* url)
+{
+    char* html = NULL;
+    if (fetch_add(fetch, url, &html)) {
+        while (fetch_pending(fetch) > 0) {
+            fetch_run(fetch, -1, fetchOne, NULL);
+        }
+    }
+    return html;
+}
+
+/**************** fetch_url() ****************/
+char*
+fetch_url(const char* url, const char* connectTo)
+{
+    fetch_t* fetch = fetch_new(1, connectTo);
+    char* html = fetch_page(fetch, url);
+    fetch_delete(fetch);
+    return html;
+}
+
+/**************** fetch_parseURL() ****************/
+bool
+fetch_parseURL(const char* url, char* host, int* port, const char** path)
+{
+    static const char SCHEME[] = "http://";
+    if (url == NULL || strncasecmp(url, SCHEME, strlen(SCHEME)) != 0) {
+        return false;
+    }
+    const char* start = url + strlen(SCHEME);
+    size_t hostLen = strcspn(start, ":/");
+    if (hostLen == 0) {
+        return false;
+    }
+    memcpy(host, start, hostLen);
+    host[hostLen] = '\0';
+    *port = 80;
+    const char* rest = start + hostLen;
+    if (*rest == ':') {
+        char* end;
+        long p = strtol(rest + 1, &end, 10);
+        if (end == rest + 1 || p <= 0 || p > 65535 || (*end != '/' && *end != '\0')) {
+            return false;
+        }
+        *port = p;
+        rest = end;
+    }
+    *path = rest;
+    return true;
+}
+
+/**************** fetchQueue() ****************/
+/* appends next to the queue of fetches not started */
+static bool
+fetchQueue(fetch_t* fetch, const queued_t next)
+{
+    if (fetch->tail == fetch->capacity) {
+        int count = fetch->tail - fetch->head;
+        int capacity = fetch->capacity;
+        if (count >= capacity / 2) {
+            capacity = capacity == 0 ? 64 : 2 * capacity;
+        }
+        queued_t* queue = mem_malloc(capacity * sizeof(queued_t));
+        if (queue == NULL) {
+            return false;
+        }
+        if (fetch->queue != NULL) {
+            memcpy(queue, &fetch->queue[fetch->head], count * sizeof(queued_t));
+            mem_free(fetch->queue);
+        }
+        fetch->queue = queue;
+        fetch->head = 0;
+        fetch->tail = count;
+        fetch->capacity = capacity;
+    }
+    fetch->queue[fetch->tail++] = next;
+    return true;
+}
+
+/**************** fetchFill() ****************/
+/* gives queued fetches to connections while there are any to */
+/* take them; returns the number that failed at once (a bad  */
+/* URL or host, or no attempts left), reported through done  */
+static int
+fetchFill(fetch_t* fetch, fetch_done_t done, void* arg)
+{
+    int failed = 0;
+    while (fetch->head < fetch->tail) {
+        queued_t next = fetch->queue[fetch->head];
+        char host[strlen(next.url) + 1];
+        int port;
+        const char* path;
+        peer_t* peer = NULL;
+        if (next.tries >= MAX_TRY || !fetch_parseURL(next.url, host, &port, &path)
+            || (peer = fetch->connectHost != NULL
+                ? fetchPeer(fetch, fetch->connectHost, fetch->connectPort)
+                : fetchPeer(fetch, host, port)) == NULL
+            || peer->addrs == NULL) {
+            fetch->head++;
+            done(arg, next.url, next.item, NULL);
+            failed++;
+            continue;
+        }
+        conn_t* conn = fetchPlace(fetch, peer);
+        if (conn == NULL) {
+            break;
+        }
+        fetch->head++;
+        if (conn->fd < 0 && !fetchConnect(fetch, conn, peer)) {
+            next.tries++;
+            fetchQueue(fetch, next);
+            continue;
+        }
+        if (!fetchRequest(fetch, conn, next, host, path)) {
+            failed += fetchDrop(fetch, conn, false, done, arg);
+        }
+    }
+    return failed;
+}
+
+/**************** fetchPlace() ****************/
+/* the connection to give a fetch from peer: an idle one to */
+/* peer, else a free one, else one to peer that has room in */
+/* its pipeline, else an idle one to another peer (closed); */
+/* NULL if none will do                                     */
+static conn_t*
+fetchPlace(fetch_t* fetch, peer_t* peer)
+{
+    conn_t* free = NULL;
+    conn_t* pipelined = NULL;
+    conn_t* idle = NULL;
+    for (int c = 0; c < fetch->maxConns; c++) {
+        conn_t* conn = &fetch->conns[c];
+        if (conn->fd < 0) {
+            if (free == NULL) {
+                free = conn;
+            }
+        } else if (conn->peer != peer) {
+            if (conn->count == 0 && idle == NULL) {
+                idle = conn;
+            }
+        } else if (conn->count == 0) {
+            return conn;
+        } else if (conn->served > 0 && conn->keepAlive && !peer->noPipeline
+                   && conn->count < fetch->pipeline
+                   && (pipelined == NULL || conn->count < pipelined->count)) {
+            pipelined = conn;
+        }
+    }
+    if (free == NULL && pipelined == NULL && idle != NULL) {
+        fetchClose(fetch, idle);
+        free = idle;
+    }
+    return free != NULL ? free : pipelined;
+}
+
+/**************** fetchConnect() ****************/
+/* starts connecting the free conn to peer's next address; */
+/* false if that fails at once                             */
+static bool
+fetchConnect(fetch_t* fetch, conn_t* conn, peer_t* peer)
+{
+    struct addrinfo* a = peer->addr;
+    peer->addr = a->ai_next != NULL ? a->ai_next : peer->addrs;
+    conn->fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (conn->fd < 0) {
+        return false;
+    }
+    fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK);
+    // a pipelined request goes out at once, not after the last one's ACK
+    int on = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    struct epoll_event event = { .events = EPOLLOUT, .data.ptr = conn };
+    if ((connect(conn->fd, a->ai_addr, a->ai_addrlen) != 0 && errno != EINPROGRESS)
+        || epoll_ctl(fetch->epfd, EPOLL_CTL_ADD, conn->fd, &event) != 0) {
+        close(conn->fd);
+        conn->fd = -1;
+        return false;
+    }
+    conn->peer = peer;
+    conn->connected = false;
+    conn->events = EPOLLOUT;
+    conn->served = 0;
+    conn->first = conn->count = 0;
+    conn->outLen = conn->sent = 0;
+    conn->keepAlive = false;
+    fetchReset(conn);
+    return true;
+}
+
+/**************** fetchRequest() ****************/
+/* gives next to conn: queues its request, and sends what it */
+/* can of it if conn is connected; false if that fails (next */
+/* is conn's all the same)                                   */
+static bool
+fetchRequest(fetch_t* fetch, conn_t* conn, const queued_t next,
+             const char* host, const char* path)
+{
+    if (conn->count == 0) {
+        conn->deadline = now() + TIMEOUT;
+    }
+    conn->pipe[(conn->first + conn->count) % PIPELINE_MAX] = next;
+    conn->count++;
+    fetch->assigned++;
+
+    // the request webpage_fetch sends, but for Connection: close
+    size_t size = strlen(path) + strlen(host) + 32;
+    if (conn->outLen + size > conn->outCap) {
+        size_t cap = conn->outCap == 0 ? 1024 : conn->outCap;
+        while (cap < conn->outLen + size) {
+            cap *= 2;
+        }
+        char* grown = realloc(conn->out, cap);
+        if (grown == NULL) {
+            return false;
+        }
+        conn->out = grown;
+        conn->outCap = cap;
+    }
+    conn->outLen += snprintf(&conn->out[conn->outLen], size,
+                             "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n",
+                             path[0] == '\0' ? "/" : path, host);
+    return !conn->connected || fetchWrite(fetch, conn);
+}
+
+/**************** fetchWrite() ****************/
+/* sends what it can of conn's requests; false on error */
+static bool
+fetchWrite(fetch_t* fetch, conn_t* conn)
+{
+    while (conn->sent < conn->outLen) {
+        ssize_t n = send(conn->fd, &conn->out[conn->sent],
+                         conn->outLen - conn->sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        if (n < 0) {
+            break;
+        }
+        conn->sent += n;
+    }
+    if (conn->sent == conn->outLen) {
+        conn->sent = conn->outLen = 0;
+    }
+    fetchWatch(fetch, conn, conn->outLen > 0 ? EPOLLIN | EPOLLOUT : EPOLLIN);
+    return true;
+}
+
+/**************** fetchWatch() ****************/
+/* has epoll watch conn for events */
+static void
+fetchWatch(fetch_t* fetch, conn_t* conn, const uint32_t events)
+{
+    if (conn->events != events) {
+        struct epoll_event event = { .events = events, .data.ptr = conn };
+        epoll_ctl(fetch->epfd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = events;
+    }
+}
+
+/**************** fetchStep() ****************/
+/* makes what progress conn can without blocking: connects, */
+/* sends, reads; returns the number of fetches completed    */
+/* (or failed), reported through done                       */
+static int
+fetchStep(fetch_t* fetch, conn_t* conn, fetch_done_t done, void* arg)
+{
+    if (conn->count == 0) {
+        // idle: the server closed it, or sent what was not asked for
+        fetchClose(fetch, conn);
+        return 0;
+    }
+    conn->deadline = now() + TIMEOUT;
+    if (!conn->connected) {
+        int error = 0;
+        socklen_t size = sizeof(error);
+        if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &size) != 0 || error != 0) {
+            // try again, without the sleep webpage_fetch makes
+            return fetchDrop(fetch, conn, false, done, arg);
+        }
+        conn->connected = true;
+    }
+    if (!fetchWrite(fetch, conn)) {
+        return fetchDrop(fetch, conn, false, done, arg);
+    }
+
+    // read all there is
+    int completed = 0;
+    while (conn->fd >= 0) {
+        // the end of this response, if its length is known
+        size_t end = conn->bodyStart > 0 && !conn->chunked && conn->bodyLen >= 0
+            ? conn->bodyStart + conn->bodyLen : 0;
+        if (conn->len + 1 >= conn->cap) {
+            size_t cap = conn->cap == 0 ? BUF_MIN : 2 * conn->cap;
+            while (cap < end + 1 && cap < BUF_MAX) {
+                cap *= 2;
+            }
+            if (cap > BUF_MAX) {
+                // the response outgrew BUF_MAX
+                return completed + fetchDrop(fetch, conn, true, done, arg);
+            }
+            char* grown = realloc(conn->buf, cap);
+            if (grown == NULL) {
+                return completed + fetchDrop(fetch, conn, true, done, arg);
+            }
+            conn->buf = grown;
+            conn->cap = cap;
+        }
+        // with responses pipelined behind it, read no further than its
+        // end, so the next is not copied out of its buffer
+        size_t want = conn->cap - 1 - conn->len;
+        if (end > conn->len && conn->count > 1 && end - conn->len < want) {
+            want = end - conn->len;
+        }
+        ssize_t n = read(conn->fd, &conn->buf[conn->len], want);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            if (n == 0 && conn->count == 0) {
+                fetchClose(fetch, conn);
+            } else if (n == 0 && conn->bodyStart > 0 && !conn->chunked && conn->bodyLen < 0) {
+                // the body is all there is until EOF
+                completed += fetchComplete(fetch, conn, done, arg);
+            } else {
+                completed += fetchDrop(fetch, conn, conn->len > 0, done, arg);
+            }
+            break;
+        }
+        conn->len += n;
+        conn->buf[conn->len] = '\0';
+
+        // the responses now in, perhaps several
+        int parsed;
+        while (conn->count > 0 && (parsed = fetchParse(conn)) != 0) {
+            completed += parsed < 0
+                ? fetchDrop(fetch, conn, true, done, arg)
+                : fetchComplete(fetch, conn, done, arg);
+        }
+    }
+    return completed;
+}
+
+/**************** fetchParse() ****************/
+/* parses what more has arrived of conn's response: the     */
+/* header once it is in, then the body; returns 1 once the  */
+/* response is complete, 0 if there is more to come, -1 if  */
+/* it is not HTTP or its Content-Length is out of range     */
+static int
+fetchParse(conn_t* conn)
+{
+    if (conn->len == 0) {
+        return 0;
+    }
+    if (conn->bodyStart == 0) {
+        // a blank line is "\r\n" or "\n", as webpage_fetch reads it
+        char* end = conn->buf + conn->len;
+        for (char* nl = memchr(conn->buf + conn->scanned, '\n', end - conn->buf - conn->scanned);
+             nl != NULL; nl = memchr(nl + 1, '\n', end - nl - 1)) {
+            if (nl + 1 < end && nl[1] == '\n') {
+                conn->bodyStart = nl + 2 - conn->buf;
+                break;
+            }
+            if (nl + 2 < end && nl[1] == '\r' && nl[2] == '\n') {
+                conn->bodyStart = nl + 3 - conn->buf;
+                break;
+            }
+        }
+        if (conn->bodyStart == 0) {
+            // a blank line may start in the last two bytes
+            conn->scanned = conn->len < 2 ? 0 : conn->len - 2;
+            return 0;
+        }
+
+        int minor = 0;
+        if (sscanf(conn->buf, "HTTP/1.%d %d", &minor, &conn->status) != 2) {
+            return -1;
+        }
+        bool close = false;
+        bool keepAlive = false;
+        bool badLength = false;
+        for (char* line = strchr(conn->buf, '\n') + 1; line < conn->buf + conn->bodyStart;
+             line = strchr(line, '\n') + 1) {
+            char* value = strchr(line, ':');
+            if (value == NULL || value > strchr(line, '\n')) {
+                continue;
+            }
+            size_t nameLen = value - line;
+            char* nl = strchr(value, '\n');
+            *nl = '\0';
+            if (nameLen == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+                // strtoll clamps an overlong length to LLONG_MAX
+                errno = 0;
+                conn->bodyLen = strtoll(value + 1, NULL, 10);
+                badLength = errno != 0 || conn->bodyLen < 0 || conn->bodyLen > BODY_MAX;
+            } else if (nameLen == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+                conn->chunked = fetchHas(value + 1, "chunked");
+            } else if (nameLen == 10 && strncasecmp(line, "Connection", 10) == 0) {
+                close = fetchHas(value + 1, "close");
+                keepAlive = fetchHas(value + 1, "keep-alive");
+            }
+            *nl = '\n';
+        }
+        if (badLength) {
+            return -1;
+        }
+        conn->keepAlive = minor >= 1 ? !close : keepAlive;
+        if (conn->chunked) {
+            conn->bodyLen = -1;
+            conn->chunkState = CHUNK_SIZE;
+            conn->parsed = conn->bodyEnd = conn->bodyStart;
+        } else if (conn->status / 100 == 1 || conn->status == 204 || conn->status == 304) {
+            conn->bodyLen = 0;
+        } else if (conn->bodyLen < 0) {
+            // the body ends at EOF
+            conn->keepAlive = false;
+        }
+    }
+
+    if (conn->chunked) {
+        return fetchChunks(conn);
+    }
+    return conn->bodyLen >= 0 && conn->len - conn->bodyStart >= conn->bodyLen ? 1 : 0;
+}
+
+/**************** fetchChunks() ****************/
+/* decodes what more has arrived of conn's chunked body, in  */
+/* place: chunk data moves down to bodyEnd, over the chunk   */
+/* sizes before it; returns as fetchParse                    */
+static int
+fetchChunks(conn_t* conn)
+{
+    char* buf = conn->buf;
+    while (true) {
+        if (conn->chunkState == CHUNK_DATA) {
+            size_t take = conn->len - conn->parsed;
+            if (take > conn->chunkLeft) {
+                take = conn->chunkLeft;
+            }
+            memmove(&buf[conn->bodyEnd], &buf[conn->parsed], take);
+            conn->bodyEnd += take;
+            conn->parsed += take;
+            conn->chunkLeft -= take;
+            if (conn->chunkLeft > 0) {
+                return 0;
+            }
+            conn->chunkState = CHUNK_END;
+            continue;
+        }
+        // the other states read a line
+        char* nl = memchr(&buf[conn->parsed], '\n', conn->len - conn->parsed);
+        if (nl == NULL) {
+            return conn->len - conn->parsed > 1024 ? -1 : 0;
+        }
+        char* line = &buf[conn->parsed];
+        conn->parsed = nl + 1 - buf;
+        if (conn->chunkState == CHUNK_SIZE) {
+            char* end;
+            conn->chunkLeft = strtoull(line, &end, 16);
+            if (end == line) {
+                return -1;
+            }
+            conn->chunkState = conn->chunkLeft == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+        } else if (conn->chunkState == CHUNK_END) {
+            // the line ending the chunk's data
+            conn->chunkState = CHUNK_SIZE;
+        } else if (nl == line || (nl == line + 1 && line[0] == '\r')) {
+            // the blank line after the trailers
+            return 1;
+        }
+    }
+}
+
+/**************** fetchComplete() ****************/
+/* passes the complete response to conn's first fetch to done  */
+/* (its body if a 200, else NULL); keeps conn for its next     */
+/* fetches if the server keeps it, else closes it and queues   */
+/* them again; returns the number of fetches completed         */
+static int
+fetchComplete(fetch_t* fetch, conn_t* conn, fetch_done_t done, void* arg)
+{
+    queued_t fetched = conn->pipe[conn->first];
+    conn->first = (conn->first + 1) % PIPELINE_MAX;
+    conn->count--;
+    fetch->assigned--;
+    conn->served++;
+
+    size_t end;
+    size_t bodyLen;
+    if (conn->chunked) {
+        end = conn->parsed;
+        bodyLen = conn->bodyEnd - conn->bodyStart;
+    } else if (conn->bodyLen >= 0) {
+        end = conn->bodyStart + conn->bodyLen;
+        bodyLen = conn->bodyLen;
+    } else {
+        end = conn->len;
+        bodyLen = conn->len - conn->bodyStart;
+    }
+    char* buf = conn->buf;
+    size_t len = conn->len;
+    size_t bodyStart = conn->bodyStart;
+    int status = conn->status;
+    bool keep = conn->keepAlive;
+
+    // what follows is the start of the next response
+    conn->buf = NULL;
+    conn->len = conn->cap = 0;
+    fetchReset(conn);
+    if (keep && end < len) {
+        size_t cap = BUF_MIN;
+        while (cap < len - end + 1) {
+            cap *= 2;
+        }
+        if ((conn->buf = malloc(cap)) == NULL) {
+            keep = false;
+        } else {
+            conn->cap = cap;
+            conn->len = len - end;
+            memcpy(conn->buf, &buf[end], conn->len);
+            conn->buf[conn->len] = '\0';
+        }
+    }
+
+    char* html = NULL;
+    if (status == 200) {
+        memmove(buf, &buf[bodyStart], bodyLen);
+        buf[bodyLen] = '\0';
+        html = buf;
+    } else {
+        free(buf);
+    }
+    if (!keep) {
+        fetchClose(fetch, conn);
+    }
+    done(arg, fetched.url, fetched.item, html);
+    return 1;
+}
+
+/**************** fetchDrop() ****************/
+/* closes conn, which failed; its first fetch fails if       */
+/* failFirst (its response had started), and its others are  */
+/* queued again; returns the number of fetches completed     */
+static int
+fetchDrop(fetch_t* fetch, conn_t* conn, const bool failFirst, fetch_done_t done, void* arg)
+{
+    if (conn->count > 1) {
+        // requests were pipelined, and lost
+        conn->peer->noPipeline = true;
+    }
+    queued_t first = conn->pipe[conn->first];
+    bool failed = failFirst && conn->count > 0;
+    if (failed) {
+        conn->first = (conn->first + 1) % PIPELINE_MAX;
+        conn->count--;
+        fetch->assigned--;
+    }
+    fetchClose(fetch, conn);
+    if (failed) {
+        done(arg, first.url, first.item, NULL);
+        return 1;
+    }
+    return 0;
+}
+
+/**************** fetchClose() ****************/
+/* closes conn and frees it; its fetches go back in the queue, */
+/* each counting an attempt                                    */
+static void
+fetchClose(fetch_t* fetch, conn_t* conn)
+{
+    for (int i = 0; i < conn->count; i++) {
+        queued_t again = conn->pipe[(conn->first + i) % PIPELINE_MAX];
+        again.tries++;
+        fetchQueue(fetch, again);
+    }
+    fetch->assigned -= conn->count;
+    conn->count = 0;
+    close(conn->fd);
+    conn->fd = -1;
+    free(conn->buf);
+    conn->buf = NULL;
+    conn->len = conn->cap = 0;
+    conn->outLen = conn->sent = 0;
+}
+
+/**************** fetchReset() ****************/
+/* readies conn to parse a new response */
+static void
+fetchReset(conn_t* conn)
+{
+    conn->scanned = 0;
+    conn->bodyStart = 0;
+    conn->bodyLen = -1;
+    conn->status = 0;
+    conn->chunked = false;
+}
+
+/**************** fetchHas() ****************/
+/* whether the comma-separated header value has token, in any case */
+static bool
+fetchHas(const char* value, const char* token)
+{
+    size_t len = strlen(token);
+    while (*value != '\0') {
+        value += strspn(value, " \t,");
+        size_t wordLen = strcspn(value, " \t,;\r");
+        if (wordLen == len && strncasecmp(value, token, len) == 0) {
+            return true;
+        }
+        value += wordLen;
+        value += strcspn(value, ",");
+    }
+    return false;
+}
+
+/**************** fetchPeer() ****************/
+/* host:port, resolved the first time it is asked for;  */
+/* its addrs are NULL if it cannot be; NULL if no memory */
+static peer_t*
+fetchPeer(fetch_t* fetch, const char* host, const int port)
+{
+    char name[strlen(host) + 16];
+    sprintf(name, "%s:%d", host, port);
+    for (peer_t* peer = fetch->peers; peer != NULL; peer = peer->next) {
+        if (strcmp(peer->name, name) == 0) {
+            return peer;
+        }
+    }
+
+    peer_t* peer = mem_malloc(sizeof(peer_t));
+    if (peer == NULL || (peer->name = mem_malloc(strlen(name) + 1)) == NULL) {
+        if (peer != NULL) {
+            mem_free(peer);
+        }
+        return NULL;
+    }
+    strcpy(peer->name, name);
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, service, &hints, &peer->addrs) != 0) {
+        peer->addrs = NULL;
+    }
+    peer->addr = peer->addrs;
+    peer->noPipeline = false;
+    peer->next = fetch->peers;
+    fetch->peers = peer;
+    return peer;
+}
+
+/**************** fetchOne() ****************/
+/* the callback of fetch_page: keeps the html in item */
+static void
+fetchOne(void* arg, const char* url, void* item, char* html)
+{
+    *(char**)item = html;
+}
+
+/**************** now() ****************/
+/* seconds on the monotonic clock */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
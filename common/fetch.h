@@ -0,0 +1,159 @@
+/*
+ * fetch.h    Kyrylo Bakumenko    24 May, 2023
+ *
+ * Page fetching for the crawler, without webpage_fetch. That resolves
+ * with gethostbyname (not reentrant), blocks on one connection at a time,
+ * reads the response through stdio a character at a time and sleeps a
+ * second per connection attempt.
+ *
+ * A *fetch_t* is an event loop of non-blocking fetches, driven by epoll:
+ * one thread keeps up to maxConns connections in flight, reads each
+ * response in large pieces as it arrives, parsing it as it goes, and
+ * hands every completed page to a callback. Hosts are resolved with
+ * getaddrinfo, once per fetch_t. Connections are kept alive where the
+ * server allows, and taken again for the next fetch from the same host,
+ * so most fetches need no connect; with fetch_pipeline, several requests
+ * may be sent on one connection before their responses arrive. Bodies
+ * may be delimited by Content-Length, chunked encoding, or EOF; a body
+ * over 64 MiB, or a Content-Length out of range, fails its fetch.
+ *
+ * A fetch_t is not thread-safe: give each thread its own. fetch_page
+ * fetches one page through a fetch_t, blocking; fetch_url fetches one
+ * page with a fetch_t of its own. Politeness is left to the caller.
+ *
+ * A fetch may be sent to another server than the URL's host, as curl's
+ * --connect-to does: the request is the same, Host header included, so a
+ * local stand-in server can serve an internal site for testing.
+ */
+
+#ifndef __FETCH_H
+#define __FETCH_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct fetch fetch_t;  // opaque to users of the module
+
+/* called once for every fetch added, as it completes: item and url as
+ * given to fetch_add; html is the body of a 200 response, NUL-terminated
+ * and malloc'd (for webpage_new; webpage_delete frees it), or NULL if the
+ * fetch failed; arg as given to fetch_run.
+ */
+typedef void (*fetch_done_t)(void* arg, const char* url, void* item, char* html);
+
+/**************** functions ****************/
+
+/**************** fetch_new ****************/
+/* Create a new fetch loop, with no fetches.
+ *
+ * Caller provides:
+ *   maxConns > 0, the most connections to have open at once;
+ *   connectTo, "host:port" to connect to instead of each URL's host
+ *   and port, or NULL; it must outlive the fetch loop.
+ * We return:
+ *   pointer to the new fetch loop; NULL if error (out of memory, no
+ *   epoll, or connectTo is not of that form).
+ * Caller is responsible for:
+ *   later calling fetch_delete.
+ */
+fetch_t* fetch_new(const int maxConns, const char* connectTo);
+
+/**************** fetch_pipeline ****************/
+/* Set the most requests outstanding on one connection, from 1 (the
+ * default: no pipelining) to 16.
+ *
+ * Notes:
+ *   requests are pipelined only on a connection the server has kept
+ *   alive, and no longer to a server that once dropped pipelined
+ *   requests, which are then sent again.
+ */
+void fetch_pipeline(fetch_t* fetch, const int depth);
+
+/**************** fetch_add ****************/
+/* Queue a fetch of url, to start when a connection is free.
+ *
+ * Caller provides:
+ *   valid fetch pointer; url of the form http://host[:port][/path],
+ *   unchanged until its fetch completes; item, anything (not used).
+ * We return:
+ *   true if queued; false if fetch or url is NULL, or out of memory.
+ * Notes:
+ *   the callback of fetch_run may add fetches.
+ */
+bool fetch_add(fetch_t* fetch, const char* url, void* item);
+
+/**************** fetch_run ****************/
+/* Start what queued fetches the free connections allow, then wait for
+ * fetches to complete, calling done for each.
+ *
+ * Caller provides:
+ *   valid fetch pointer; done, the callback; arg, passed to it;
+ *   timeout in milliseconds, or -1 to wait as long as it takes.
+ * We return:
+ *   the number of fetches completed, as soon as it is at least one, or
+ *   0 once timeout passes first, or at once if there is nothing to fetch
+ *   and no timeout.
+ * Notes:
+ *   a fetch is tried 3 times if its connection fails before the
+ *   response begins (3 attempts to connect, as webpage_fetch makes, or
+ *   a kept-alive connection closed by the server meanwhile); a server
+ *   that sends nothing for 30 seconds fails the fetch.
+ */
+int fetch_run(fetch_t* fetch, const int timeout, fetch_done_t done, void* arg);
+
+/**************** fetch_pending ****************/
+/* Return the number of fetches queued or in flight (0 if fetch is NULL). */
+int fetch_pending(fetch_t* fetch);
+
+/**************** fetch_delete ****************/
+/* Close every connection and free the fetch loop.
+ *
+ * Caller provides:
+ *   valid fetch pointer, or NULL (ignored).
+ * Notes:
+ *   fetches not yet complete are dropped, without a call to done.
+ */
+void fetch_delete(fetch_t* fetch);
+
+/**************** fetch_page ****************/
+/* Fetch url through fetch, blocking until it is done.
+ *
+ * Caller provides:
+ *   valid fetch pointer with no fetches pending; url as for fetch_add.
+ * We return:
+ *   as fetch_url; the connection stays open for the next fetch_page.
+ */
+char* fetch_page(fetch_t* fetch, const char* url);
+
+/**************** fetch_url ****************/
+/* Fetch an http:// URL with one HTTP/1.1 GET, as webpage_fetch does.
+ *
+ * Caller provides:
+ *   url of the form http://host[:port][/path];
+ *   connectTo, "host:port" to connect to instead of the URL's host
+ *   and port, or NULL.
+ * We return:
+ *   the body of a 200 response, NUL-terminated, malloc'd (as for
+ *   webpage_new; webpage_delete frees it); NULL if the URL cannot be
+ *   parsed, the server cannot be reached (after 3 attempts to connect),
+ *   or the response is not a 200.
+ * Notes:
+ *   fetch_page with a fetch loop of one connection, made and deleted
+ *   for the call.
+ */
+char* fetch_url(const char* url, const char* connectTo);
+
+/**************** fetch_parseURL ****************/
+/* Split url into its host, port and path.
+ *
+ * Caller provides:
+ *   url of the form http://host[:port][/path]; host must hold the host
+ *   (at most strlen(url) + 1 bytes); path is set to point into url.
+ * We return:
+ *   true with host, port (80 if none) and path ("/..." or "") set;
+ *   false if url is not of that form.
+ */
+bool fetch_parseURL(const char* url, char* host, int* port, const char** path);
+
+#endif // __FETCH_H
@@ -0,0 +1,438 @@
+/* fetchbench.c    Kyrylo Bakumenko    25 May, 2023
+ *
+ * Fetch throughput benchmark, against an HTTP server run in a thread of
+ * this process on 127.0.0.1 (so no network and no politeness delay), which
+ * answers every GET with the same page of pageSize bytes. Fetches
+ * numPages distinct URLs and reports pages per second:
+ *   - with fetch_url, one page and one connection at a time, as a
+ *     crawler worker once fetched
+ *   - with one fetch_t, from one thread, 1, 16 and 256 connections in
+ *     flight at once, from a server that closes each connection after
+ *     its response, then from one that keeps them alive
+ *   - with 16 connections kept alive, 8 requests pipelined on each
+ * checking that every fetch returns the whole page.
+ *
+ * The server is itself one epoll loop, so on one core it shares the CPU
+ * with the fetches. Answering at once, it gives the cost of a fetch, both
+ * ends; then it answers each request latency milliseconds late, as a
+ * distant server would, and the first on a connection twice as late, for
+ * the connect's round trip, for numPages / 10 pages: the time that
+ * fetches in flight together, and connections kept alive, can save.
+ *
+ * usage: ./fetchbench [numPages [pageSize [latency]]]
+ *   default: 10000 pages of 16384 bytes, latency 2 ms
+ *
+ * Exit codes: 1 -> invalid arguments
+ *             2 -> cannot start the server
+ *             3 -> a fetch failed or returned the wrong page
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "fetch.h"
+#include "mem.h"
+
+// the fetch_t runs: connections, requests per connection, kept alive
+static const struct {
+    int conns;
+    int pipeline;
+    bool keepAlive;
+} RUNS[] = {
+    { 1, 1, false }, { 16, 1, false }, { 256, 1, false },
+    { 1, 1, true }, { 16, 1, true }, { 256, 1, true },
+    { 16, 8, true }, { 0, 0, false }
+};
+
+// the server's connection state
+typedef struct client {
+    int fd;
+    size_t got;                 // bytes read of requests not yet whole
+    bool answered;              // a request has had its reply
+    int owed;                   // replies due, not yet written
+    size_t sent;                // bytes written of the reply being written
+    int waiting;                // batches of replies to it in the queue
+    bool gone;                  // closed; freed once none are waiting
+    uint32_t events;            // watched for
+    char request[4096];
+} client_t;
+
+// the replies to requests read together, due together
+typedef struct batch {
+    client_t* client;
+    int replies;
+    double due;                 // when to reply
+    struct batch* next;         // in the queue, in order of due
+} batch_t;
+
+// the responses the server sends, and where it listens
+static char* response[2];       // closing, [1] kept alive
+static size_t responseLen[2];
+static size_t pageSize = 16384;
+static int listener;
+// set between runs: microseconds the server waits before each reply,
+// and whether it keeps connections alive
+static atomic_long latency;
+static atomic_bool keepAlive;
+
+// the fetch_t callback's tally
+typedef struct tally {
+    int ok;
+    int bad;
+} tally_t;
+
+static double now(void);
+static int serverStart(void);
+static void* serve(void* arg);
+static int serveRequests(client_t* client);
+static bool serveReplies(int epfd, client_t* client);
+static bool serveClose(client_t* client);
+static void run(char** urls, int numPages);
+static void check(void* arg, const char* url, void* item, char* html);
+static char** makeURLs(int port, int n);
+
+/* ***************************
+ *  main function
+ *  Accepts 0-3 arguments: numPages, pageSize, latency
+ */
+int main(int argc, char* argv[])
+{
+    int numPages = 10000;
+    int size = pageSize;
+    double ms = 2;
+    if (argc > 4 || (argc > 1 && (numPages = atoi(argv[1])) <= 0)
+        || (argc > 2 && (size = atoi(argv[2])) <= 0)
+        || (argc > 3 && (ms = atof(argv[3])) <= 0)) {
+        fprintf(stderr, "usage: %s [numPages [pageSize [latency]]]\n", argv[0]);
+        exit(1);
+    }
+    pageSize = size;
+    int port = serverStart();
+    if (port < 0) {
+        fprintf(stderr, "ERROR: Cannot start the server: %s\n", strerror(errno));
+        exit(2);
+    }
+    char** urls = makeURLs(port, numPages);
+
+    printf("%d pages of %zu bytes from 127.0.0.1:%d, at once\n", numPages, pageSize, port);
+    run(urls, numPages);
+    int fewer = numPages >= 10 ? numPages / 10 : 1;
+    printf("%d pages of %zu bytes, %.1f ms late (%.1f ms on a new connection)\n",
+           fewer, pageSize, ms, 2 * ms);
+    atomic_store(&latency, (long)(ms * 1000));
+    run(urls, fewer);
+
+    for (int i = 0; i < numPages; i++) {
+        mem_free(urls[i]);
+    }
+    mem_free(urls);
+    return 0;
+}
+
+/**************** run() ****************/
+/* fetches the first numPages of urls each way, reporting */
+/* pages per second; exits if a fetch goes wrong          */
+static void
+run(char** urls, int numPages)
+{
+    // one page at a time, blocking
+    atomic_store(&keepAlive, false);
+    double start = now();
+    tally_t tally = { 0, 0 };
+    for (int i = 0; i < numPages; i++) {
+        check(&tally, urls[i], NULL, fetch_url(urls[i], NULL));
+    }
+    double secs = now() - start;
+    printf("  %-42s %10.0f pages/s\n", "fetch_url", numPages / secs);
+    if (tally.bad > 0) {
+        fprintf(stderr, "ERROR: %d of %d fetches failed\n", tally.bad, numPages);
+        exit(3);
+    }
+
+    // all at once, from one loop
+    for (int r = 0; RUNS[r].conns > 0; r++) {
+        atomic_store(&keepAlive, RUNS[r].keepAlive);
+        fetch_t* fetch = fetch_new(RUNS[r].conns, NULL);
+        if (fetch == NULL) {
+            fprintf(stderr, "ERROR: Cannot make a fetch loop\n");
+            exit(2);
+        }
+        fetch_pipeline(fetch, RUNS[r].pipeline);
+        start = now();
+        tally.ok = tally.bad = 0;
+        for (int i = 0; i < numPages; i++) {
+            fetch_add(fetch, urls[i], NULL);
+        }
+        while (fetch_pending(fetch) > 0) {
+            fetch_run(fetch, -1, check, &tally);
+        }
+        secs = now() - start;
+        fetch_delete(fetch);
+        char name[64];
+        snprintf(name, sizeof(name), "fetch_t, %d in flight, %s%s", RUNS[r].conns,
+                 RUNS[r].keepAlive ? "kept alive" : "closed",
+                 RUNS[r].pipeline > 1 ? ", pipelined" : "");
+        printf("  %-42s %10.0f pages/s\n", name, numPages / secs);
+        if (tally.ok != numPages) {
+            fprintf(stderr, "ERROR: %d of %d fetches failed\n", numPages - tally.ok, numPages);
+            exit(3);
+        }
+    }
+}
+
+/**************** now() ****************/
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** serverStart() ****************/
+/* listens on 127.0.0.1, any port, and starts the server */
+/* thread; returns the port, or -1                       */
+static int
+serverStart(void)
+{
+    // the page: a line of text, repeated
+    static const char LINE[] = "<p>the quick brown fox jumps over the lazy dog</p>\n";
+    for (int keep = 0; keep < 2; keep++) {
+        char header[128];
+        int headerLen = snprintf(header, sizeof(header),
+                                 "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n%s\r\n",
+                                 pageSize, keep ? "" : "Connection: close\r\n");
+        responseLen[keep] = headerLen + pageSize;
+        response[keep] = mem_malloc_assert(responseLen[keep], "response");
+        memcpy(response[keep], header, headerLen);
+        for (size_t i = 0; i < pageSize; i++) {
+            response[keep][headerLen + i] = LINE[i % (sizeof(LINE) - 1)];
+        }
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    int on = 1;
+    pthread_t thread;
+    if ((listener = socket(AF_INET, SOCK_STREAM, 0)) < 0
+        || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+        || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || listen(listener, 4096) != 0
+        || getsockname(listener, (struct sockaddr*)&addr, &addrLen) != 0
+        || pthread_create(&thread, NULL, serve, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    return ntohs(addr.sin_port);
+}
+
+/**************** serve() ****************/
+/* the server thread: accepts and answers connections until  */
+/* the process exits; replies wait their turn in a queue, in */
+/* the order they are due                                    */
+static void*
+serve(void* arg)
+{
+    int epfd = epoll_create1(0);
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &event);
+    struct epoll_event events[64];
+    batch_t* head = NULL;
+    while (true) {
+        int wait = -1;
+        if (head != NULL) {
+            double ms = (head->due - now()) * 1000;
+            wait = ms <= 0 ? 0 : (int)ms + 1;
+        }
+        int n = epoll_wait(epfd, events, 64, wait);
+        for (int e = 0; e < n; e++) {
+            client_t* client = events[e].data.ptr;
+            if (client == NULL) {
+                int fd;
+                while ((fd = accept(listener, NULL, NULL)) >= 0) {
+                    client = mem_calloc_assert(1, sizeof(client_t), "client");
+                    client->fd = fd;
+                    client->events = EPOLLIN;
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    // replies written back to back go out at once, as
+                    // a web server sends them
+                    int on = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                    struct epoll_event ready = { .events = EPOLLIN, .data.ptr = client };
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ready);
+                }
+                continue;
+            }
+            if ((events[e].events & EPOLLOUT) != 0 && !serveReplies(epfd, client)) {
+                continue;
+            }
+            if ((events[e].events & ~EPOLLOUT) == 0) {
+                continue;
+            }
+            int requests = serveRequests(client);
+            if (requests > 0) {
+                // a new connection's replies wait a round trip more,
+                // so may be due after replies queued since
+                batch_t* batch = mem_malloc_assert(sizeof(batch_t), "batch");
+                batch->client = client;
+                batch->replies = requests;
+                batch->due = now() + atomic_load(&latency) / 1e6 * (client->answered ? 1 : 2);
+                client->answered = true;
+                client->waiting++;
+                batch_t** at = &head;
+                while (*at != NULL && (*at)->due <= batch->due) {
+                    at = &(*at)->next;
+                }
+                batch->next = *at;
+                *at = batch;
+            }
+        }
+        double t = now();
+        while (head != NULL && head->due <= t) {
+            batch_t* batch = head;
+            head = head->next;
+            client_t* client = batch->client;
+            client->waiting--;
+            client->owed += batch->replies;
+            mem_free(batch);
+            if (client->gone) {
+                serveClose(client);
+            } else {
+                serveReplies(epfd, client);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**************** serveRequests() ****************/
+/* reads what there is of client's requests; returns how  */
+/* many are now whole, or -1 if client went away (closed, */
+/* and freed if no replies to it wait)                    */
+static int
+serveRequests(client_t* client)
+{
+    ssize_t n = read(client->fd, &client->request[client->got],
+                     sizeof(client->request) - 1 - client->got);
+    if (n < 0 && errno == EAGAIN) {
+        return 0;
+    }
+    if (n <= 0 || client->got + n == sizeof(client->request) - 1) {
+        serveClose(client);
+        return -1;
+    }
+    client->got += n;
+    client->request[client->got] = '\0';
+    int requests = 0;
+    char* end;
+    while ((end = strstr(client->request, "\r\n\r\n")) != NULL) {
+        end += 4;
+        client->got -= end - client->request;
+        memmove(client->request, end, client->got + 1);
+        requests++;
+    }
+    return requests;
+}
+
+/**************** serveReplies() ****************/
+/* writes what it can of the replies client is owed,   */
+/* closing it after the first unless connections are   */
+/* kept alive; false if client is closed               */
+static bool
+serveReplies(int epfd, client_t* client)
+{
+    int keep = atomic_load(&keepAlive) ? 1 : 0;
+    while (client->owed > 0) {
+        ssize_t n = send(client->fd, &response[keep][client->sent],
+                         responseLen[keep] - client->sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EAGAIN) {
+            break;
+        }
+        if (n <= 0) {
+            serveClose(client);
+            return false;
+        }
+        client->sent += n;
+        if (client->sent == responseLen[keep]) {
+            client->sent = 0;
+            client->owed--;
+            if (!keep) {
+                serveClose(client);
+                return false;
+            }
+        }
+    }
+    uint32_t events = client->owed > 0 ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    if (events != client->events) {
+        struct epoll_event ready = { .events = events, .data.ptr = client };
+        epoll_ctl(epfd, EPOLL_CTL_MOD, client->fd, &ready);
+        client->events = events;
+    }
+    return true;
+}
+
+/**************** serveClose() ****************/
+/* closes client, and frees it unless replies to it are */
+/* queued, the last of which then does; true if freed   */
+static bool
+serveClose(client_t* client)
+{
+    if (!client->gone) {
+        close(client->fd);
+        client->gone = true;
+    }
+    if (client->waiting > 0) {
+        return false;
+    }
+    mem_free(client);
+    return true;
+}
+
+/**************** check() ****************/
+/* the callback of the runs: counts html as ok if it is the page */
+static void
+check(void* arg, const char* url, void* item, char* html)
+{
+    tally_t* tally = arg;
+    if (html != NULL && strlen(html) == pageSize
+        && memcmp(html, &response[0][responseLen[0] - pageSize], pageSize) == 0) {
+        tally->ok++;
+    } else {
+        tally->bad++;
+    }
+    free(html);
+}
+
+/**************** makeURLs() ****************/
+/* n distinct URLs on 127.0.0.1:port */
+static char**
+makeURLs(int port, int n)
+{
+    char** urls = mem_malloc_assert(n * sizeof(char*), "urls");
+    for (int i = 0; i < n; i++) {
+        char url[64];
+        snprintf(url, sizeof(url), "http://127.0.0.1:%d/tse/page/%d.html", port, i);
+        urls[i] = mem_malloc_assert(strlen(url) + 1, "url");
+        strcpy(urls[i], url);
+    }
+    return urls;
+}
@@ -0,0 +1,238 @@
+/* filebench.c    Kyrylo Bakumenko    18 May, 2023
+ *
+ * Benchmark of libcs50's file reading. Writes a temporary file of lines
+ * of random words, then times reading it whole and line by line,
+ *   - with the old file_readUntil, kept here: fgetc, and one realloc per
+ *     character past the first 80
+ *   - with file_readFile and file_readLine, which grow by doubling and
+ *     read with fread and getline
+ *   - with file_readFileBuf and file_readLineBuf, reusing one buffer
+ * checking that each reads the same text, and reports MB per second.
+ *
+ * usage: ./filebench [MB [repeats]]
+ *   defaults: an 8 MB file, read 3 times
+ *
+ * Exit codes: 1 -> invalid arguments
+ *             2 -> cannot write the temporary file
+ *             3 -> the readers disagree
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "file.h"
+
+// what a reader read, to compare them
+typedef struct tally {
+    long lines;
+    uint64_t checksum;
+} tally_t;
+
+static double now(void);
+static char* old_readUntil(FILE* fp, int (*stopfunc)(int c));
+static int old_isnewline(int c);
+static void tally_text(tally_t* tally, const char* text);
+static void report(const char* name, double mb, double secs, double base);
+static void check(const char* name, const tally_t* want, const tally_t* got);
+
+/* ***************************
+ *  main function
+ *  Accepts 0-2 arguments: MB, repeats
+ */
+int main(int argc, char* argv[])
+{
+    double megabytes = 8;
+    int repeats = 3;
+    if (argc > 3 || (argc > 1 && (megabytes = atof(argv[1])) <= 0)
+        || (argc > 2 && (repeats = atoi(argv[2])) <= 0)) {
+        fprintf(stderr, "usage: %s [MB [repeats]]\n", argv[0]);
+        exit(1);
+    }
+
+    // lines of 1-12 random words
+    FILE* fp = tmpfile();
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: Cannot create a temporary file\n");
+        exit(2);
+    }
+    size_t bytes = 0;
+    srand(1);
+    while (bytes < megabytes * 1e6) {
+        int words = 1 + rand() % 12;
+        for (int w = 0; w < words; w++) {
+            int len = 1 + rand() % 10;
+            for (int c = 0; c < len; c++) {
+                fputc('a' + rand() % 26, fp);
+            }
+            fputc(w + 1 < words ? ' ' : '\n', fp);
+            bytes += len + 1;
+        }
+    }
+    fflush(fp);
+    double mb = bytes * repeats / 1e6;
+    printf("%.1f MB file, read %d times\n", bytes / 1e6, repeats);
+
+    // whole file
+    tally_t want = { 0, 0 };
+    double start = now();
+    for (int r = 0; r < repeats; r++) {
+        rewind(fp);
+        char* text = old_readUntil(fp, NULL);
+        tally_text(&want, text);
+        free(text);
+    }
+    double base = now() - start;
+    report("old readFile", mb, base, base);
+
+    tally_t got = { 0, 0 };
+    start = now();
+    for (int r = 0; r < repeats; r++) {
+        rewind(fp);
+        char* text = file_readFile(fp);
+        tally_text(&got, text);
+        free(text);
+    }
+    report("file_readFile", mb, now() - start, base);
+    check("file_readFile", &want, &got);
+
+    char* buf = NULL;
+    size_t cap = 0;
+    size_t len;
+    got = (tally_t){ 0, 0 };
+    start = now();
+    for (int r = 0; r < repeats; r++) {
+        rewind(fp);
+        tally_text(&got, file_readFileBuf(fp, &buf, &cap, &len));
+    }
+    report("file_readFileBuf", mb, now() - start, base);
+    check("file_readFileBuf", &want, &got);
+
+    // line by line
+    want = (tally_t){ 0, 0 };
+    start = now();
+    for (int r = 0; r < repeats; r++) {
+        rewind(fp);
+        char* line;
+        while ((line = old_readUntil(fp, old_isnewline)) != NULL) {
+            tally_text(&want, line);
+            free(line);
+        }
+    }
+    base = now() - start;
+    report("old readLine", mb, base, base);
+
+    got = (tally_t){ 0, 0 };
+    start = now();
+    for (int r = 0; r < repeats; r++) {
+        rewind(fp);
+        char* line;
+        while ((line = file_readLine(fp)) != NULL) {
+            tally_text(&got, line);
+            free(line);
+        }
+    }
+    report("file_readLine", mb, now() - start, base);
+    check("file_readLine", &want, &got);
+
+    got = (tally_t){ 0, 0 };
+    start = now();
+    for (int r = 0; r < repeats; r++) {
+        rewind(fp);
+        char* line;
+        while ((line = file_readLineBuf(fp, &buf, &cap)) != NULL) {
+            tally_text(&got, line);
+        }
+    }
+    report("file_readLineBuf", mb, now() - start, base);
+    check("file_readLineBuf", &want, &got);
+
+    free(buf);
+    fclose(fp);
+    return 0;
+}
+
+/**************** now() ****************/
+/* wall-clock seconds */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** old_readUntil() ****************/
+/* file_readUntil as it was: fgetc, and a realloc for every */
+/* character past the first 80                              */
+static char*
+old_readUntil(FILE* fp, int (*stopfunc)(int c))
+{
+    int len = 81;
+    char* buf = malloc(len * sizeof(char));
+    if (buf == NULL) {
+        return NULL;
+    }
+    int pos;
+    int c;
+    for (pos = 0; (c = fgetc(fp)) != EOF && !(stopfunc != NULL && (*stopfunc)(c)); pos++) {
+        if (pos + 1 > len - 1) {
+            char* newbuf = realloc(buf, ++len * sizeof(char));
+            if (newbuf == NULL) {
+                free(buf);
+                return NULL;
+            }
+            buf = newbuf;
+        }
+        buf[pos] = c;
+    }
+    if (pos == 0 && c == EOF) {
+        free(buf);
+        return NULL;
+    }
+    buf[pos] = '\0';
+    return buf;
+}
+
+/**************** old_isnewline() ****************/
+static int
+old_isnewline(int c)
+{
+    return c == '\n';
+}
+
+/**************** tally_text() ****************/
+/* counts the text's lines and adds its FNV-1a hash to the checksum */
+static void
+tally_text(tally_t* tally, const char* text)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* c = text; c != NULL && *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+        tally->lines += *c == '\n';
+    }
+    tally->lines++;
+    tally->checksum += hash;
+}
+
+/**************** report() ****************/
+static void
+report(const char* name, double mb, double secs, double base)
+{
+    printf("%-18s %8.1f MB/s   %6.1fx\n", name, mb / secs, base / secs);
+}
+
+/**************** check() ****************/
+/* exits if a reader read something else */
+static void
+check(const char* name, const tally_t* want, const tally_t* got)
+{
+    if (want->lines != got->lines || want->checksum != got->checksum) {
+        fprintf(stderr, "ERROR: %s read %ld lines, the old reader %ld\n",
+                name, got->lines, want->lines);
+        exit(3);
+    }
+}
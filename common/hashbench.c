@@ -0,0 +1,346 @@
+/* hashbench.c    Kyrylo Bakumenko    18 May, 2023
+ *
+ * Hashtable microbenchmark. For 10K, 1M and 10M distinct word-like keys
+ * (up to maxKeys), times inserting every key into a table made with
+ * hashtable_new(200), as index_new(200) does, then finding every key
+ * and as many absent keys, and reports nanoseconds per operation,
+ *   - for the hashtable (open addressing, see libcs50/hashtable.c)
+ *   - for the chained layout it replaced, kept here: a fixed array of
+ *     slots, each a linked list searched with strcmp, with 200 slots
+ *     (10K keys only: longer chains take minutes) and with one slot
+ *     per key, its best case
+ * checking that each finds every key and none of the absent ones; and
+ * times hashing alone, hash_jenkins against hash_bytes.
+ *
+ * Then the same for a urlset (see urlset.h), the crawler's pagesSeen, as
+ * fingerprints and as a Bloom filter of 16 bits per key, reporting the
+ * bytes per key and how many absent keys each took as present, against
+ * urlset_falsePositive's estimate.
+ *
+ * usage: ./hashbench [maxKeys]
+ *   default: 1000000, so the 10M run is left to ./hashbench 10000000
+ *
+ * Exit codes: 1 -> invalid arguments
+ *             2 -> out of memory
+ *             3 -> a table lost or invented a key
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hashtable.h"
+#include "urlset.h"
+#include "hash.h"
+#include "mem.h"
+
+// the chained layout of libcs50-given.a
+typedef struct oldnode {
+    char* key;
+    void* item;
+    struct oldnode* next;
+} oldnode_t;
+
+typedef struct oldtable {
+    oldnode_t** slots;
+    int numSlots;
+} oldtable_t;
+
+static double now(void);
+static char** make_keys(int n, int salt, char** text);
+static void run_hash(char** keys, int n);
+static void run_new(char** keys, char** absent, int n);
+static void run_old(char** keys, char** absent, int n, int numSlots);
+static void run_urlset(char** keys, char** absent, int n, int bits);
+static void* old_find(oldtable_t* table, const char* key);
+static void report(const char* name, int n, double insert, double hit, double miss);
+
+/* ***************************
+ *  main function
+ *  Accepts 0-1 arguments: maxKeys
+ */
+int main(int argc, char* argv[])
+{
+    int maxKeys = 1000000;
+    if (argc > 2 || (argc > 1 && (maxKeys = atoi(argv[1])) <= 0)) {
+        fprintf(stderr, "usage: %s [maxKeys]\n", argv[0]);
+        exit(1);
+    }
+
+    static const int sizes[] = { 10000, 1000000, 10000000 };
+    printf("%-24s %8s %10s %10s %10s  (ns per operation)\n",
+           "", "keys", "insert", "find", "find miss");
+    for (int s = 0; s < 3 && sizes[s] <= maxKeys; s++) {
+        int n = sizes[s];
+        char* text;
+        char* absentText;
+        char** keys = make_keys(n, 0, &text);
+        char** absent = make_keys(n, 1, &absentText);
+
+        if (s == 0) {
+            run_hash(keys, n);
+        }
+        run_new(keys, absent, n);
+        if (n <= 10000) {
+            run_old(keys, absent, n, 200);
+        }
+        run_old(keys, absent, n, n);
+        run_urlset(keys, absent, n, 0);
+        run_urlset(keys, absent, n, 16);
+
+        free(keys);
+        free(absent);
+        free(text);
+        free(absentText);
+    }
+    return 0;
+}
+
+/**************** now() ****************/
+/* wall-clock seconds */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** make_keys() ****************/
+/* n distinct keys of 3-12 lowercase letters, in random order; keys */
+/* of salt 0 and salt 1 never match; *text holds the strings         */
+static char**
+make_keys(int n, int salt, char** text)
+{
+    char** keys = malloc(n * sizeof(char*));
+    *text = malloc((size_t)n * 16);
+    if (keys == NULL || *text == NULL) {
+        fprintf(stderr, "ERROR: Out of memory for %d keys\n", n);
+        exit(2);
+    }
+    char* next = *text;
+    for (int i = 0; i < n; i++) {
+        // i in base 26, after a letter for the salt, padded at random
+        keys[i] = next;
+        *next++ = 'a' + salt;
+        unsigned long v = (unsigned long)i * 2654435761u % 4294967291u;
+        for (int d = 0; d < 7; d++) {
+            *next++ = 'a' + v % 26;
+            v /= 26;
+        }
+        int pad = rand() % 5;
+        for (int p = 0; p < pad; p++) {
+            *next++ = 'e';
+        }
+        *next++ = '\0';
+    }
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        char* swap = keys[i];
+        keys[i] = keys[j];
+        keys[j] = swap;
+    }
+    return keys;
+}
+
+/**************** run_hash() ****************/
+/* hashes every key 100 times, into 2^20 slots, each way */
+static void
+run_hash(char** keys, int n)
+{
+    unsigned long sum = 0;
+    double start = now();
+    for (int r = 0; r < 100; r++) {
+        for (int i = 0; i < n; i++) {
+            sum += hash_jenkins(keys[i], 1 << 20);
+        }
+    }
+    double jenkins = now() - start;
+
+    uint64_t seed = hash_seed();
+    start = now();
+    for (int r = 0; r < 100; r++) {
+        for (int i = 0; i < n; i++) {
+            sum += hash_bytes(keys[i], strlen(keys[i]), seed) & ((1 << 20) - 1);
+        }
+    }
+    double bytes = now() - start;
+    printf("hash only: hash_jenkins %.1f ns, hash_bytes %.1f ns per key (%lu)\n",
+           jenkins * 1e9 / (100.0 * n), bytes * 1e9 / (100.0 * n), sum % 10);
+}
+
+/**************** run_new() ****************/
+static void
+run_new(char** keys, char** absent, int n)
+{
+    hashtable_t* table = hashtable_new(200);
+    double start = now();
+    for (int i = 0; i < n; i++) {
+        if (!hashtable_insert(table, keys[i], keys[i])) {
+            fprintf(stderr, "ERROR: Cannot insert key %d\n", i);
+            exit(3);
+        }
+    }
+    double insert = now() - start;
+
+    start = now();
+    for (int i = 0; i < n; i++) {
+        if (hashtable_find(table, keys[i]) != keys[i]) {
+            fprintf(stderr, "ERROR: Lost key %s\n", keys[i]);
+            exit(3);
+        }
+    }
+    double hit = now() - start;
+
+    start = now();
+    for (int i = 0; i < n; i++) {
+        if (hashtable_find(table, absent[i]) != NULL) {
+            fprintf(stderr, "ERROR: Found absent key %s\n", absent[i]);
+            exit(3);
+        }
+    }
+    double miss = now() - start;
+
+    hashtable_delete(table, NULL);
+    report("hashtable", n, insert, hit, miss);
+}
+
+/**************** run_old() ****************/
+static void
+run_old(char** keys, char** absent, int n, int numSlots)
+{
+    oldtable_t table;
+    table.numSlots = numSlots;
+    table.slots = calloc(numSlots, sizeof(oldnode_t*));
+    if (table.slots == NULL) {
+        fprintf(stderr, "ERROR: Out of memory for %d slots\n", numSlots);
+        exit(2);
+    }
+
+    // as the old hashtable_insert: look for the key, then copy it into a new node
+    double start = now();
+    for (int i = 0; i < n; i++) {
+        if (old_find(&table, keys[i]) != NULL) {
+            fprintf(stderr, "ERROR: Key %s inserted twice\n", keys[i]);
+            exit(3);
+        }
+        oldnode_t* node = malloc(sizeof(oldnode_t));
+        char* copy = malloc(strlen(keys[i]) + 1);
+        if (node == NULL || copy == NULL) {
+            fprintf(stderr, "ERROR: Out of memory\n");
+            exit(2);
+        }
+        strcpy(copy, keys[i]);
+        int slot = hash_jenkins(keys[i], numSlots);
+        node->key = copy;
+        node->item = keys[i];
+        node->next = table.slots[slot];
+        table.slots[slot] = node;
+    }
+    double insert = now() - start;
+
+    start = now();
+    for (int i = 0; i < n; i++) {
+        if (old_find(&table, keys[i]) != keys[i]) {
+            fprintf(stderr, "ERROR: Lost key %s\n", keys[i]);
+            exit(3);
+        }
+    }
+    double hit = now() - start;
+
+    start = now();
+    for (int i = 0; i < n; i++) {
+        if (old_find(&table, absent[i]) != NULL) {
+            fprintf(stderr, "ERROR: Found absent key %s\n", absent[i]);
+            exit(3);
+        }
+    }
+    double miss = now() - start;
+
+    for (int s = 0; s < numSlots; s++) {
+        oldnode_t* node = table.slots[s];
+        while (node != NULL) {
+            oldnode_t* next = node->next;
+            free(node->key);
+            free(node);
+            node = next;
+        }
+    }
+    free(table.slots);
+
+    char name[32];
+    snprintf(name, sizeof(name), "chained, %d slots", numSlots);
+    report(name, n, insert, hit, miss);
+}
+
+/**************** run_urlset() ****************/
+static void
+run_urlset(char** keys, char** absent, int n, int bits)
+{
+    // sized as the crawler sizes it: 200 for fingerprints, n for a filter
+    urlset_t* set = urlset_new(bits == 0 ? 200 : n, bits);
+    if (set == NULL) {
+        fprintf(stderr, "ERROR: Out of memory for a urlset\n");
+        exit(2);
+    }
+    // a Bloom filter takes some keys as present as they are inserted
+    int lost = 0;
+    double start = now();
+    for (int i = 0; i < n; i++) {
+        lost += !urlset_insert(set, keys[i]);
+    }
+    double insert = now() - start;
+
+    start = now();
+    for (int i = 0; i < n; i++) {
+        if (!urlset_find(set, keys[i])) {
+            fprintf(stderr, "ERROR: Lost key %s\n", keys[i]);
+            exit(3);
+        }
+    }
+    double hit = now() - start;
+
+    int taken = 0;
+    start = now();
+    for (int i = 0; i < n; i++) {
+        taken += urlset_find(set, absent[i]);
+    }
+    double miss = now() - start;
+    double estimate = urlset_falsePositive(set);
+    size_t bytes = urlset_bytes(set);
+    urlset_delete(set);
+
+    // fingerprints may collide, with a chance of 1 in 2^64 / n each
+    if (bits == 0 && lost + taken > 0) {
+        fprintf(stderr, "ERROR: %d keys taken as present\n", lost + taken);
+        exit(3);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), bits == 0 ? "urlset" : "urlset, %d-bit Bloom", bits);
+    report(name, n, insert, hit, miss);
+    printf("%-24s %.1f bytes per key; %d absent keys found (%.2g), estimated %.2g; %d lost\n",
+           "", (double)bytes / n, taken, (double)taken / n, estimate, lost);
+}
+
+/**************** old_find() ****************/
+static void*
+old_find(oldtable_t* table, const char* key)
+{
+    for (oldnode_t* node = table->slots[hash_jenkins(key, table->numSlots)];
+         node != NULL; node = node->next) {
+        if (strcmp(node->key, key) == 0) {
+            return node->item;
+        }
+    }
+    return NULL;
+}
+
+/**************** report() ****************/
+static void
+report(const char* name, int n, double insert, double hit, double miss)
+{
+    printf("%-24s %8d %10.1f %10.1f %10.1f\n", name, n,
+           insert * 1e9 / n, hit * 1e9 / n, miss * 1e9 / n);
+}
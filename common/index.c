@@ -2,15 +2,33 @@
  *
  * Module providing the data structure to represent the in-memory index, and functions to read and write index files.
  * index module for TSE
+ *
+ * Two file formats are supported: the text format written by index_save
+ * (one "word docID count ..." line per word), and a versioned binary
+ * format written by index_saveBinary which index_map uses in place.
  * 
  * Kyrylo Bakumenko, 29 April 2023
  */
 
+#define _POSIX_C_SOURCE 200809L // fileno, mmap, fstat
+#define _DEFAULT_SOURCE         // MADV_DONTNEED
+
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "webpage.h"
 #include "hashtable.h"
-#include "counters.h"
+#include "hash.h"
+#include "arena.h"
+#include "postings.h"
+#include "query.h"
+#include "bitpack.h"
+#include "pagedir.h"
 #include "file.h"
 #include "mem.h"
 
@@ -20,29 +38,147 @@ typedef struct index {
     // given a word, can determine number of occurences
     // in a particular file (indexed by docID)
     //
-    // char* word -> (int docID, int count)
+    // char* word -> postings_t* (int docID, int count) pairs
     hashtable_t* table;
+    arena_t* arena;             // every postings list in table
+    int slots;                  // of table, for index_clear
+    size_t memory;              // estimated bytes held by index_add
+
+    // binary index file mapped by index_map (NULL for in-memory index)
+    void* map;
+    size_t mapSize;
+    const struct indexentry* dict;    // sorted by word
+    const char* strings;              // NUL-terminated words
+    const uint8_t* postings;          // encoded postings lists
+    uint32_t numWords;
 } index_t;
 
+/**************** binary file format ****************/
+/* All integers are in host byte order. The file is laid out as
+ *
+ *   header | dictionary | strings | postings
+ *
+ * The dictionary is an array of numWords entries sorted by word; each
+ * entry points into the strings block (the word) and the postings block
+ * (the word's postings list, encoded as by postings_write).
+ */
+static const char INDEX_MAGIC[8] = "TSEINDX";
+static const uint32_t INDEX_VERSION = 4;
+
+typedef struct indexheader {
+    char magic[8];              // INDEX_MAGIC
+    uint32_t version;           // INDEX_VERSION
+    uint32_t numWords;          // number of dictionary entries
+    uint64_t numPostings;       // total (docID, count) pairs
+    uint64_t dictOffset;        // byte offsets from start of file
+    uint64_t stringsOffset;
+    uint64_t postingsOffset;
+    uint64_t fileSize;          // total size, to detect truncation
+} indexheader_t;
+
+typedef struct indexentry {
+    uint64_t postingOffset;     // byte offset into postings block
+    uint32_t postingBytes;      // encoded length of the postings list
+    uint32_t numPostings;       // number of (docID, count) pairs
+    uint32_t wordOffset;        // byte offset into strings block
+    uint32_t maxCount;          // largest count, bounding any score
+} indexentry_t;
+
+// gathers words and postings from the hashtable for index_saveBinary
+typedef struct wordpostings {
+    const char* word;
+    postings_t* postings;
+} wordpostings_t;
+
+typedef struct wordlist {
+    int size;
+    wordpostings_t* items;
+} wordlist_t;
+
+// a word's postings in each part, for index_merge
+typedef struct mergeword {
+    const char* word;           // the key in a part's table
+    postings_t* sources[];      // numParts, NULL where absent
+} mergeword_t;
+
+// one thread's share of the words for index_merge
+typedef struct mergeshare {
+    pthread_t thread;
+    index_t** parts;
+    int numParts;
+    int share;                  // words hashing to share are this thread's
+    int maxDocID;
+    int source;                 // part being collected
+    hashtable_t* words;         // word -> mergeword_t
+    arena_t* scratch;           // the mergeword_t of words
+    arena_t* arena;             // the merged postings, for index's arena
+    wordlist_t merged;          // words point into the parts
+    int capacity;               // items allocated in merged
+} mergeshare_t;
+
+// slots in a merge thread's table of words
+static const int MERGE_SLOTS = 4096;
+
+// bytes a word costs the hashtable besides its key: a 24-byte slot,
+// in a table between 7/16 and 7/8 full (the postings come from an arena,
+// without a malloc header)
+static const size_t WORD_OVERHEAD = 40;
+
+// a run's position in the merge of index_mergeRuns
+typedef struct runcursor {
+    index_t* run;               // mapped run file
+    uint32_t next;              // its next dictionary entry
+    int order;                  // runs hold increasing docIDs
+    size_t released[3];         // of dictionary, words and postings,
+                                // the bytes given back
+} runcursor_t;
+
+// bytes of a run read before its pages are given back to the kernel
+static const size_t RUN_RELEASE = 1 << 18;
+
 
 /**************** global functions ****************/
 /* that is, visible outside this file                                */
 /* see hashtable.h for comments about exported hashtable_t functions */
-/* see counters.h for comments about exported counters_t functions   */
+/* see postings.h for comments about exported postings_t functions   */
 
 index_t* index_new(const int size);
 void index_save(index_t* index, char* indexFilename);
 void index_load(index_t* index, char* indexFilename);
+void index_saveBinary(index_t* index, char* indexFilename);
+index_t* index_map(char* indexFilename);
+bool index_isBinary(char* indexFilename);
 void index_delete(index_t* index);
 void index_search(index_t* index, char** words, int* scores, int numDocs, int numWords);
 
-counters_t* index_find(index_t* index, char* key);
+postings_t* index_find(index_t* index, char* key);
+cursor_t* index_open(index_t* index, const char* word);
 bool index_add(index_t* index, char* key, int docID);
+bool index_merge(index_t* index, index_t** parts, const int numParts, const int maxDocID);
+size_t index_memory(index_t* index);
+void index_clear(index_t* index);
+bool index_mergeRuns(char** runFilenames, const int numRuns, char* indexFilename);
+bool index_setDecoder(const char* name);
+const char* index_decoder(void);
 int num_docs_crawled(char* pageDirectory);
 
 static void index_itr(void* fp, const char* key, void* item);
-static void index_itr_helper(void* fp, const int key, const int count);
-static void index_delete_helper(void* item);
+static void index_save_word(FILE* fp, const char* word, cursor_t* cursor);
+static void index_count_itr(void* arg, const char* key, void* item);
+static void index_collect_itr(void* arg, const char* key, void* item);
+static int index_word_cmp(const void* a, const void* b);
+static int index_pair_cmp(const void* a, const void* b);
+static const indexentry_t* index_lookup(index_t* index, const char* word);
+static bool index_map_valid(const void* map, const uint64_t size);
+static void* index_merge_share(void* arg);
+static const char* run_word(const runcursor_t* cursor);
+static bool run_less(const runcursor_t* a, const runcursor_t* b);
+static void run_sift(runcursor_t* heap, const int size, int i);
+static void run_release(runcursor_t* cursor);
+static void run_release_range(const index_t* run, size_t* released,
+                              const void* start, const void* done);
+static void index_merge_collect_itr(void* arg, const char* key, void* item);
+static void index_merge_word_itr(void* arg, const char* key, void* item);
 
 
 /**************** local functions ****************/
@@ -64,6 +200,15 @@ index_new(const int size)
     } else {
         // allocs mem
         index->table = hashtable_new(size);
+        index->arena = arena_new();
+        index->slots = size;
+        index->memory = 0;
+        index->map = NULL;
+        index->mapSize = 0;
+        index->dict = NULL;
+        index->strings = NULL;
+        index->postings = NULL;
+        index->numWords = 0;
     }
     
     return index;
@@ -83,7 +228,13 @@ index_save(index_t* index, char* indexFilename)
     }
 
     // defensive programming
-    if (index != NULL && index->table != NULL) {
+    if (index != NULL && index->map != NULL) {
+        // mapped index: walk the dictionary in word order
+        for (uint32_t w = 0; w < index->numWords; w++) {
+            const char* word = &index->strings[index->dict[w].wordOffset];
+            index_save_word(fp, word, index_open(index, word));
+        }
+    } else if (index != NULL && index->table != NULL) {
         // iterate through every word in index
         hashtable_iterate(index->table, fp, index_itr);
     }
@@ -91,6 +242,191 @@ index_save(index_t* index, char* indexFilename)
     fclose(fp);
 }
 
+/**************** index_saveBinary() ****************/
+/* writes inverted index to path in binary format */
+/* description in index.h                         */
+void
+index_saveBinary(index_t* index, char* indexFilename)
+{
+    FILE* fp;
+    if ((fp = fopen(indexFilename, "w")) == NULL) {
+        fprintf(stderr, "ERROR: Cannot write to %s\n", indexFilename);
+        exit(1);
+    }
+    if (index == NULL) {
+        fclose(fp);
+        return;
+    }
+
+    // a mapped index is already in binary format
+    if (index->map != NULL) {
+        fwrite(index->map, 1, index->mapSize, fp);
+        fclose(fp);
+        return;
+    }
+
+    // gather every word, then sort so the querier can binary search
+    wordlist_t list = {0, NULL};
+    hashtable_iterate(index->table, &list, index_count_itr);
+    int numWords = list.size;
+    list.items = mem_malloc_assert((numWords + 1) * sizeof(wordpostings_t), "index words");
+    list.size = 0;
+    hashtable_iterate(index->table, &list, index_collect_itr);
+    qsort(list.items, numWords, sizeof(wordpostings_t), index_word_cmp);
+
+    // size each block so offsets are known before writing
+    indexentry_t* dict = mem_calloc_assert(numWords + 1, sizeof(indexentry_t), "index dict");
+    uint64_t stringsSize = 0;
+    uint64_t postingsSize = 0;
+    uint64_t numPostings = 0;
+    for (int w = 0; w < numWords; w++) {
+        postings_t* postings = list.items[w].postings;
+        dict[w].wordOffset = stringsSize;
+        dict[w].postingOffset = postingsSize;
+        dict[w].postingBytes = postings_bytes(postings);
+        dict[w].numPostings = postings_size(postings);
+        dict[w].maxCount = postings_max(postings);
+        stringsSize += strlen(list.items[w].word) + 1;
+        postingsSize += dict[w].postingBytes;
+        numPostings += dict[w].numPostings;
+    }
+
+    indexheader_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.numWords = numWords;
+    header.numPostings = numPostings;
+    header.dictOffset = sizeof(header);
+    header.stringsOffset = header.dictOffset + (uint64_t)numWords * sizeof(indexentry_t);
+    // pad strings so the postings block is 8-byte aligned
+    uint64_t padding = (8 - stringsSize % 8) % 8;
+    header.postingsOffset = header.stringsOffset + stringsSize + padding;
+    header.fileSize = header.postingsOffset + postingsSize;
+
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(dict, sizeof(indexentry_t), numWords, fp);
+    for (int w = 0; w < numWords; w++) {
+        fwrite(list.items[w].word, 1, strlen(list.items[w].word) + 1, fp);
+    }
+    static const char zeros[8] = {0};
+    fwrite(zeros, 1, padding, fp);
+    for (int w = 0; w < numWords; w++) {
+        postings_write(list.items[w].postings, fp);
+    }
+
+    mem_free(dict);
+    mem_free(list.items);
+    fclose(fp);
+}
+
+/**************** index_isBinary() ****************/
+/* true if the file starts with the binary magic  */
+/* description in index.h                         */
+bool
+index_isBinary(char* indexFilename)
+{
+    FILE* fp;
+    char magic[sizeof(INDEX_MAGIC)];
+    if ((fp = fopen(indexFilename, "r")) == NULL) {
+        return false;
+    }
+    bool binary = fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+                  && memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return binary;
+}
+
+/**************** index_map() ****************/
+/* maps a binary index file for use in place  */
+/* description in index.h                     */
+index_t*
+index_map(char* indexFilename)
+{
+    FILE* fp;
+    struct stat st;
+    if ((fp = fopen(indexFilename, "r")) == NULL) {
+        return NULL;
+    }
+    if (fstat(fileno(fp), &st) != 0 || st.st_size < sizeof(indexheader_t)) {
+        fclose(fp);
+        return NULL;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    // the mapping stays valid after the file is closed
+    fclose(fp);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    // validate the header and dictionary before trusting any offsets
+    if (!index_map_valid(map, st.st_size)) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    // checking read every page; give them back until a lookup needs them
+    madvise(map, st.st_size, MADV_DONTNEED);
+
+    const indexheader_t* header = map;
+    index_t* index = mem_malloc_assert(sizeof(index_t), "index_t");
+    index->table = NULL;
+    index->arena = NULL;
+    index->slots = 0;
+    index->memory = 0;
+    index->map = map;
+    index->mapSize = st.st_size;
+    index->dict = (const indexentry_t*)((const char*)map + header->dictOffset);
+    index->strings = (const char*)map + header->stringsOffset;
+    index->postings = (const uint8_t*)map + header->postingsOffset;
+    index->numWords = header->numWords;
+    return index;
+}
+
+/**************** index_map_valid() ****************/
+/* true if the mapped file of size bytes is a binary index whose */
+/* blocks, and every dictionary entry's word and postings, lie   */
+/* inside it                                                     */
+static bool
+index_map_valid(const void* map, const uint64_t size)
+{
+    const indexheader_t* header = map;
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0
+        || header->version != INDEX_VERSION
+        || header->fileSize != size
+        || header->dictOffset < sizeof(indexheader_t)
+        || header->dictOffset % sizeof(uint64_t) != 0
+        || header->dictOffset > size) {
+        return false;
+    }
+    // dictOffset <= size, so none of these sums can wrap
+    uint64_t dictEnd = header->dictOffset + (uint64_t)header->numWords * sizeof(indexentry_t);
+    if (dictEnd > header->stringsOffset
+        || header->stringsOffset > header->postingsOffset
+        || header->postingsOffset > size) {
+        return false;
+    }
+    const indexentry_t* dict = (const indexentry_t*)((const char*)map + header->dictOffset);
+    const char* strings = (const char*)map + header->stringsOffset;
+    uint64_t stringsSize = header->postingsOffset - header->stringsOffset;
+    const uint8_t* postings = (const uint8_t*)map + header->postingsOffset;
+    uint64_t postingsSize = size - header->postingsOffset;
+    // a NUL last byte ends every word, wherever in the block it starts
+    if (header->numWords > 0 && (stringsSize == 0 || strings[stringsSize - 1] != '\0')) {
+        return false;
+    }
+    for (uint32_t w = 0; w < header->numWords; w++) {
+        if (dict[w].wordOffset >= stringsSize
+            || dict[w].postingOffset > postingsSize
+            || dict[w].postingBytes > postingsSize - dict[w].postingOffset
+            || dict[w].numPostings > INT_MAX
+            || !postings_valid(postings + dict[w].postingOffset, dict[w].postingBytes,
+                               dict[w].numPostings)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**************** index_load() ****************/
 /* reads inverted index from specified path   */
 /* description in index.h                     */
@@ -98,38 +434,61 @@ void
 index_load(index_t* index, char* indexFilename)
 {
     FILE* fp;
+    // a mapped index is read-only
+    if (index == NULL || index->table == NULL) {
+        return;
+    }
     /* creates index from oldIndexFilename */
     // try to open file
     if ((fp = fopen(indexFilename, "r")) != NULL) {
-        // loop through every line (one word per line)
+        // loop through every line (one word per line), read into one
+        // buffer reused for every line; the hashtable copies the word
+        char* buf = NULL;
+        size_t cap = 0;
         char* line;
-        while ((line = file_readLine(fp)) != NULL) {
+        while ((line = file_readLineBuf(fp, &buf, &cap)) != NULL) {
             // save the word from the line
             char* word = strtok(line, " ");
-            // assign values to docID and count pairs
-            int docID;
-            int count;
+            if (word == NULL) {
+                continue;
+            }
+            // (docID, count) pairs, grown as needed
+            int capacity = 8;
+            int numPairs = 0;
+            int* pairs = mem_malloc_assert(2 * capacity * sizeof(int), "index pairs");
 
             // gather new docID, count pair
             // and assert that values could be read
             char* nextDocID;
             char* nextCount;
-            // create counter for word
-            counters_t* counter = counters_new();
             while ((nextDocID = strtok(NULL, " ")) != NULL && (nextCount = strtok(NULL, " ")) != NULL) {
+                if (numPairs == capacity) {
+                    int* grown = mem_malloc_assert(4 * capacity * sizeof(int), "index pairs");
+                    memcpy(grown, pairs, 2 * numPairs * sizeof(int));
+                    mem_free(pairs);
+                    pairs = grown;
+                    capacity *= 2;
+                }
                 // assign value to docID and count variables
-                sscanf(nextDocID, "%d", &docID);
-                sscanf(nextCount, "%d", &count);
+                sscanf(nextDocID, "%d", &pairs[2 * numPairs]);
+                sscanf(nextCount, "%d", &pairs[2 * numPairs + 1]);
+                numPairs++;
+            }
 
-                // add docID, counter pair to counter
-                counters_set(counter, docID, count);
+            // postings must be appended in docID order
+            qsort(pairs, numPairs, 2 * sizeof(int), index_pair_cmp);
+            postings_t* postings = postings_newIn(index->arena);
+            for (int p = 0; p < numPairs; p++) {
+                postings_append(postings, pairs[2*p], pairs[2*p + 1]);
+            }
+            // add word->postings to hashtable
+            if (!hashtable_insert(index->table, word, postings)) {
+                postings_delete(postings);
             }
-            // add word->counter to hashtable
-            hashtable_insert(index->table, word, counter);
 
-            // clear mem for line
-            mem_free(line);
+            mem_free(pairs);
         }
+        free(buf);
     } else {
         // if fails, exit with error
         fprintf(stderr, "ERROR: Unable to open file: %s\n", indexFilename);
@@ -145,151 +504,544 @@ index_load(index_t* index, char* indexFilename)
 void 
 index_delete(index_t* index)
 {   
-    // iterate through hashtbable, calling counter_delete
-    hashtable_delete(index->table, index_delete_helper);
+    // mapped index owns no postings, just the mapping
+    if (index->map != NULL) {
+        munmap(index->map, index->mapSize);
+        index->map = NULL;
+        return;
+    }
+    // the postings all go with the arena, a few munmaps
+    hashtable_delete(index->table, NULL);
+    arena_delete(index->arena);
     // free hashtable pointer [DONT DO THIS, results in double free]
     // mem_free(index->table);
 }
 
 static void
 index_itr(void* fp, const char* key, void* item)
+{
+    index_save_word(fp, key, postings_open(item));
+}
+
+/**************** index_save_word() ****************/
+/* writes one "word docID count ..." line, consuming cursor */
+static void
+index_save_word(FILE* fp, const char* word, cursor_t* cursor)
 {
     // for a given entry, add word to index
-    fprintf(fp, "%s", key);
+    fprintf(fp, "%s", word);
     // iterate through every docID, count pair
-    counters_iterate(item, fp, index_itr_helper);
+    while (cursor_next(cursor)) {
+        fprintf(fp, " %d %d", cursor_docID(cursor), cursor_count(cursor));
+    }
     // new line for every entry
     fprintf(fp, "\n");
+    cursor_delete(cursor);
 }
 
 static void
-index_itr_helper(void* fp, const int key, const int count)
+index_count_itr(void* arg, const char* key, void* item)
 {
-    // add [docID, count] pair to index
-    fprintf(fp, " %d %d", key, count);
+    ((wordlist_t*)arg)->size++;
 }
 
 static void
-index_delete_helper(void* item)
+index_collect_itr(void* arg, const char* key, void* item)
 {
-    counters_delete(item);
+    wordlist_t* list = arg;
+    list->items[list->size].word = key;
+    list->items[list->size].postings = item;
+    list->size++;
+}
+
+static int
+index_word_cmp(const void* a, const void* b)
+{
+    return strcmp(((const wordpostings_t*)a)->word, ((const wordpostings_t*)b)->word);
+}
+
+static int
+index_pair_cmp(const void* a, const void* b)
+{
+    int docA = *(const int*)a;
+    int docB = *(const int*)b;
+    return (docA > docB) - (docA < docB);
+}
+
+/**************** index_lookup() ****************/
+/* binary search the mapped dictionary for word */
+/* returns NULL if absent                       */
+static const indexentry_t*
+index_lookup(index_t* index, const char* word)
+{
+    uint32_t lo = 0;
+    uint32_t hi = index->numWords;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(word, &index->strings[index->dict[mid].wordOffset]);
+        if (cmp == 0) {
+            return &index->dict[mid];
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
 }
 
 /**************** index_find() ****************/
-/* return counters_t associated with key      */
+/* return postings_t associated with key      */
 /* description in index.h                     */
-counters_t* 
+postings_t* 
 index_find(index_t* index, char* key)
 {
+    if (index->table == NULL) {
+        return NULL;
+    }
     return hashtable_find(index->table, key);
 }
 
+/**************** index_open() ****************/
+/* return a cursor over the postings of word  */
+/* description in index.h                     */
+cursor_t*
+index_open(index_t* index, const char* word)
+{
+    if (index == NULL || word == NULL) {
+        return NULL;
+    }
+    if (index->map == NULL) {
+        return postings_open(hashtable_find(index->table, word));
+    }
+    const indexentry_t* entry = index_lookup(index, word);
+    if (entry == NULL) {
+        return NULL;
+    }
+    return cursor_new(&index->postings[entry->postingOffset], entry->postingBytes,
+                      entry->numPostings, entry->maxCount);
+}
+
 /**************** index_add() ****************/
 /* increment docID word count in index       */
 /* description in index.h                    */
 bool 
 index_add(index_t* index, char* key, int docID)
 {
-    counters_t* counter;
-    if (hashtable_find(index->table, key) == NULL) {
-        counter = counters_new();
-        counters_add(counter, docID);
-        return hashtable_insert(index->table, key, counter);
+    postings_t* postings;
+    // a mapped index is read-only
+    if (index->table == NULL) {
+        return false;
+    }
+    // one lookup: a word already seen is just counted
+    if ((postings = hashtable_find(index->table, key)) == NULL) {
+        postings = postings_newIn(index->arena);
+        postings_add(postings, docID);
+        index->memory += strlen(key) + 1 + WORD_OVERHEAD + postings_memory(postings);
+        return hashtable_insert(index->table, key, postings);
+    }
+
+    size_t before = postings_memory(postings);
+    bool added = postings_add(postings, docID);
+    index->memory += postings_memory(postings) - before;
+    return added;
+}
+
+/**************** index_memory() ****************/
+/* estimated bytes of the words added so far     */
+/* description in index.h                        */
+size_t
+index_memory(index_t* index)
+{
+    return index == NULL ? 0 : index->memory;
+}
+
+/**************** index_clear() ****************/
+/* removes every word from an in-memory index    */
+/* description in index.h                        */
+void
+index_clear(index_t* index)
+{
+    if (index == NULL || index->table == NULL) {
+        return;
+    }
+    hashtable_delete(index->table, NULL);
+    arena_delete(index->arena);
+    index->table = hashtable_new(index->slots);
+    index->arena = arena_new();
+    index->memory = 0;
+}
+
+/**************** index_mergeRuns() ****************/
+/* k-way merges sorted binary runs into a text   */
+/* index file, a word at a time                  */
+/* description in index.h                        */
+bool
+index_mergeRuns(char** runFilenames, const int numRuns, char* indexFilename)
+{
+    if (runFilenames == NULL || numRuns <= 0 || indexFilename == NULL) {
+        return false;
+    }
+    FILE* fp = fopen(indexFilename, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: Cannot write to %s\n", indexFilename);
+        return false;
+    }
+
+    // a min-heap of the runs, by next word, then by run order; there
+    // may be thousands of runs, too many for the stack
+    runcursor_t* heap = mem_malloc_assert(numRuns * sizeof(runcursor_t), "run heap");
+    int size = 0;
+    bool ok = true;
+    for (int r = 0; r < numRuns; r++) {
+        index_t* run = index_map(runFilenames[r]);
+        if (run == NULL) {
+            fprintf(stderr, "ERROR: Cannot map index run %s\n", runFilenames[r]);
+            ok = false;
+            continue;
+        }
+        if (run->numWords == 0) {
+            index_delete(run);
+            mem_free(run);
+            continue;
+        }
+        // each run is read once, front to back
+        posix_madvise(run->map, run->mapSize, POSIX_MADV_SEQUENTIAL);
+        heap[size].run = run;
+        heap[size].next = 0;
+        heap[size].order = r;
+        memset(heap[size].released, 0, sizeof(heap[size].released));
+        size++;
+    }
+    for (int i = size / 2 - 1; i >= 0; i--) {
+        run_sift(heap, size, i);
+    }
+
+    while (ok && size > 0) {
+        // the smallest word; its runs pop off in run order,
+        // so its docIDs are written in increasing order
+        const char* word = run_word(&heap[0]);
+        char* current = mem_malloc_assert(strlen(word) + 1, "merge word");
+        strcpy(current, word);
+        fprintf(fp, "%s", current);
+        while (size > 0 && strcmp(run_word(&heap[0]), current) == 0) {
+            runcursor_t* top = &heap[0];
+            const indexentry_t* entry = &top->run->dict[top->next];
+            cursor_t* cursor = cursor_new(top->run->postings + entry->postingOffset,
+                                          entry->postingBytes, entry->numPostings,
+                                          entry->maxCount);
+            while (cursor_next(cursor)) {
+                fprintf(fp, " %d %d", cursor_docID(cursor), cursor_count(cursor));
+            }
+            cursor_delete(cursor);
+
+            // advance the run, or drop it when done
+            if (++top->next == top->run->numWords) {
+                index_delete(top->run);
+                mem_free(top->run);
+                heap[0] = heap[--size];
+            } else {
+                run_release(top);
+            }
+            run_sift(heap, size, 0);
+        }
+        fprintf(fp, "\n");
+        mem_free(current);
+    }
+
+    for (int i = 0; i < size; i++) {
+        index_delete(heap[i].run);
+        mem_free(heap[i].run);
+    }
+    mem_free(heap);
+    return fclose(fp) == 0 && ok;
+}
+
+/**************** run_word() ****************/
+/* the next word of a run */
+static const char*
+run_word(const runcursor_t* cursor)
+{
+    return &cursor->run->strings[cursor->run->dict[cursor->next].wordOffset];
+}
+
+/**************** run_less() ****************/
+/* orders runs by next word, then run order */
+static bool
+run_less(const runcursor_t* a, const runcursor_t* b)
+{
+    int cmp = strcmp(run_word(a), run_word(b));
+    return cmp < 0 || (cmp == 0 && a->order < b->order);
+}
+
+/**************** run_release() ****************/
+/* gives back the pages of a run read so far, so   */
+/* merging many runs does not keep them resident   */
+static void
+run_release(runcursor_t* cursor)
+{
+    const index_t* run = cursor->run;
+    const indexentry_t* entry = &run->dict[cursor->next];
+    run_release_range(run, &cursor->released[0], run->dict, entry);
+    run_release_range(run, &cursor->released[1], run->strings,
+                      &run->strings[entry->wordOffset]);
+    run_release_range(run, &cursor->released[2], run->postings,
+                      &run->postings[entry->postingOffset]);
+}
+
+/**************** run_release_range() ****************/
+/* gives back the whole pages from start to done,    */
+/* once at least RUN_RELEASE more bytes are done;    */
+/* released is how far that has been done            */
+static void
+run_release_range(const index_t* run, size_t* released, const void* start, const void* done)
+{
+    const uint8_t* map = run->map;
+    size_t page = sysconf(_SC_PAGESIZE);
+    // whole pages only: a page shared with the block before is still in use
+    size_t from = (const uint8_t*)start - map;
+    from += (page - from % page) % page;
+    size_t to = (const uint8_t*)done - map;
+    to -= to % page;
+    if (*released < from) {
+        *released = from;
     }
+    if (to >= *released + RUN_RELEASE) {
+        madvise((uint8_t*)map + *released, to - *released, MADV_DONTNEED);
+        *released = to;
+    }
+}
 
-    counter = hashtable_find(index->table, key);
-    return counters_add(counter, docID);
+/**************** run_sift() ****************/
+/* restores the min-heap below i */
+static void
+run_sift(runcursor_t* heap, const int size, int i)
+{
+    while (true) {
+        int least = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < size && run_less(&heap[left], &heap[least])) {
+            least = left;
+        }
+        if (right < size && run_less(&heap[right], &heap[least])) {
+            least = right;
+        }
+        if (least == i) {
+            return;
+        }
+        runcursor_t swap = heap[i];
+        heap[i] = heap[least];
+        heap[least] = swap;
+        i = least;
+    }
+}
+
+/**************** index_merge() ****************/
+/* merges partial indexes into index, one thread */
+/* per share of the words                        */
+/* description in index.h                        */
+bool
+index_merge(index_t* index, index_t** parts, const int numParts, const int maxDocID)
+{
+    if (index == NULL || index->table == NULL || parts == NULL || numParts <= 0) {
+        return false;
+    }
+    for (int p = 0; p < numParts; p++) {
+        if (parts[p] == NULL || parts[p]->table == NULL) {
+            return false;
+        }
+    }
+
+    // the parts are only read, so every thread may iterate them; the
+    // decoder picks its kernel once, before the threads share it
+    index_decoder();
+    mergeshare_t* shares = mem_calloc_assert(numParts, sizeof(mergeshare_t), "merge shares");
+    for (int t = 0; t < numParts; t++) {
+        shares[t].parts = parts;
+        shares[t].numParts = numParts;
+        shares[t].share = t;
+        shares[t].maxDocID = maxDocID;
+        if (pthread_create(&shares[t].thread, NULL, index_merge_share, &shares[t]) != 0) {
+            // not enough threads: merge this share here
+            index_merge_share(&shares[t]);
+            shares[t].thread = pthread_self();
+        }
+    }
+
+    // the hashtable is not thread-safe: insert the merged words here
+    bool ok = true;
+    for (int t = 0; t < numParts; t++) {
+        if (!pthread_equal(shares[t].thread, pthread_self())) {
+            pthread_join(shares[t].thread, NULL);
+        }
+        for (int w = 0; w < shares[t].merged.size; w++) {
+            wordpostings_t* item = &shares[t].merged.items[w];
+            if (!hashtable_insert(index->table, item->word, item->postings)) {
+                // index was not empty
+                postings_delete(item->postings);
+                ok = false;
+            }
+        }
+        // the merged postings now belong to index
+        arena_join(index->arena, shares[t].arena);
+        if (shares[t].merged.items != NULL) {
+            mem_free(shares[t].merged.items);
+        }
+    }
+    mem_free(shares);
+    return ok;
+}
+
+/**************** index_merge_share() ****************/
+/* gathers the parts' postings for each word of this   */
+/* thread's share, then merges each word's postings    */
+static void*
+index_merge_share(void* arg)
+{
+    mergeshare_t* share = arg;
+    share->words = hashtable_new(MERGE_SLOTS);
+    share->scratch = arena_new();
+    share->arena = arena_new();
+    for (int p = 0; p < share->numParts; p++) {
+        share->source = p;
+        hashtable_iterate(share->parts[p]->table, share, index_merge_collect_itr);
+    }
+    hashtable_iterate(share->words, share, index_merge_word_itr);
+    hashtable_delete(share->words, NULL);
+    arena_delete(share->scratch);
+    return NULL;
+}
+
+/**************** index_merge_collect_itr() ****************/
+/* records a part's postings for a word of this share */
+static void
+index_merge_collect_itr(void* arg, const char* key, void* item)
+{
+    mergeshare_t* share = arg;
+    if (hash_bytes(key, strlen(key), 0) % share->numParts != share->share) {
+        return;
+    }
+    mergeword_t* word = hashtable_find(share->words, key);
+    if (word == NULL) {
+        size_t size = sizeof(mergeword_t) + share->numParts * sizeof(postings_t*);
+        word = mem_assert(arena_alloc(share->scratch, size), "merge word");
+        memset(word, 0, size);
+        word->word = key;
+        hashtable_insert(share->words, key, word);
+    }
+    word->sources[share->source] = item;
+}
+
+/**************** index_merge_word_itr() ****************/
+/* merges one word's postings from every part by docID */
+static void
+index_merge_word_itr(void* arg, const char* key, void* item)
+{
+    mergeshare_t* share = arg;
+    mergeword_t* word = item;
+    postings_t** sources = word->sources;
+
+    // a cursor on each part holding the word, each on its first pair
+    cursor_t* cursors[share->numParts];
+    int numCursors = 0;
+    for (int p = 0; p < share->numParts; p++) {
+        if (sources[p] != NULL) {
+            cursors[numCursors] = postings_open(sources[p]);
+            if (cursor_next(cursors[numCursors])) {
+                numCursors++;
+            } else {
+                cursor_delete(cursors[numCursors]);
+            }
+        }
+    }
+
+    postings_t* postings = postings_newIn(share->arena);
+    while (numCursors > 0) {
+        // the parts hold disjoint documents; take the smallest next
+        int c = 0;
+        for (int i = 1; i < numCursors; i++) {
+            if (cursor_docID(cursors[i]) < cursor_docID(cursors[c])) {
+                c = i;
+            }
+        }
+        int docID = cursor_docID(cursors[c]);
+        if (share->maxDocID <= 0 || docID <= share->maxDocID) {
+            postings_append(postings, docID, cursor_count(cursors[c]));
+        }
+        if (!cursor_next(cursors[c])) {
+            cursor_delete(cursors[c]);
+            cursors[c] = cursors[--numCursors];
+        }
+    }
+    if (postings_size(postings) == 0) {
+        postings_delete(postings);
+        return;
+    }
+
+    // the word is a part's key, which outlives this thread's table
+    if (share->merged.size == share->capacity) {
+        int capacity = share->capacity == 0 ? 1024 : 2 * share->capacity;
+        wordpostings_t* items = mem_malloc_assert(capacity * sizeof(wordpostings_t), "merged words");
+        if (share->merged.items != NULL) {
+            memcpy(items, share->merged.items, share->merged.size * sizeof(wordpostings_t));
+            mem_free(share->merged.items);
+        }
+        share->merged.items = items;
+        share->capacity = capacity;
+    }
+    share->merged.items[share->merged.size].word = word->word;
+    share->merged.items[share->merged.size].postings = postings;
+    share->merged.size++;
 }
 
 /**************** index_search() ****************/
 /* initializes score array with score (relevance of word) */
 /* for every word in words and with an entry in index     */
+/* the query is evaluated document-at-a-time (query.h)    */
 void
 index_search(index_t* index, char** words, int* scores, int numDocs, int numWords) {
-    int i = 0; // words index
-    counters_t* counter;
-
     // scores is score array
     // idx 0 -> docID 1
     // the value at idx 0 is docID's score, accordingly
-    
-    // for every doc, (curDoc is document index)
-    for (int curDoc = 0; curDoc < numDocs; curDoc++) {
-        // iterate through query
-        bool init = false;
-        int minScore = 0;
-        i = 0;
-        while (i < numWords) {
-            // if "and," dont bother to look up
-            if (strcmp(words[i], "and") == 0) {
-                i++;
-                continue;
-            }
-            // if "or," add minScore to doc's score
-            if (strcmp(words[i], "or") == 0) {
-                i++;
-                scores[curDoc] += minScore;
-                minScore = 0;
-                init = false;
-                continue;
-            }
-            // else, try to find word
-            if ((counter = index_find(index, words[i])) == NULL) {
-                // if not found, minScore is 0, skip until "or"
-                minScore = 0;
-                while (words[i] != NULL && strcmp(words[i], "or") != 0) {
-                    i++;
-                }
-            } else {
-                // if found, running score is set to mininum query score
-                int curScore = counters_get(counter, curDoc+1);
-                // if uninitialized, set to curScore
-                if (!init) {
-                    minScore = curScore;
-                    init = true;
-                } else if (curScore < minScore) {
-                    // else, if curScore is less than min, update
-                    minScore = curScore;
-                }
-                i++;
-            }
-        }
-        // terminated word sequence, last update
-        scores[curDoc] += minScore;
-        minScore = 0;
+    hit_t* hits;
+    int numHits = query_evaluate(index, words, numWords, &hits);
+    for (int h = 0; h < numHits && hits[h].docID <= numDocs; h++) {
+        scores[hits[h].docID - 1] += hits[h].score;
     }
+    if (hits != NULL) {
+        mem_free(hits);
+    }
+}
+
+/**************** index_setDecoder() ****************/
+/* choose the postings block decoder            */
+/* description in index.h                       */
+bool
+index_setDecoder(const char* name)
+{
+    return bitpack_select(name);
+}
+
+/**************** index_decoder() ****************/
+/* name the postings block decoder              */
+/* description in index.h                       */
+const char*
+index_decoder(void)
+{
+    return bitpack_name();
 }
 
 /**************** num_docs_crawled() ****************/
 /* Returns the number of crawled docs in a crawler directory            */
 /* Assumes directory *is* a crawler directory without extensive checks  */
+/* read from the crawl manifest; directories without one are probed    */
 int
 num_docs_crawled(char* pageDirectory)
 {
-    FILE* fp;
-    int DOC_ID_MAX_LEN = 20; // ASSUMPTION: there are less than 10^19 docID's
-    char docString[DOC_ID_MAX_LEN];
-    char* filePath;
-    int docID = 1;
-
-    // create filePath string
-    filePath = mem_malloc(strlen(pageDirectory) + DOC_ID_MAX_LEN + 1);
-    sprintf(docString, "%d", docID);
-    strcpy(filePath, pageDirectory);
-    strcat(filePath, "/");
-    strcat(filePath, docString);
-
-    while ((fp = fopen(filePath, "r")) != NULL) {
-        mem_free(filePath);
-        docID++;
-        filePath = mem_malloc(strlen(pageDirectory) + DOC_ID_MAX_LEN + 1);
-        sprintf(docString, "%d", docID);
-        strcpy(filePath, pageDirectory);
-        strcat(filePath, "/");
-        strcat(filePath, docString);
-        fclose(fp);
+    int numDocs = pagedir_count(pageDirectory);
+    if (numDocs < 0) {
+        numDocs = pagedir_probe(pageDirectory);
     }
-    mem_free(filePath);
-
-    return docID - 1;
+    return numDocs;
 }
@@ -4,7 +4,7 @@
 
 #include <stdlib.h>
 #include "hashtable.h"
-#include "counters.h"
+#include "postings.h"
 #include "mem.h"
 
 /**************** global types ****************/
@@ -48,8 +48,49 @@ void index_save(index_t* index, char* indexFilename);
  */
 void index_load(index_t* index, char* indexFilename);
 
+/**************** index_saveBinary ****************/
+/* Saves the index to indexFilename in the binary format
+ * read by index_map: a header, a dictionary sorted by word,
+ * the words themselves, and docID-sorted (docID, count) pairs.
+ *
+ * Caller provides:
+ *   a valid path to an existing directory and filename
+ *   If the file does not yet exist, it will be created
+ * We return:
+ *   void; exits non-zero if the file cannot be written
+ */
+void index_saveBinary(index_t* index, char* indexFilename);
+
+/**************** index_map ****************/
+/* Maps a binary index file written by index_saveBinary into memory
+ * and uses it in place. The file is read through once to check it
+ * (see below), then its pages are given back, so only the pages touched
+ * by lookups stay in memory.
+ *
+ * Caller provides:
+ *   a path to a readable binary index file
+ * We return:
+ *   pointer to a read-only index; NULL if the file cannot be opened,
+ *   is not a binary index, or is of another version or truncated, or
+ *   if a dictionary entry's word or postings lie outside their blocks,
+ *   or its postings are not exactly numPostings pairs (postings_valid).
+ * Caller is responsible for:
+ *   later calling index_delete and mem_free on the index.
+ * Notes:
+ *   index_add, index_load and index_find do not apply to a mapped index;
+ *   index_save and index_search work on either kind.
+ */
+index_t* index_map(char* indexFilename);
+
+/**************** index_isBinary ****************/
+/* Returns true if indexFilename begins with the binary index magic,
+ * false if it cannot be read or is (presumably) a text index.
+ */
+bool index_isBinary(char* indexFilename);
+
 /**************** index_delete ****************/
 /* Frees memory associated within index struture
+ * (or unmaps the file of an index from index_map)
  *
  * Caller provides:
  *   valid pointer to an index
@@ -65,11 +106,27 @@ void index_delete(index_t* index);
  *   valid pointer to index, valid string for key.
  * We return:
  *   pointer to the item corresponding to the given key, if found;
- *   NULL if index is NULL, key is NULL, or key is not found.
+ *   NULL if index is NULL, key is NULL, or key is not found,
+ *   and always NULL for an index from index_map.
  * Notes:
  *   the index is unchanged by this operation.
  */
-counters_t* index_find(index_t* index, char* key);
+postings_t* index_find(index_t* index, char* key);
+
+/**************** index_open ****************/
+/* Return a cursor over the postings of word, in docID order.
+ * This is how postings are read from either kind of index;
+ * see postings.h for the cursor functions.
+ *
+ * Caller provides:
+ *   valid pointer to index, valid string for word.
+ * We return:
+ *   a new cursor positioned before the first (docID, count) pair;
+ *   NULL if index or word is NULL, or word is not in the index.
+ * Caller is responsible for:
+ *   later calling cursor_delete.
+ */
+cursor_t* index_open(index_t* index, const char* word);
 
 /**************** index_add ****************/
 /* Increments the count associated with the docID
@@ -83,11 +140,56 @@ counters_t* index_find(index_t* index, char* key);
  */
 bool index_add(index_t* index, char* key, int docID);
 
+/**************** index_merge ****************/
+/* Moves the words of numParts partial indexes into index, merging
+ * each word's postings by docID. The words are split among numParts
+ * threads by hash, and each thread merges its share of them.
+ *
+ * Caller provides:
+ *   valid pointer to an empty in-memory index, and numParts in-memory
+ *   indexes holding disjoint sets of documents (a document's words
+ *   all in one part), for example built by separate threads;
+ *   maxDocID > 0 drops the documents after it, 0 keeps all.
+ * We return:
+ *   true on success; false if any argument is invalid.
+ * We guarantee:
+ *   the parts are unchanged, and may be deleted afterwards.
+ */
+bool index_merge(index_t* index, index_t** parts, const int numParts, const int maxDocID);
+
+/**************** index_memory ****************/
+/* Return an estimate of the bytes held by the words and postings
+ * added with index_add since index_new or index_clear; 0 if NULL.
+ */
+size_t index_memory(index_t* index);
+
+/**************** index_clear ****************/
+/* Remove every word from an in-memory index, freeing its postings;
+ * the index is then empty, as from index_new.
+ */
+void index_clear(index_t* index);
+
+/**************** index_mergeRuns ****************/
+/* Merge runs, binary index files written by index_saveBinary, into
+ * one index file in the text format of index_save. The runs must hold
+ * increasing docIDs in the order given (run 1's documents all before
+ * run 2's, and so on); a word in several runs gets one line with the
+ * runs' postings in that order. Words are written in sorted order and
+ * only one run entry is held in memory at a time.
+ *
+ * We return:
+ *   true if every run was read and indexFilename completely written;
+ *   false on error, after printing a message to stderr.
+ */
+bool index_mergeRuns(char** runFilenames, const int numRuns, char* indexFilename);
+
 /**************** index_search ****************/
 /* initializes score array with score, representing
  * relevance of a word as defined in specs. This is done
  * for every word in words which return a non-null counter
- * with a look-up in the index.
+ * with a look-up in the index. Scores are added to the
+ * entries of documents 1..numDocs; query_evaluate (query.h)
+ * returns the same scores for just the matching documents.
  *
  * Caller provides:
  *   valid index pointer, array of char*, int array of scores
@@ -99,9 +201,28 @@ bool index_add(index_t* index, char* key, int docID);
  */
 void index_search(index_t* index, char** words, int* scores, int numDocs, int numWords);
 
+/**************** index_setDecoder ****************/
+/* Choose the kernel that decodes packed postings blocks:
+ * "auto" (the default: AVX2, SSE4.1 or scalar, whichever the CPU
+ * supports best), "avx2", "sse4.1" or "scalar".
+ *
+ * We return:
+ *   true if selected; false if unknown or not supported by this CPU.
+ */
+bool index_setDecoder(const char* name);
+
+/**************** index_decoder ****************/
+/* Return the name of the kernel decoding packed postings blocks,
+ * choosing it if none has been yet; call it before starting threads
+ * that decode (index_merge does so for its own).
+ */
+const char* index_decoder(void);
+
 /**************** num_docs_crawled ****************/
 /* Returns the number of crawled docs in a crawler directory
  * Assumes directory *is* a crawler directory without extensive checks
+ * The count is read from the crawl manifest in .crawler (pagedir.h);
+ * only a directory without one is probed page by page.
  *
  * Caller provides:
  *   A valid path to an existing readable crawler directory
@@ -1,20 +1,31 @@
 /* pagedir.c    Kyrylo Bakumenko    23 April, 2023
  *
  * This file contains methods for initalizing a directory
- * and saving crawled files found through a call to crawler.c
+ * and saving crawled files found through a call to crawler.c,
+ * and for writing and reading the manifest of a completed crawl
  * 
  * Error Codes: 1 -> Cannot write to specified directory
  */
 
+#define _POSIX_C_SOURCE 200809L // access
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "../libcs50/webpage.h"
 #include "../libcs50/mem.h"
 
+// manifest format version, first line of .crawler
+static const int MANIFEST_VERSION = 1;
+
 // function prototypes
 bool pagedir_init(const char* pageDirectory);
-void pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID);
+size_t pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID);
+bool pagedir_finish(const char* pageDirectory, const int numDocs, const size_t* lengths);
+int pagedir_count(const char* pageDirectory);
+int pagedir_probe(const char* pageDirectory);
+static char* pagedir_path(const char* pageDirectory, const char* name);
 
 /**************** pagedir_init() ****************/
 /* See pagedir.h for more information           */
@@ -42,7 +53,7 @@ pagedir_init(const char* pageDirectory)
 
 /**************** pagedir_save() ****************/
 /* See pagedir.h for more information           */
-void 
+size_t
 pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID)
 {
     // construct the pathname for the page file in pageDirectory
@@ -65,7 +76,86 @@ pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID)
     fprintf(fp, "%d\n", webpage_getDepth(page));
     // print the contents of the webpage
     fprintf(fp, "%s\n", webpage_getHTML(page));
-    // close the file and return true.
+    // close the file and return its size.
+    long length = ftell(fp);
     fclose(fp);
     mem_free(page_path);
+    return length < 0 ? 0 : length;
+}
+
+/**************** pagedir_finish() ****************/
+/* See pagedir.h for more information           */
+bool
+pagedir_finish(const char* pageDirectory, const int numDocs, const size_t* lengths)
+{
+    // write a temporary file, then rename it over .crawler
+    char* tmp_path = pagedir_path(pageDirectory, "/.crawler.tmp");
+    char* crawler_path = pagedir_path(pageDirectory, "/.crawler");
+    FILE* fp = fopen(tmp_path, "w");
+    bool ok = fp != NULL;
+    if (ok) {
+        fprintf(fp, "tse-crawler %d\ndocs %d\nmaxDocID %d\n", MANIFEST_VERSION, numDocs, numDocs);
+        size_t offset = 0;
+        for (int docID = 1; docID <= numDocs; docID++) {
+            fprintf(fp, "%d %zu %zu\n", docID, offset, lengths[docID - 1]);
+            offset += lengths[docID - 1];
+        }
+        ok = !ferror(fp);
+        ok = (fclose(fp) == 0) && ok;
+        ok = ok && rename(tmp_path, crawler_path) == 0;
+        if (!ok) {
+            remove(tmp_path);
+        }
+    }
+    mem_free(tmp_path);
+    mem_free(crawler_path);
+    return ok;
+}
+
+/**************** pagedir_count() ****************/
+/* See pagedir.h for more information           */
+int
+pagedir_count(const char* pageDirectory)
+{
+    char* crawler_path = pagedir_path(pageDirectory, "/.crawler");
+    FILE* fp = fopen(crawler_path, "r");
+    mem_free(crawler_path);
+    if (fp == NULL) {
+        return -1;
+    }
+    // only the header is read, however many pages there are
+    int version, numDocs, maxDocID;
+    int fields = fscanf(fp, "tse-crawler %d docs %d maxDocID %d", &version, &numDocs, &maxDocID);
+    fclose(fp);
+    if (fields != 3 || version != MANIFEST_VERSION || maxDocID < 0) {
+        return -1;
+    }
+    return maxDocID;
+}
+
+/**************** pagedir_probe() ****************/
+/* See pagedir.h for more information           */
+int
+pagedir_probe(const char* pageDirectory)
+{
+    // one path buffer, rewritten for each docID
+    char* page_path = pagedir_path(pageDirectory, "/12345678901234567890");
+    size_t dirLen = strlen(pageDirectory);
+    int docID = 0;
+    do {
+        sprintf(&page_path[dirLen], "/%d", ++docID);
+    } while (access(page_path, R_OK) == 0);
+    mem_free(page_path);
+    return docID - 1;
+}
+
+/**************** pagedir_path() ****************/
+/* returns pageDirectory followed by name, to be mem_free'd */
+static char*
+pagedir_path(const char* pageDirectory, const char* name)
+{
+    char* path = mem_malloc_assert(strlen(pageDirectory) + strlen(name) + 1, "pagedir path");
+    strcpy(path, pageDirectory);
+    strcat(path, name);
+    return path;
 }
@@ -1,5 +1,17 @@
 /* 
  * pagedir.h    Kyrylo Bakumenko    23 April, 2023
+ *
+ * A crawler directory holds one file per page, named by docID from 1,
+ * and a .crawler file. When a crawl completes, .crawler is a manifest:
+ *
+ *   tse-crawler 1
+ *   docs <number of pages>
+ *   maxDocID <largest docID>
+ *   <docID> <offset> <length>      one line per page, in docID order
+ *
+ * where length is the size of the page file in bytes and offset is the
+ * total size of the pages before it, so the page count is read in O(1).
+ * An empty .crawler (an older or interrupted crawl) has no manifest.
  */
 
 #ifndef __PAGEDIR_H
@@ -32,8 +44,39 @@ bool pagedir_init(const char* pageDirectory);
  *   existing directory, and a document ID as an int.
  * We return:
  *   URL, Depth, and HTML content of the webpage is
- *   printed to terminal
+ *   printed to the file; returns its size in bytes.
+ *   Exits non-zero if the file cannot be written.
+ */
+size_t pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID);
+
+/**************** pagedir_finish ****************/
+/* Writes the manifest of a completed crawl into .crawler
+ *
+ * Caller provides:
+ *   a valid path to a crawler directory holding pages 1..numDocs,
+ *   and lengths[docID-1], the size pagedir_save returned for each.
+ * We return:
+ *   true if the manifest was written; .crawler is replaced whole,
+ *   so readers never see a partial manifest.
+ */
+bool pagedir_finish(const char* pageDirectory, const int numDocs, const size_t* lengths);
+
+/**************** pagedir_count ****************/
+/* Reads the largest docID from the manifest in .crawler, in O(1)
+ *
+ * We return:
+ *   the largest docID (0 for an empty crawl); -1 if there is no
+ *   manifest, in which case pagedir_probe can count the pages.
+ */
+int pagedir_count(const char* pageDirectory);
+
+/**************** pagedir_probe ****************/
+/* Counts pages by checking for pageDirectory/1, /2, ... until one
+ * is missing; for directories without a manifest.
+ *
+ * We return:
+ *   the last docID found (0 if none).
  */
-void pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID);
+int pagedir_probe(const char* pageDirectory);
 
 #endif // __PAGEDIR_H
\ No newline at end of file
@@ -0,0 +1,379 @@
+/* polite.c    Kyrylo Bakumenko    26 May, 2023
+ *
+ * The politeness scheduler. See polite.h for documentation.
+ *
+ * Every host seen is a host_t, found by name in a hashtable, holding its
+ * pages in a bag and its token bucket. A bucket is refilled lazily: its
+ * tokens are known as of a time, stamp, and topped up by the time passed
+ * whenever it is looked at.
+ *
+ * A host with pages is in one of two places. With a token, it is on the
+ * ready list, and polite_next takes from the host at its head, then puts
+ * the host at its tail if it has a token left, so ready hosts take turns.
+ * Without one, it waits on a timer wheel of 256 slots of 10 ms, in the
+ * slot of the tick in which its next token is due, with the time itself,
+ * since a slot holds hosts due in any later turn of the wheel too. The
+ * wheel is turned to the present on every call, moving the hosts whose
+ * time has come to the ready list; the slot of the present tick is only
+ * partly past, so is looked at again next turn. A host with no pages is
+ * on neither, and costs nothing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "polite.h"
+#include "fetch.h"
+#include "bag.h"
+#include "hashtable.h"
+#include "mem.h"
+
+// the timer wheel: slots, and seconds per slot
+#define WHEEL_SLOTS 256
+static const double TICK = 0.01;
+
+// hosts expected, for the size of the hashtable
+static const int HOSTS = 64;
+
+// where a host is
+enum { HOST_IDLE, HOST_READY, HOST_WAITING };
+
+/**************** local types ****************/
+typedef struct host {
+    bag_t* queue;               // its items
+    int queued;
+    double delay;               // seconds per token
+    int burst;                  // most tokens
+    double tokens;              // as of stamp
+    double stamp;
+    int state;                  // HOST_*
+    double due;                 // if waiting, the time of its next token
+    long long tick;             //   and its tick
+    struct host* next;          // in the ready list, or its wheel slot
+    struct host* all;           // every host
+} host_t;
+
+/**************** global types ****************/
+typedef struct polite {
+    hashtable_t* hosts;         // by name
+    host_t* all;                // every host, newest first
+    double delay;               // the defaults
+    int burst;
+    host_t* ready;              // hosts with a token, in turn
+    host_t* readyTail;
+    host_t* wheel[WHEEL_SLOTS]; // hosts without
+    long long tick;             // the wheel is turned past here; -1 until used
+    int waiting;                // hosts on the wheel
+    int pending;                // items queued
+} polite_t;
+
+/**************** local functions ****************/
+static host_t* politeHost(polite_t* polite, const char* name);
+static void politeRefill(host_t* host, const double now);
+static void politeSchedule(polite_t* polite, host_t* host, const double now);
+static void politeReady(polite_t* polite, host_t* host);
+static void politeTurn(polite_t* polite, const double now);
+static double politeWait(polite_t* polite, const double now);
+
+/**************** polite_new() ****************/
+/* see polite.h for description */
+polite_t*
+polite_new(const double delay, const int burst)
+{
+    if (delay < 0 || burst < 1) {
+        return NULL;
+    }
+    polite_t* polite = mem_malloc(sizeof(polite_t));
+    if (polite == NULL) {
+        return NULL;
+    }
+    polite->hosts = hashtable_new(HOSTS);
+    if (polite->hosts == NULL) {
+        mem_free(polite);
+        return NULL;
+    }
+    polite->all = NULL;
+    polite->delay = delay;
+    polite->burst = burst;
+    polite->ready = polite->readyTail = NULL;
+    for (int s = 0; s < WHEEL_SLOTS; s++) {
+        polite->wheel[s] = NULL;
+    }
+    polite->tick = -1;
+    polite->waiting = 0;
+    polite->pending = 0;
+    return polite;
+}
+
+/**************** polite_rate() ****************/
+/* see polite.h for description */
+bool
+polite_rate(polite_t* polite, const char* host, const double delay, const int burst)
+{
+    if (polite == NULL || host == NULL || delay < 0 || burst < 1) {
+        return false;
+    }
+    host_t* h = politeHost(polite, host);
+    if (h == NULL) {
+        return false;
+    }
+    h->delay = delay;
+    h->burst = burst;
+    if (h->tokens > burst) {
+        h->tokens = burst;
+    }
+    return true;
+}
+
+/**************** polite_add() ****************/
+/* see polite.h for description */
+bool
+polite_add(polite_t* polite, const char* url, void* item, const double now)
+{
+    if (polite == NULL || url == NULL || item == NULL) {
+        return false;
+    }
+    char name[strlen(url) + 1];
+    int port;
+    const char* path;
+    if (!fetch_parseURL(url, name, &port, &path)) {
+        return false;
+    }
+    host_t* host = politeHost(polite, name);
+    if (host == NULL) {
+        return false;
+    }
+    politeTurn(polite, now);
+    bag_insert(host->queue, item);
+    host->queued++;
+    polite->pending++;
+    if (host->state == HOST_IDLE) {
+        politeSchedule(polite, host, now);
+    }
+    return true;
+}
+
+/**************** polite_next() ****************/
+/* see polite.h for description */
+void*
+polite_next(polite_t* polite, const double now, double* wait)
+{
+    if (polite == NULL) {
+        if (wait != NULL) {
+            *wait = -1;
+        }
+        return NULL;
+    }
+    politeTurn(polite, now);
+    host_t* host = polite->ready;
+    if (host == NULL) {
+        if (wait != NULL) {
+            *wait = polite->pending == 0 ? -1 : politeWait(polite, now);
+        }
+        return NULL;
+    }
+    polite->ready = host->next;
+    if (polite->ready == NULL) {
+        polite->readyTail = NULL;
+    }
+    host->state = HOST_IDLE;
+
+    void* item = bag_extract(host->queue);
+    host->queued--;
+    polite->pending--;
+    politeRefill(host, now);
+    host->tokens -= 1;
+    if (host->queued > 0) {
+        politeSchedule(polite, host, now);
+    }
+    if (wait != NULL) {
+        *wait = 0;
+    }
+    return item;
+}
+
+/**************** polite_pending() ****************/
+/* see polite.h for description */
+int
+polite_pending(polite_t* polite)
+{
+    return polite == NULL ? 0 : polite->pending;
+}
+
+/**************** polite_delete() ****************/
+/* see polite.h for description */
+void
+polite_delete(polite_t* polite, void (*itemdelete)(void* item))
+{
+    if (polite == NULL) {
+        return;
+    }
+    host_t* host = polite->all;
+    while (host != NULL) {
+        host_t* next = host->all;
+        bag_delete(host->queue, itemdelete);
+        mem_free(host);
+        host = next;
+    }
+    hashtable_delete(polite->hosts, NULL);
+    mem_free(polite);
+}
+
+/**************** politeHost() ****************/
+/* the host of that name, made with the defaults and a full */
+/* bucket if new; NULL if out of memory                     */
+static host_t*
+politeHost(polite_t* polite, const char* name)
+{
+    host_t* host = hashtable_find(polite->hosts, name);
+    if (host != NULL) {
+        return host;
+    }
+    host = mem_malloc(sizeof(host_t));
+    if (host == NULL) {
+        return NULL;
+    }
+    host->queue = bag_new();
+    if (host->queue == NULL || !hashtable_insert(polite->hosts, name, host)) {
+        if (host->queue != NULL) {
+            bag_delete(host->queue, NULL);
+        }
+        mem_free(host);
+        return NULL;
+    }
+    host->queued = 0;
+    host->delay = polite->delay;
+    host->burst = polite->burst;
+    host->tokens = host->burst;
+    host->stamp = 0;
+    host->state = HOST_IDLE;
+    host->next = NULL;
+    host->all = polite->all;
+    polite->all = host;
+    return host;
+}
+
+/**************** politeRefill() ****************/
+/* tops up host's tokens for the time since its stamp */
+static void
+politeRefill(host_t* host, const double now)
+{
+    if (host->delay <= 0) {
+        host->tokens = host->burst;
+    } else if (now > host->stamp) {
+        host->tokens += (now - host->stamp) / host->delay;
+        if (host->tokens > host->burst) {
+            host->tokens = host->burst;
+        }
+    }
+    if (now > host->stamp) {
+        host->stamp = now;
+    }
+}
+
+/**************** politeSchedule() ****************/
+/* puts idle host, which has items, on the ready list if it has */
+/* a token, or on the wheel at the tick its next one is due     */
+static void
+politeSchedule(polite_t* polite, host_t* host, const double now)
+{
+    politeRefill(host, now);
+    if (host->tokens >= 1) {
+        politeReady(polite, host);
+        return;
+    }
+    host->due = host->stamp + (1 - host->tokens) * host->delay;
+    long long tick = (long long)(host->due / TICK);
+    if (tick <= polite->tick) {
+        // that slot is turned past already
+        tick = polite->tick + 1;
+    }
+    host->tick = tick;
+    host->state = HOST_WAITING;
+    host->next = polite->wheel[tick % WHEEL_SLOTS];
+    polite->wheel[tick % WHEEL_SLOTS] = host;
+    polite->waiting++;
+}
+
+/**************** politeReady() ****************/
+/* puts host at the tail of the ready list */
+static void
+politeReady(polite_t* polite, host_t* host)
+{
+    host->state = HOST_READY;
+    host->next = NULL;
+    if (polite->readyTail == NULL) {
+        polite->ready = host;
+    } else {
+        polite->readyTail->next = host;
+    }
+    polite->readyTail = host;
+}
+
+/**************** politeTurn() ****************/
+/* turns the wheel to now, making ready every host whose */
+/* time has come; each slot is looked at once at most    */
+static void
+politeTurn(polite_t* polite, const double now)
+{
+    long long to = (long long)(now / TICK);
+    if (polite->tick < 0 || polite->waiting == 0) {
+        if (to - 1 > polite->tick) {
+            polite->tick = to - 1;
+        }
+        return;
+    }
+    long long from = polite->tick + 1;
+    if (to - from >= WHEEL_SLOTS) {
+        from = to - WHEEL_SLOTS + 1;
+    }
+    for (long long t = from; t <= to && polite->waiting > 0; t++) {
+        host_t** at = &polite->wheel[t % WHEEL_SLOTS];
+        while (*at != NULL) {
+            host_t* host = *at;
+            if (host->due > now) {
+                // due later in this tick, or a later turn of the wheel
+                at = &host->next;
+                continue;
+            }
+            *at = host->next;
+            polite->waiting--;
+            // its token is due, but the sum of the refill may
+            // round a hair short of one
+            politeRefill(host, now);
+            if (host->tokens < 1) {
+                host->tokens = 1;
+            }
+            politeReady(polite, host);
+        }
+    }
+    if (to - 1 > polite->tick) {
+        polite->tick = to - 1;
+    }
+}
+
+/**************** politeWait() ****************/
+/* seconds from now until the first host on the wheel is due */
+static double
+politeWait(polite_t* polite, const double now)
+{
+    double first = -1;
+    // the first slot with a host due in this turn, and the first of those
+    for (long long t = polite->tick + 1; t <= polite->tick + WHEEL_SLOTS && first < 0; t++) {
+        for (host_t* host = polite->wheel[t % WHEEL_SLOTS]; host != NULL; host = host->next) {
+            if (host->tick == t && (first < 0 || host->due < first)) {
+                first = host->due;
+            }
+        }
+    }
+    // else the first of any later turn
+    bool later = first < 0;
+    for (int s = 0; s < WHEEL_SLOTS && later; s++) {
+        for (host_t* host = polite->wheel[s]; host != NULL; host = host->next) {
+            if (first < 0 || host->due < first) {
+                first = host->due;
+            }
+        }
+    }
+    return first > now ? first - now : 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * polite.h    Kyrylo Bakumenko    26 May, 2023
+ *
+ * A politeness scheduler: the crawler's frontier, kept per host, which
+ * hands out a page to fetch only when its host may be fetched from again.
+ *
+ * Each host has a token bucket: one token per fetch, refilled at one per
+ * delay seconds, holding at most burst tokens. A burst of 1 is a minimum
+ * delay between the starts of two fetches from the host; a larger burst
+ * lets that many go at once after an idle spell, at the same average
+ * rate. Every host has the default delay and burst unless polite_rate
+ * sets its own. The default profile, a delay of 1 second and a burst of
+ * 1, is the second between fetches that the crawler always kept.
+ *
+ * Hosts with pages waiting and a token are taken in turn; hosts with
+ * pages but no token wait on a timer wheel for the time of their next
+ * one, so polite_next finds the next page in O(1), and says how long to
+ * sleep only when every host with pages is throttled.
+ *
+ * Pages are taken from a host's queue in the order a bag gives them, so a
+ * crawl of one host visits its pages in the same order as with one bag.
+ *
+ * Time is the caller's, in seconds, from any steady clock (CLOCK_MONOTONIC),
+ * as long as it never goes back. A polite_t is not thread-safe.
+ */
+
+#ifndef __POLITE_H
+#define __POLITE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct polite polite_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** polite_new ****************/
+/* Create a new scheduler, with no pages.
+ *
+ * Caller provides:
+ *   delay >= 0, the default seconds per token (0: no limit);
+ *   burst >= 1, the default size of a host's bucket.
+ * We return:
+ *   pointer to the new scheduler; NULL if error (out of memory, or
+ *   delay or burst out of range).
+ * Caller is responsible for:
+ *   later calling polite_delete.
+ */
+polite_t* polite_new(const double delay, const int burst);
+
+/**************** polite_rate ****************/
+/* Give host a delay and burst of its own, in place of the defaults.
+ *
+ * Caller provides:
+ *   valid scheduler pointer; host, as in its URLs (no port);
+ *   delay and burst, as for polite_new.
+ * We return:
+ *   true if set; false if any parameter is invalid, or out of memory.
+ * Notes:
+ *   takes effect from the host's next refill; best set before any of
+ *   its pages are added.
+ */
+bool polite_rate(polite_t* polite, const char* host, const double delay, const int burst);
+
+/**************** polite_add ****************/
+/* Queue item, a page to fetch from url, on url's host.
+ *
+ * Caller provides:
+ *   valid scheduler pointer; url of the form http://host[:port][/path];
+ *   item, not NULL; now, the time.
+ * We return:
+ *   true if queued; false if any parameter is NULL, url has no host,
+ *   or out of memory.
+ */
+bool polite_add(polite_t* polite, const char* url, void* item, const double now);
+
+/**************** polite_next ****************/
+/* Take the next item that may be fetched at time now, spending one of
+ * its host's tokens.
+ *
+ * Caller provides:
+ *   valid scheduler pointer; now, the time; wait, where to say how long
+ *   to wait, or NULL.
+ * We return:
+ *   an item, with *wait = 0; or NULL, with *wait = the seconds until a
+ *   host has a token again, or -1 if no items are queued.
+ * Notes:
+ *   hosts that may be fetched from take turns, one item each.
+ */
+void* polite_next(polite_t* polite, const double now, double* wait);
+
+/**************** polite_pending ****************/
+/* Return the number of items queued (0 if polite is NULL). */
+int polite_pending(polite_t* polite);
+
+/**************** polite_delete ****************/
+/* Delete the scheduler, calling itemdelete on each item still queued.
+ *
+ * Caller provides:
+ *   valid scheduler pointer, or NULL (ignored); itemdelete, or NULL.
+ */
+void polite_delete(polite_t* polite, void (*itemdelete)(void* item));
+
+#endif // __POLITE_H
@@ -0,0 +1,645 @@
+/* postings.c - CS50 'postings' module
+ *
+ * Block-packed, delta-encoded postings lists, and cursors to decode them.
+ * See postings.h for documentation.
+ *
+ * Kyrylo Bakumenko, 23 April 2023
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "postings.h"
+#include "bitpack.h"
+#include "mem.h"
+
+/**************** global types ****************/
+
+typedef struct postings {
+    arena_t* arena;     // the list and buf come from here; NULL for malloc
+    uint8_t* buf;       // packed blocks, then varint pairs
+    size_t len;         // bytes used in buf
+    size_t cap;         // bytes allocated for buf
+    size_t tailStart;   // offset of the first varint pair in buf
+    int size;           // number of pairs, including the last one
+    int blockDoc;       // docID of the last pair in the last block
+    int prevDoc;        // docID of the last *encoded* pair (delta base)
+    int lastDoc;        // docID of the last pair
+    int lastCount;      // count of the last pair; kept unencoded so
+                        // postings_add can keep incrementing it
+    int maxCount;       // largest count of any pair
+} postings_t;
+
+typedef struct cursor {
+    const uint8_t* pos; // next block, or next varint pair
+    const uint8_t* end; // end of encoded bytes
+    int size;           // total number of pairs
+    int maxCount;       // largest count of any pair
+    int blocks;         // packed blocks not yet decoded
+    int index;          // current pair in docs/counts
+    int avail;          // pairs decoded into docs/counts
+    int docID;          // current pair
+    int count;
+    int tailDoc;        // unencoded last pair of an in-memory list
+    int tailCount;      // 0 if there is none (or it was consumed)
+    uint32_t docs[BITPACK_BLOCK];       // the decoded block
+    uint32_t counts[BITPACK_BLOCK];
+} cursor_t;
+
+/* A packed block of BITPACK_BLOCK pairs is
+ *
+ *   uint32 lastDoc | uint8 docBits | uint8 countBits | 2 zero bytes |
+ *   frame of (docID gap - 1) | frame of (count - 1)
+ *
+ * with each frame bit-packed as by bitpack_pack. The pairs after the
+ * last full block are varint pairs as described in postings.h.
+ */
+static const int BLOCK_HEADER = 8;
+
+// a varint is at most 5 bytes for a 32-bit value
+static const int VARINT_MAX = 5;
+
+// largest encoding of the pairs after the last block
+#define TAIL_MAX (2 * 5 * BITPACK_BLOCK)
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see postings.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static void* postings_alloc(arena_t* arena, const size_t size);
+static void postings_release(arena_t* arena, void* ptr, const size_t size);
+static bool postings_reserve(postings_t* postings, const size_t extra);
+static size_t postings_tail(const postings_t* postings, uint8_t* out);
+static size_t block_pack(const uint32_t* docs, const uint32_t* counts, uint32_t base, uint8_t* out);
+static int varint_put(uint8_t* out, uint32_t value);
+static uint32_t varint_get(const uint8_t** pos, const uint8_t* end);
+static size_t block_bytes(const uint8_t* block, const uint8_t* end);
+static int block_gallop(const uint32_t* docs, int lo, const int hi, const int docID);
+
+/**************** postings_new() ****************/
+postings_t*
+postings_new(void)
+{
+    return postings_newIn(NULL);
+}
+
+/**************** postings_newIn() ****************/
+postings_t*
+postings_newIn(arena_t* arena)
+{
+    postings_t* postings = postings_alloc(arena, sizeof(postings_t));
+    if (postings == NULL) {
+        return NULL;
+    }
+    postings->arena = arena;
+    postings->buf = NULL;
+    postings->len = 0;
+    postings->cap = 0;
+    postings->tailStart = 0;
+    postings->size = 0;
+    postings->blockDoc = 0;
+    postings->prevDoc = 0;
+    postings->lastDoc = 0;
+    postings->lastCount = 0;
+    postings->maxCount = 0;
+    return postings;
+}
+
+/**************** postings_add() ****************/
+bool
+postings_add(postings_t* postings, const int docID)
+{
+    if (postings == NULL || docID <= 0 || docID < postings->lastDoc) {
+        return false;
+    }
+    // same document as last time: just count it
+    if (docID == postings->lastDoc) {
+        postings->lastCount++;
+        if (postings->lastCount > postings->maxCount) {
+            postings->maxCount = postings->lastCount;
+        }
+        return true;
+    }
+    return postings_append(postings, docID, 1);
+}
+
+/**************** postings_append() ****************/
+bool
+postings_append(postings_t* postings, const int docID, const int count)
+{
+    if (postings == NULL || docID <= postings->lastDoc || count <= 0) {
+        return false;
+    }
+    // encode the previous last pair, now that its count is final
+    if (postings->lastCount > 0) {
+        if ((postings->size % BITPACK_BLOCK) == 0) {
+            // it completes a block: repack the varint pairs as a block
+            uint8_t block[TAIL_MAX];
+            size_t blockLen = postings_tail(postings, block);
+            postings->len = postings->tailStart;
+            if (!postings_reserve(postings, blockLen)) {
+                return false;
+            }
+            memcpy(&postings->buf[postings->len], block, blockLen);
+            postings->len += blockLen;
+            postings->tailStart = postings->len;
+            postings->blockDoc = postings->lastDoc;
+        } else {
+            if (!postings_reserve(postings, 2 * VARINT_MAX)) {
+                return false;
+            }
+            uint8_t* out = &postings->buf[postings->len];
+            out += varint_put(out, postings->lastDoc - postings->prevDoc);
+            out += varint_put(out, postings->lastCount);
+            postings->len = out - postings->buf;
+        }
+        postings->prevDoc = postings->lastDoc;
+    }
+    postings->lastDoc = docID;
+    postings->lastCount = count;
+    if (count > postings->maxCount) {
+        postings->maxCount = count;
+    }
+    postings->size++;
+    return true;
+}
+
+/**************** postings_size() ****************/
+int
+postings_size(const postings_t* postings)
+{
+    return postings == NULL ? 0 : postings->size;
+}
+
+/**************** postings_max() ****************/
+int
+postings_max(const postings_t* postings)
+{
+    return postings == NULL ? 0 : postings->maxCount;
+}
+
+/**************** postings_bytes() ****************/
+size_t
+postings_bytes(const postings_t* postings)
+{
+    if (postings == NULL) {
+        return 0;
+    }
+    uint8_t tail[TAIL_MAX];
+    return postings->tailStart + postings_tail(postings, tail);
+}
+
+/**************** postings_memory() ****************/
+size_t
+postings_memory(const postings_t* postings)
+{
+    return postings == NULL ? 0 : sizeof(postings_t) + postings->cap;
+}
+
+/**************** postings_write() ****************/
+bool
+postings_write(const postings_t* postings, FILE* fp)
+{
+    if (postings == NULL || fp == NULL) {
+        return false;
+    }
+    // the pairs after the last block are encoded on the fly,
+    // leaving postings unchanged
+    uint8_t tail[TAIL_MAX];
+    size_t tailLen = postings_tail(postings, tail);
+    if (postings->tailStart > 0
+        && fwrite(postings->buf, 1, postings->tailStart, fp) != postings->tailStart) {
+        return false;
+    }
+    return fwrite(tail, 1, tailLen, fp) == tailLen;
+}
+
+/**************** postings_delete() ****************/
+void
+postings_delete(postings_t* postings)
+{
+    if (postings != NULL) {
+        arena_t* arena = postings->arena;
+        if (postings->buf != NULL) {
+            postings_release(arena, postings->buf, postings->cap);
+        }
+        postings_release(arena, postings, sizeof(postings_t));
+    }
+}
+
+/**************** postings_open() ****************/
+cursor_t*
+postings_open(const postings_t* postings)
+{
+    if (postings == NULL) {
+        return NULL;
+    }
+    // the last pair is not in buf
+    int encoded = postings->size - (postings->lastCount > 0 ? 1 : 0);
+    cursor_t* cursor = cursor_new(postings->buf, postings->len, encoded, postings->maxCount);
+    if (cursor != NULL) {
+        cursor->size = postings->size;
+        cursor->tailDoc = postings->lastDoc;
+        cursor->tailCount = postings->lastCount;
+    }
+    return cursor;
+}
+
+/**************** cursor_new() ****************/
+cursor_t*
+cursor_new(const uint8_t* bytes, const size_t len, const int size, const int maxCount)
+{
+    cursor_t* cursor = mem_malloc(sizeof(cursor_t));
+    if (cursor == NULL) {
+        return NULL;
+    }
+    cursor->pos = bytes;
+    cursor->end = bytes + len;
+    cursor->size = size;
+    cursor->maxCount = maxCount;
+    cursor->blocks = size / BITPACK_BLOCK;
+    cursor->index = 0;
+    cursor->avail = 0;
+    cursor->docID = 0;
+    cursor->count = 0;
+    cursor->tailDoc = 0;
+    cursor->tailCount = 0;
+    return cursor;
+}
+
+/**************** cursor_next() ****************/
+bool
+cursor_next(cursor_t* cursor)
+{
+    if (cursor == NULL) {
+        return false;
+    }
+    // next pair of the decoded block
+    if (cursor->index + 1 < cursor->avail) {
+        cursor->index++;
+        cursor->docID = cursor->docs[cursor->index];
+        cursor->count = cursor->counts[cursor->index];
+        return true;
+    }
+    cursor->avail = 0;
+    // decode the next block; its gaps continue from the current docID
+    if (cursor->blocks > 0 && block_bytes(cursor->pos, cursor->end) == 0) {
+        // a corrupt block: stop rather than read past the end
+        cursor->blocks = 0;
+        cursor->tailCount = 0;
+        cursor->pos = cursor->end;
+    }
+    if (cursor->blocks > 0) {
+        const uint8_t* block = cursor->pos;
+        int docBits = block[4];
+        int countBits = block[5];
+        const uint8_t* docFrame = block + BLOCK_HEADER;
+        const uint8_t* countFrame = docFrame + bitpack_size(docBits);
+        bitpack_unpack(docFrame, docBits, 1, cursor->docs);
+        bitpack_prefix(cursor->docs, cursor->docID);
+        bitpack_unpack(countFrame, countBits, 1, cursor->counts);
+        cursor->pos = countFrame + bitpack_size(countBits);
+        cursor->blocks--;
+        cursor->index = 0;
+        cursor->avail = BITPACK_BLOCK;
+        cursor->docID = cursor->docs[0];
+        cursor->count = cursor->counts[0];
+        return true;
+    }
+    if (cursor->pos < cursor->end) {
+        uint32_t gap = varint_get(&cursor->pos, cursor->end);
+        // a pair cut short by the end is not a pair
+        if (cursor->pos < cursor->end) {
+            cursor->docID += gap;
+            cursor->count = varint_get(&cursor->pos, cursor->end);
+            return true;
+        }
+    }
+    if (cursor->tailCount > 0) {
+        cursor->docID = cursor->tailDoc;
+        cursor->count = cursor->tailCount;
+        cursor->tailCount = 0;
+        return true;
+    }
+    // ran off the end
+    cursor->docID = 0;
+    cursor->count = 0;
+    cursor->pos = cursor->end;
+    return false;
+}
+
+/**************** cursor_seek() ****************/
+/* gallops through the decoded block, skips whole blocks  */
+/* whose header lastDoc is below docID without decoding   */
+/* them, decodes only the block docID is in and gallops   */
+/* in it, and steps through the varint pairs at the end   */
+bool
+cursor_seek(cursor_t* cursor, const int docID)
+{
+    if (cursor == NULL) {
+        return false;
+    }
+    if (cursor->count > 0 && cursor->docID >= docID) {
+        return true;
+    }
+    // docID is in the decoded block
+    if (cursor->avail > 0 && cursor->docs[cursor->avail - 1] >= (uint32_t)docID) {
+        cursor->index = block_gallop(cursor->docs, cursor->index + 1, cursor->avail, docID);
+        cursor->docID = cursor->docs[cursor->index];
+        cursor->count = cursor->counts[cursor->index];
+        return true;
+    }
+    // the decoded block ends before docID: the next block's gaps (or
+    // the varint pairs') continue from its last pair, not this one
+    if (cursor->avail > 0) {
+        cursor->docID = cursor->docs[cursor->avail - 1];
+        cursor->avail = 0;
+    }
+    // skip blocks that end before docID; the next block's gaps
+    // continue from the skipped block's lastDoc
+    while (cursor->blocks > 0) {
+        size_t bytes = block_bytes(cursor->pos, cursor->end);
+        if (bytes == 0) {
+            // a corrupt block: cursor_next stops at it
+            break;
+        }
+        uint32_t lastDoc;
+        memcpy(&lastDoc, cursor->pos, sizeof(lastDoc));
+        if (lastDoc >= (uint32_t)docID) {
+            break;
+        }
+        cursor->pos += bytes;
+        cursor->blocks--;
+        cursor->avail = 0;
+        cursor->docID = lastDoc;
+    }
+    // the next block ends at or after docID: decode it, and gallop
+    if (cursor->blocks > 0) {
+        if (!cursor_next(cursor)) {
+            return false;
+        }
+        cursor->index = block_gallop(cursor->docs, 0, cursor->avail, docID);
+        cursor->docID = cursor->docs[cursor->index];
+        cursor->count = cursor->counts[cursor->index];
+        return true;
+    }
+    while (cursor_next(cursor)) {
+        if (cursor->docID >= docID) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************** postings_valid() ****************/
+bool
+postings_valid(const uint8_t* bytes, const size_t len, const int size)
+{
+    if (size < 0 || (bytes == NULL && len > 0)) {
+        return false;
+    }
+    const uint8_t* pos = bytes;
+    const uint8_t* end = bytes + len;
+    for (int b = 0; b < size / BITPACK_BLOCK; b++) {
+        size_t blockLen = block_bytes(pos, end);
+        if (blockLen == 0) {
+            return false;
+        }
+        pos += blockLen;
+    }
+    // each varint must end before the list does; one that runs to
+    // the end without a last byte stops at end with the top bit set
+    for (int i = 0; i < 2 * (size % BITPACK_BLOCK); i++) {
+        if (pos == end) {
+            return false;
+        }
+        varint_get(&pos, end);
+        if (pos[-1] & 0x80) {
+            return false;
+        }
+    }
+    return pos == end;
+}
+
+/**************** cursor getters ****************/
+int
+cursor_docID(const cursor_t* cursor)
+{
+    return cursor == NULL ? 0 : cursor->docID;
+}
+
+int
+cursor_count(const cursor_t* cursor)
+{
+    return cursor == NULL ? 0 : cursor->count;
+}
+
+int
+cursor_size(const cursor_t* cursor)
+{
+    return cursor == NULL ? 0 : cursor->size;
+}
+
+int
+cursor_max(const cursor_t* cursor)
+{
+    return cursor == NULL ? 0 : cursor->maxCount;
+}
+
+/**************** cursor_delete() ****************/
+void
+cursor_delete(cursor_t* cursor)
+{
+    if (cursor != NULL) {
+        mem_free(cursor);
+    }
+}
+
+/**************** postings_alloc() ****************/
+/* size bytes from arena, or from mem_malloc if arena is NULL */
+static void*
+postings_alloc(arena_t* arena, const size_t size)
+{
+    return arena == NULL ? mem_malloc(size) : arena_alloc(arena, size);
+}
+
+/**************** postings_release() ****************/
+/* gives back memory from postings_alloc */
+static void
+postings_release(arena_t* arena, void* ptr, const size_t size)
+{
+    if (arena == NULL) {
+        mem_free(ptr);
+    } else {
+        arena_free(arena, ptr, size);
+    }
+}
+
+/**************** postings_reserve() ****************/
+/* grow buf geometrically so at least extra more bytes fit */
+static bool
+postings_reserve(postings_t* postings, const size_t extra)
+{
+    if (postings->len + extra <= postings->cap) {
+        return true;
+    }
+    size_t cap = postings->cap == 0 ? 16 : postings->cap;
+    while (cap < postings->len + extra) {
+        cap *= 2;
+    }
+    uint8_t* buf = postings_alloc(postings->arena, cap);
+    if (buf == NULL) {
+        return false;
+    }
+    if (postings->buf != NULL) {
+        memcpy(buf, postings->buf, postings->len);
+        postings_release(postings->arena, postings->buf, postings->cap);
+    }
+    postings->buf = buf;
+    postings->cap = cap;
+    return true;
+}
+
+/**************** postings_tail() ****************/
+/* encodes the pairs after the last block, including the  */
+/* unencoded last pair, into out; a full block is packed  */
+/* returns the number of bytes written                    */
+static size_t
+postings_tail(const postings_t* postings, uint8_t* out)
+{
+    int pairs = postings->size % BITPACK_BLOCK;
+    if (pairs != 0 || postings->size == 0) {
+        // fewer than a block: copy the varints, add the last pair
+        size_t len = postings->len - postings->tailStart;
+        if (len > 0) {
+            memcpy(out, &postings->buf[postings->tailStart], len);
+        }
+        if (postings->lastCount > 0) {
+            len += varint_put(&out[len], postings->lastDoc - postings->prevDoc);
+            len += varint_put(&out[len], postings->lastCount);
+        }
+        return len;
+    }
+
+    // exactly a block: decode the varints and pack them
+    uint32_t docs[BITPACK_BLOCK];
+    uint32_t counts[BITPACK_BLOCK];
+    const uint8_t* pos = &postings->buf[postings->tailStart];
+    const uint8_t* end = &postings->buf[postings->len];
+    uint32_t docID = postings->blockDoc;
+    for (int i = 0; i < BITPACK_BLOCK - 1; i++) {
+        docID += varint_get(&pos, end);
+        docs[i] = docID;
+        counts[i] = varint_get(&pos, end);
+    }
+    docs[BITPACK_BLOCK - 1] = postings->lastDoc;
+    counts[BITPACK_BLOCK - 1] = postings->lastCount;
+    return block_pack(docs, counts, postings->blockDoc, out);
+}
+
+/**************** block_pack() ****************/
+/* packs BITPACK_BLOCK pairs following docID base into out */
+/* returns the number of bytes written                     */
+static size_t
+block_pack(const uint32_t* docs, const uint32_t* counts, uint32_t base, uint8_t* out)
+{
+    uint32_t gaps[BITPACK_BLOCK];
+    uint32_t extra[BITPACK_BLOCK];
+    for (int i = 0; i < BITPACK_BLOCK; i++) {
+        gaps[i] = docs[i] - (i == 0 ? base : docs[i-1]) - 1;
+        extra[i] = counts[i] - 1;
+    }
+    int docBits = bitpack_bits(gaps);
+    int countBits = bitpack_bits(extra);
+
+    uint32_t lastDoc = docs[BITPACK_BLOCK - 1];
+    memcpy(out, &lastDoc, sizeof(lastDoc));
+    out[4] = docBits;
+    out[5] = countBits;
+    out[6] = 0;
+    out[7] = 0;
+    uint8_t* frame = out + BLOCK_HEADER;
+    bitpack_pack(gaps, docBits, frame);
+    frame += bitpack_size(docBits);
+    bitpack_pack(extra, countBits, frame);
+    frame += bitpack_size(countBits);
+    return frame - out;
+}
+
+/**************** varint_put() ****************/
+/* writes value 7 bits per byte, low bits first; the high bit */
+/* of each byte is set if more bytes follow                   */
+/* returns the number of bytes written                        */
+static int
+varint_put(uint8_t* out, uint32_t value)
+{
+    int n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+/**************** varint_get() ****************/
+/* reads one varint at *pos and advances *pos past it;   */
+/* stops at end, and ignores bits beyond the 32 it holds  */
+static uint32_t
+varint_get(const uint8_t** pos, const uint8_t* end)
+{
+    const uint8_t* p = *pos;
+    uint32_t value = 0;
+    int shift = 0;
+    while (p < end) {
+        uint8_t byte = *p++;
+        if (shift < 32) {
+            value |= (uint32_t)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    *pos = p;
+    return value;
+}
+
+/**************** block_bytes() ****************/
+/* returns the length of the packed block at block, or 0 */
+/* if its header or frames would run past end or its bit */
+/* widths are over 32                                    */
+static size_t
+block_bytes(const uint8_t* block, const uint8_t* end)
+{
+    if (end - block < BLOCK_HEADER || block[4] > 32 || block[5] > 32) {
+        return 0;
+    }
+    size_t bytes = BLOCK_HEADER + bitpack_size(block[4]) + bitpack_size(block[5]);
+    return bytes > (size_t)(end - block) ? 0 : bytes;
+}
+
+/**************** block_gallop() ****************/
+/* returns the first i in [lo, hi) with docs[i] >= docID,  */
+/* given docs is sorted and docs[hi-1] >= docID: doubles   */
+/* the step from lo until it passes docID, then bisects    */
+static int
+block_gallop(const uint32_t* docs, int lo, const int hi, const int docID)
+{
+    int step = 1;
+    while (lo + step < hi && docs[lo + step - 1] < (uint32_t)docID) {
+        lo += step;
+        step *= 2;
+    }
+    int top = lo + step < hi ? lo + step - 1 : hi - 1;
+    while (lo < top) {
+        int mid = lo + (top - lo) / 2;
+        if (docs[mid] < (uint32_t)docID) {
+            lo = mid + 1;
+        } else {
+            top = mid;
+        }
+    }
+    return lo;
+}
@@ -0,0 +1,181 @@
+/*
+ * postings.h    Kyrylo Bakumenko    23 April, 2023
+ *
+ * A postings list holds the (docID, count) pairs of one word, sorted by
+ * docID. Every BITPACK_BLOCK pairs are stored as a packed block: the
+ * docID gaps and the counts, each bit-packed with the fewest bits that
+ * fit the block (see bitpack.h). The remaining pairs are delta-encoded
+ * with variable-byte integers: varint(docID - previous docID) followed
+ * by varint(count), so small gaps and counts take one byte each. The same
+ * bytes are used in memory and in the binary index file.
+ *
+ * A cursor decodes a postings list sequentially, a block at a time, from
+ * memory or from a mapped index file.
+ */
+
+#ifndef __POSTINGS_H
+#define __POSTINGS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
+
+/**************** global types ****************/
+typedef struct postings postings_t;  // opaque to users of the module
+typedef struct cursor cursor_t;      // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** postings_new ****************/
+/* Create a new (empty) postings list.
+ *
+ * We return:
+ *   pointer to a new postings list; NULL if error.
+ * Caller is responsible for:
+ *   later calling postings_delete.
+ */
+postings_t* postings_new(void);
+
+/**************** postings_newIn ****************/
+/* Create a new (empty) postings list in arena: the list and its buffer
+ * are allocated from the arena, and the buffer, as it grows, is given
+ * back to the arena for reuse.
+ *
+ * Caller provides:
+ *   valid arena pointer, used by no other thread while the list grows.
+ * We return:
+ *   pointer to a new postings list; NULL if error.
+ * Caller is responsible for:
+ *   either calling postings_delete, which gives the memory back to the
+ *   arena, or deleting the arena, which frees every list in it at once.
+ */
+postings_t* postings_newIn(arena_t* arena);
+
+/**************** postings_add ****************/
+/* Increment the count of docID.
+ *
+ * Caller provides:
+ *   valid postings pointer, docID > 0 no smaller than any docID added so far
+ *   (documents are indexed in increasing docID order).
+ * We return:
+ *   true if the count was incremented (or a new pair started with count 1);
+ *   false if postings is NULL or docID is out of order.
+ * Notes:
+ *   O(1) whatever the length of the list: the last pair is kept unencoded,
+ *   so the same docID again only increments its count, and a new docID
+ *   encodes that pair at the end of the buffer (packing a block every
+ *   BITPACK_BLOCK pairs).
+ */
+bool postings_add(postings_t* postings, const int docID);
+
+/**************** postings_append ****************/
+/* Append the pair (docID, count) to the end of the list.
+ *
+ * Caller provides:
+ *   valid postings pointer, docID > 0 larger than any docID so far, count > 0.
+ * We return:
+ *   true on success; false if any argument is invalid or out of order.
+ */
+bool postings_append(postings_t* postings, const int docID, const int count);
+
+/**************** postings_size ****************/
+/* Return the number of (docID, count) pairs in the list; 0 if NULL. */
+int postings_size(const postings_t* postings);
+
+/**************** postings_max ****************/
+/* Return the largest count of any pair; 0 if empty or NULL. */
+int postings_max(const postings_t* postings);
+
+/**************** postings_bytes ****************/
+/* Return the number of bytes postings_write will write; 0 if NULL. */
+size_t postings_bytes(const postings_t* postings);
+
+/**************** postings_memory ****************/
+/* Return the bytes of memory the list occupies, allocated
+ * but unused space included; 0 if NULL. */
+size_t postings_memory(const postings_t* postings);
+
+/**************** postings_write ****************/
+/* Write the encoded pairs to fp, in the format read by cursor_new.
+ *
+ * We return:
+ *   true if all postings_bytes(postings) bytes were written.
+ */
+bool postings_write(const postings_t* postings, FILE* fp);
+
+/**************** postings_delete ****************/
+/* Free the postings list and its buffer (to its arena, if it has one). */
+void postings_delete(postings_t* postings);
+
+/**************** postings_open ****************/
+/* Return a cursor positioned before the first pair of postings.
+ *
+ * Caller is responsible for:
+ *   later calling cursor_delete; not modifying postings while the cursor is in use.
+ */
+cursor_t* postings_open(const postings_t* postings);
+
+/**************** cursor_new ****************/
+/* Return a cursor over size pairs encoded in bytes[0..len-1],
+ * as written by postings_write (e.g. inside a mapped index file),
+ * whose largest count is maxCount (see postings_max).
+ *
+ * Caller is responsible for:
+ *   keeping bytes valid while the cursor is in use, later calling cursor_delete.
+ */
+cursor_t* cursor_new(const uint8_t* bytes, const size_t len, const int size, const int maxCount);
+
+/**************** postings_valid ****************/
+/* Return true if bytes[0..len-1] holds exactly size encoded pairs:
+ * its packed blocks have bit widths of at most 32 and, with the
+ * varint pairs after them, end exactly at len.
+ *
+ * A cursor never reads outside bytes[0..len-1] in any case; this lets
+ * a mapped index refuse a corrupt list rather than give its garbage.
+ */
+bool postings_valid(const uint8_t* bytes, const size_t len, const int size);
+
+/**************** cursor_next ****************/
+/* Advance to the next pair.
+ *
+ * We return:
+ *   true if the cursor is now on a pair; false at the end of the list.
+ */
+bool cursor_next(cursor_t* cursor);
+
+/**************** cursor_seek ****************/
+/* Advance to the first pair whose docID is >= docID; the cursor never
+ * moves backward, so a cursor already past docID stays where it is.
+ * Packed blocks ending before docID are skipped by their header without
+ * being decoded, and a decoded block is searched by galloping, so a seek
+ * costs about the log of the distance moved rather than the distance.
+ *
+ * We return:
+ *   true if the cursor is now on a pair; false at the end of the list.
+ */
+bool cursor_seek(cursor_t* cursor, const int docID);
+
+/**************** cursor_docID, cursor_count ****************/
+/* Return the docID, or count, of the current pair;
+ * 0 before the first cursor_next and after the end.
+ */
+int cursor_docID(const cursor_t* cursor);
+int cursor_count(const cursor_t* cursor);
+
+/**************** cursor_size ****************/
+/* Return the total number of pairs the cursor walks over. */
+int cursor_size(const cursor_t* cursor);
+
+/**************** cursor_max ****************/
+/* Return the largest count of any pair the cursor walks over,
+ * an upper bound on cursor_count used to prune queries.
+ */
+int cursor_max(const cursor_t* cursor);
+
+/**************** cursor_delete ****************/
+/* Free the cursor (not the postings it reads). */
+void cursor_delete(cursor_t* cursor);
+
+#endif // __POSTINGS_H
@@ -0,0 +1,411 @@
+/* query.c - CS50 'query' module
+ *
+ * Document-at-a-time query evaluation over posting cursors.
+ * See query.h for documentation.
+ *
+ * Kyrylo Bakumenko, 12 May 2023
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "query.h"
+#include "index.h"
+#include "mem.h"
+
+/**************** file-local types ****************/
+
+// the words of one and-sequence, and the document it is on
+typedef struct sequence {
+    cursor_t** cursors;     // one per word
+    int numCursors;
+    int docID;              // current matching document; 0 when done
+    int score;              // minimum count of the words in docID
+    int bound;              // no document scores more: the least
+                            // of the words' largest counts
+} sequence_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+int query_evaluate(index_t* index, char** words, int numWords, hit_t** hits);
+int query_top(hit_t* hits, int numHits, int k);
+int query_prune(index_t* index, char** words, int numWords, int k, int maxDoc, hit_t** hits);
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static int sequences_open(index_t* index, char** words, int numWords, sequence_t* sequences);
+static void sequences_close(sequence_t* sequences, int numSequences);
+static bool sequence_next(sequence_t* sequence);
+static bool sequence_seek(sequence_t* sequence, int docID);
+static void sequences_sort(sequence_t** live, int numLive);
+static int cursor_size_cmp(const void* a, const void* b);
+static bool hit_better(const hit_t* a, const hit_t* b);
+static void heap_build(hit_t* heap, int size);
+static void heap_sift(hit_t* heap, int size, int i);
+
+/**************** query_evaluate() ****************/
+/* see query.h for description */
+int
+query_evaluate(index_t* index, char** words, int numWords, hit_t** hits)
+{
+    *hits = NULL;
+    if (index == NULL || words == NULL || numWords <= 0) {
+        return 0;
+    }
+
+    // there are no more and-sequences than words
+    sequence_t* sequences = mem_malloc_assert(numWords * sizeof(sequence_t), "sequences");
+    int numSequences = sequences_open(index, words, numWords, sequences);
+
+    // position every and-sequence on its first matching document
+    for (int s = 0; s < numSequences; s++) {
+        sequence_next(&sequences[s]);
+    }
+
+    // merge the and-sequences in docID order, summing their scores
+    int numHits = 0;
+    int capacity = 0;
+    while (true) {
+        int docID = 0;
+        for (int s = 0; s < numSequences; s++) {
+            if (sequences[s].docID > 0 && (docID == 0 || sequences[s].docID < docID)) {
+                docID = sequences[s].docID;
+            }
+        }
+        if (docID == 0) {
+            break;      // every and-sequence is exhausted
+        }
+        int score = 0;
+        for (int s = 0; s < numSequences; s++) {
+            if (sequences[s].docID == docID) {
+                score += sequences[s].score;
+                sequence_next(&sequences[s]);
+            }
+        }
+
+        if (numHits == capacity) {
+            capacity = capacity == 0 ? 16 : 2 * capacity;
+            hit_t* grown = mem_malloc_assert(capacity * sizeof(hit_t), "hits");
+            if (*hits != NULL) {
+                memcpy(grown, *hits, numHits * sizeof(hit_t));
+                mem_free(*hits);
+            }
+            *hits = grown;
+        }
+        (*hits)[numHits].docID = docID;
+        (*hits)[numHits].score = score;
+        numHits++;
+    }
+
+    sequences_close(sequences, numSequences);
+    mem_free(sequences);
+    return numHits;
+}
+
+/**************** query_top() ****************/
+/* see query.h for description */
+int
+query_top(hit_t* hits, int numHits, int k)
+{
+    if (hits == NULL || numHits <= 0) {
+        return 0;
+    }
+    if (k <= 0 || k > numHits) {
+        k = numHits;
+    }
+
+    // hits[0..k-1] is a min-heap: the worst of the best k is on top
+    heap_build(hits, k);
+    for (int i = k; i < numHits; i++) {
+        if (hit_better(&hits[i], &hits[0])) {
+            hit_t swap = hits[0];
+            hits[0] = hits[i];
+            hits[i] = swap;
+            heap_sift(hits, k, 0);
+        }
+    }
+
+    // repeatedly move the worst to the end of the heap,
+    // leaving hits[0..k-1] best first
+    for (int size = k - 1; size > 0; size--) {
+        hit_t swap = hits[0];
+        hits[0] = hits[size];
+        hits[size] = swap;
+        heap_sift(hits, size, 0);
+    }
+    return k;
+}
+
+/**************** query_prune() ****************/
+/* see query.h for description */
+int
+query_prune(index_t* index, char** words, int numWords, int k, int maxDoc, hit_t** hits)
+{
+    *hits = NULL;
+    if (index == NULL || words == NULL || numWords <= 0 || k <= 0) {
+        return 0;
+    }
+
+    sequence_t* sequences = mem_malloc_assert(numWords * sizeof(sequence_t), "sequences");
+    int numSequences = sequences_open(index, words, numWords, sequences);
+    sequence_t** live = mem_malloc_assert((numSequences + 1) * sizeof(sequence_t*), "live");
+    int numLive = 0;
+    for (int s = 0; s < numSequences; s++) {
+        if (sequence_next(&sequences[s])) {
+            live[numLive++] = &sequences[s];
+        }
+    }
+
+    // the best k so far; once there are k, a min-heap
+    hit_t* top = mem_malloc_assert(k * sizeof(hit_t), "top");
+    int numTop = 0;
+    // a document needs at least this score to enter the top k: with
+    // the heap full, a later (higher) docID wins ties with its worst
+    int threshold = 1;
+
+    while (numLive > 0) {
+        sequences_sort(live, numLive);
+
+        // the pivot is the first document whose preceding
+        // sequences' bounds could add up to the threshold
+        int pivot = 0;
+        int bound = 0;
+        for (; pivot < numLive; pivot++) {
+            bound += live[pivot]->bound;
+            if (bound >= threshold) {
+                break;
+            }
+        }
+        if (pivot == numLive) {
+            break;      // no remaining document can enter the top k
+        }
+        int docID = live[pivot]->docID;
+        if (maxDoc > 0 && docID > maxDoc) {
+            break;      // every remaining candidate is past maxDoc
+        }
+
+        if (live[0]->docID == docID) {
+            // every sequence up to the pivot is on docID: score it
+            hit_t hit = { docID, 0 };
+            for (int s = 0; s < numLive && live[s]->docID == docID; s++) {
+                hit.score += live[s]->score;
+                sequence_next(live[s]);
+            }
+            if (numTop < k) {
+                top[numTop++] = hit;
+                if (numTop == k) {
+                    heap_build(top, numTop);
+                    threshold = top[0].score;
+                }
+            } else if (hit_better(&hit, &top[0])) {
+                top[0] = hit;
+                heap_sift(top, numTop, 0);
+                threshold = top[0].score;
+            }
+        } else {
+            // documents before the pivot cannot reach the threshold
+            for (int s = 0; s < pivot; s++) {
+                sequence_seek(live[s], docID);
+            }
+        }
+
+        // drop exhausted sequences
+        int alive = 0;
+        for (int s = 0; s < numLive; s++) {
+            if (live[s]->docID > 0) {
+                live[alive++] = live[s];
+            }
+        }
+        numLive = alive;
+    }
+
+    sequences_close(sequences, numSequences);
+    mem_free(sequences);
+    mem_free(live);
+    if (numTop == 0) {
+        mem_free(top);
+        return 0;
+    }
+    *hits = top;
+    return query_top(top, numTop, k);
+}
+
+/**************** sequences_open() ****************/
+/* splits words into and-sequences at each "or", opening a  */
+/* cursor per word; a sequence with a word missing from the */
+/* index can never match, so it is dropped                  */
+/* returns the number of sequences                          */
+static int
+sequences_open(index_t* index, char** words, int numWords, sequence_t* sequences)
+{
+    int numSequences = 0;
+    int i = 0;
+    while (i < numWords) {
+        sequence_t* sequence = &sequences[numSequences];
+        sequence->cursors = mem_malloc_assert(numWords * sizeof(cursor_t*), "cursors");
+        sequence->numCursors = 0;
+        sequence->docID = 0;
+        sequence->score = 0;
+        sequence->bound = 0;
+        bool missing = false;
+
+        for (; i < numWords && strcmp(words[i], "or") != 0; i++) {
+            if (strcmp(words[i], "and") == 0 || missing) {
+                continue;
+            }
+            cursor_t* cursor = index_open(index, words[i]);
+            if (cursor == NULL) {
+                missing = true;
+            } else {
+                sequence->cursors[sequence->numCursors++] = cursor;
+                if (sequence->numCursors == 1 || cursor_max(cursor) < sequence->bound) {
+                    sequence->bound = cursor_max(cursor);
+                }
+            }
+        }
+        i++;    // skip the "or"
+
+        if (missing || sequence->numCursors == 0) {
+            sequences_close(sequence, 1);
+        } else {
+            // rarest word first: it proposes the candidate documents
+            qsort(sequence->cursors, sequence->numCursors, sizeof(cursor_t*), cursor_size_cmp);
+            numSequences++;
+        }
+    }
+    return numSequences;
+}
+
+/**************** sequences_close() ****************/
+/* deletes the cursors of each sequence */
+static void
+sequences_close(sequence_t* sequences, int numSequences)
+{
+    for (int s = 0; s < numSequences; s++) {
+        for (int c = 0; c < sequences[s].numCursors; c++) {
+            cursor_delete(sequences[s].cursors[c]);
+        }
+        mem_free(sequences[s].cursors);
+    }
+}
+
+/**************** sequence_next() ****************/
+/* advances the sequence to its next matching document    */
+/* returns false (and sets docID 0) when none remain      */
+static bool
+sequence_next(sequence_t* sequence)
+{
+    return sequence_seek(sequence, sequence->docID + 1);
+}
+
+/**************** sequence_seek() ****************/
+/* advances the sequence to the first document >= docID   */
+/* containing every word: each cursor in turn seeks to    */
+/* the largest docID seen so far, until all of them       */
+/* agree; with the rarest word first, the common words    */
+/* are only probed at its documents, and cursor_seek      */
+/* skips the rest                                         */
+/* returns false (and sets docID 0) when none remain      */
+static bool
+sequence_seek(sequence_t* sequence, int docID)
+{
+    cursor_t** cursors = sequence->cursors;
+    int n = sequence->numCursors;
+
+    if (sequence->docID >= docID) {
+        return true;
+    }
+    if (!cursor_seek(cursors[0], docID)) {
+        sequence->docID = 0;
+        return false;
+    }
+    int target = cursor_docID(cursors[0]);
+    int agreed = 1;         // cursors known to be on target
+    for (int c = 1 % n; agreed < n; c = (c + 1) % n) {
+        if (!cursor_seek(cursors[c], target)) {
+            sequence->docID = 0;
+            return false;
+        }
+        if (cursor_docID(cursors[c]) == target) {
+            agreed++;
+        } else {
+            target = cursor_docID(cursors[c]);
+            agreed = 1;
+        }
+    }
+
+    sequence->docID = target;
+    sequence->score = cursor_count(cursors[0]);
+    for (int c = 1; c < n; c++) {
+        if (cursor_count(cursors[c]) < sequence->score) {
+            sequence->score = cursor_count(cursors[c]);
+        }
+    }
+    return true;
+}
+
+/**************** sequences_sort() ****************/
+/* insertion sort of the live sequences by docID; they   */
+/* are few, and mostly still in order from the last call */
+static void
+sequences_sort(sequence_t** live, int numLive)
+{
+    for (int i = 1; i < numLive; i++) {
+        sequence_t* sequence = live[i];
+        int j = i;
+        for (; j > 0 && live[j-1]->docID > sequence->docID; j--) {
+            live[j] = live[j-1];
+        }
+        live[j] = sequence;
+    }
+}
+
+/**************** cursor_size_cmp() ****************/
+/* orders cursors by increasing number of postings */
+static int
+cursor_size_cmp(const void* a, const void* b)
+{
+    return cursor_size(*(cursor_t* const*)a) - cursor_size(*(cursor_t* const*)b);
+}
+
+/**************** hit_better() ****************/
+/* ranks by score, then by docID, both descending */
+static bool
+hit_better(const hit_t* a, const hit_t* b)
+{
+    return a->score > b->score || (a->score == b->score && a->docID > b->docID);
+}
+
+/**************** heap_build() ****************/
+/* arranges heap[0..size-1] as a min-heap, worst hit on top */
+static void
+heap_build(hit_t* heap, int size)
+{
+    for (int i = size / 2 - 1; i >= 0; i--) {
+        heap_sift(heap, size, i);
+    }
+}
+
+/**************** heap_sift() ****************/
+/* moves heap[i] down until neither child is worse */
+static void
+heap_sift(hit_t* heap, int size, int i)
+{
+    while (true) {
+        int worst = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < size && hit_better(&heap[worst], &heap[left])) {
+            worst = left;
+        }
+        if (right < size && hit_better(&heap[worst], &heap[right])) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+        hit_t swap = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = swap;
+        i = worst;
+    }
+}
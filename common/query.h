@@ -0,0 +1,82 @@
+/*
+ * query.h    Kyrylo Bakumenko    12 May, 2023
+ *
+ * Document-at-a-time evaluation of a query over an index. A query is a
+ * sequence of words where "and" binds tighter than "or":
+ *     and-sequence: words joined by "and" (or by nothing); its score in
+ *                   a document is the minimum count of its words there
+ *     query:        and-sequences joined by "or"; the score of a document
+ *                   is the sum of its and-sequence scores
+ *
+ * Each word's postings are opened once; and-sequences intersect their
+ * cursors and the query merges the and-sequences in docID order, so only
+ * documents containing query words are ever visited. An and-sequence is
+ * driven by its rarest word, and the other cursors seek (skipping and
+ * galloping, see postings.h) straight to its documents, so documents
+ * failing a conjunct are mostly never decoded.
+ */
+
+#ifndef __QUERY_H
+#define __QUERY_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "index.h"
+
+/**************** global types ****************/
+typedef struct hit {
+    int docID;          // a document matching the query
+    int score;          // its score, > 0
+} hit_t;
+
+/**************** functions ****************/
+
+/**************** query_evaluate ****************/
+/* Score every document matching the query.
+ *
+ * Caller provides:
+ *   valid index pointer, array of numWords lower-case words forming a
+ *   valid query (no "and"/"or" first, last or adjacent), and a pointer
+ *   to receive the hits.
+ * We return:
+ *   the number of matching documents; *hits is set to a new array of
+ *   that many hits sorted by docID (NULL if there are none).
+ * Caller is responsible for:
+ *   later calling mem_free on *hits.
+ */
+int query_evaluate(index_t* index, char** words, int numWords, hit_t** hits);
+
+/**************** query_top ****************/
+/* Select the k best hits: highest score first, and among equal scores
+ * the highest docID first. A min-heap of the k best seen so far is kept
+ * in hits[0..k-1], so this takes O(numHits log k) time and no extra memory.
+ *
+ * Caller provides:
+ *   array of numHits hits, and k; k <= 0 means all of them.
+ * We return:
+ *   the number of hits selected, min(k, numHits); they are moved to the
+ *   front of hits in rank order, and the rest of hits is left unordered.
+ */
+int query_top(hit_t* hits, int numHits, int k);
+
+/**************** query_prune ****************/
+/* Find the k best hits of the query, as query_evaluate then query_top
+ * would, but with dynamic pruning (WAND): each and-sequence's score is
+ * bounded by the least of its words' largest counts (cursor_max, stored
+ * in the index), and documents whose and-sequences' bounds cannot add up
+ * to the score of the k-th best hit so far are skipped without being
+ * scored. Long "or" queries over common words visit far fewer documents.
+ *
+ * Caller provides:
+ *   as for query_evaluate, and k > 0; maxDoc, the last docID that may be
+ *   a hit (documents after it are never scored, so they cannot crowd
+ *   out the k best before it), or 0 for every document.
+ * We return:
+ *   the number of hits, at most k; *hits is set to a new array of them
+ *   in rank order (NULL if there are none).
+ * Caller is responsible for:
+ *   later calling mem_free on *hits.
+ */
+int query_prune(index_t* index, char** words, int numWords, int k, int maxDoc, hit_t** hits);
+
+#endif // __QUERY_H
@@ -0,0 +1,242 @@
+/* querybench.c    Kyrylo Bakumenko    14 May, 2023
+ *
+ * Benchmark for query evaluation on skewed queries. Builds an in-memory
+ * index of synthetic documents in which "common" appears in nearly every
+ * document and "rare" in very few, then
+ *   - times and-sequences with query_evaluate and with a linear merge that
+ *     steps every cursor one pair at a time
+ *   - times top-k "or" queries with query_evaluate + query_top (exhaustive)
+ *     and with query_prune (WAND)
+ * checking in each case that both find the same documents and scores.
+ *
+ * usage: ./querybench [numDocs [repeats]]
+ *
+ * Exit codes: 1 -> invalid arguments
+ *             2 -> query_evaluate disagrees with the linear merge,
+ *                  or query_prune with query_evaluate
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "index.h"
+#include "query.h"
+#include "mem.h"
+
+// words and the fraction of documents (in 1/100000) each appears in
+static const struct {
+    char* word;
+    int per100k;
+} WORDS[] = {
+    { "common", 95000 },
+    { "medium", 10000 },
+    { "uncommon", 1000 },
+    { "rare", 10 },
+    { NULL, 0 },
+};
+
+// and-sequences to time, as words of a query
+static char* QUERIES[][4] = {
+    { "rare", "common", NULL },
+    { "common", "rare", NULL },
+    { "uncommon", "common", NULL },
+    { "medium", "common", NULL },
+    { "rare", "medium", "common", NULL },
+};
+static const int NUM_QUERIES = sizeof(QUERIES) / sizeof(QUERIES[0]);
+
+// top-k queries to time
+static char* OR_QUERIES[] = {
+    "common or medium",
+    "medium or uncommon or rare",
+    "common or medium or uncommon or rare",
+    "rare and common or medium and common",
+    NULL
+};
+static const int TOP_K = 10;
+
+static double now(void);
+static int linear_and(index_t* index, char** words, int numWords, hit_t* hits);
+
+/* ***************************
+ *  main function
+ *  Accepts 0-2 arguments: numDocs, repeats
+ */
+int main(int argc, char* argv[])
+{
+    int numDocs = 1000000;
+    int repeats = 20;
+    if (argc > 3 || (argc > 1 && (numDocs = atoi(argv[1])) <= 0)
+        || (argc > 2 && (repeats = atoi(argv[2])) <= 0)) {
+        fprintf(stderr, "usage: %s [numDocs [repeats]]\n", argv[0]);
+        exit(1);
+    }
+
+    // documents in increasing docID order, as the indexer adds them
+    srand(1);
+    index_t* index = index_new(16);
+    for (int docID = 1; docID <= numDocs; docID++) {
+        for (int w = 0; WORDS[w].word != NULL; w++) {
+            if (rand() % 100000 < WORDS[w].per100k) {
+                for (int n = 1 + rand() % 3; n > 0; n--) {
+                    index_add(index, WORDS[w].word, docID);
+                }
+            }
+        }
+    }
+    for (int w = 0; WORDS[w].word != NULL; w++) {
+        cursor_t* cursor = index_open(index, WORDS[w].word);
+        printf("%-9s in %8d docs\n", WORDS[w].word, cursor_size(cursor));
+        cursor_delete(cursor);
+    }
+
+    hit_t* expect = mem_malloc_assert(numDocs * sizeof(hit_t), "expect");
+    for (int q = 0; q < NUM_QUERIES; q++) {
+        // the query "a and b ...", and its words alone
+        char* words[8];
+        char* terms[4];
+        int numWords = 0;
+        int numTerms = 0;
+        char label[64] = "";
+        for (int t = 0; QUERIES[q][t] != NULL; t++) {
+            if (numTerms > 0) {
+                words[numWords++] = "and";
+                strcat(label, " and ");
+            }
+            words[numWords++] = terms[numTerms++] = QUERIES[q][t];
+            strcat(label, QUERIES[q][t]);
+        }
+
+        int numExpect = 0;
+        double start = now();
+        for (int r = 0; r < repeats; r++) {
+            numExpect = linear_and(index, terms, numTerms, expect);
+        }
+        double linearSecs = (now() - start) / repeats;
+
+        hit_t* hits = NULL;
+        int numHits = 0;
+        start = now();
+        for (int r = 0; r < repeats; r++) {
+            if (hits != NULL) {
+                mem_free(hits);
+            }
+            numHits = query_evaluate(index, words, numWords, &hits);
+        }
+        double seekSecs = (now() - start) / repeats;
+
+        if (numHits != numExpect
+            || (numHits > 0 && memcmp(hits, expect, numHits * sizeof(hit_t)) != 0)) {
+            fprintf(stderr, "ERROR: '%s' found %d docs, expected %d\n", label, numHits, numExpect);
+            exit(2);
+        }
+        printf("%-30s %7d hits   linear %9.1f us   query_evaluate %9.1f us   %6.1fx\n",
+               label, numHits, linearSecs * 1e6, seekSecs * 1e6, linearSecs / seekSecs);
+        if (hits != NULL) {
+            mem_free(hits);
+        }
+    }
+
+    for (int q = 0; OR_QUERIES[q] != NULL; q++) {
+        char line[128];
+        char* words[16];
+        int numWords = 0;
+        strcpy(line, OR_QUERIES[q]);
+        for (char* word = strtok(line, " "); word != NULL; word = strtok(NULL, " ")) {
+            words[numWords++] = word;
+        }
+
+        hit_t* all = NULL;
+        int numAll = 0;
+        double start = now();
+        for (int r = 0; r < repeats; r++) {
+            if (all != NULL) {
+                mem_free(all);
+            }
+            numAll = query_top(all, query_evaluate(index, words, numWords, &all), TOP_K);
+        }
+        double fullSecs = (now() - start) / repeats;
+
+        hit_t* top = NULL;
+        int numTop = 0;
+        start = now();
+        for (int r = 0; r < repeats; r++) {
+            if (top != NULL) {
+                mem_free(top);
+            }
+            numTop = query_prune(index, words, numWords, TOP_K, 0, &top);
+        }
+        double pruneSecs = (now() - start) / repeats;
+
+        if (numTop != numAll
+            || (numTop > 0 && memcmp(top, all, numTop * sizeof(hit_t)) != 0)) {
+            fprintf(stderr, "ERROR: '%s' top %d differs when pruned\n", OR_QUERIES[q], TOP_K);
+            exit(2);
+        }
+        printf("top %-2d %-36s exhaustive %9.1f us   query_prune %9.1f us   %6.1fx\n",
+               TOP_K, OR_QUERIES[q], fullSecs * 1e6, pruneSecs * 1e6, fullSecs / pruneSecs);
+        if (all != NULL) {
+            mem_free(all);
+        }
+        if (top != NULL) {
+            mem_free(top);
+        }
+    }
+
+    mem_free(expect);
+    index_delete(index);
+    mem_free(index);
+    return 0;
+}
+
+/**************** now() ****************/
+/* wall-clock seconds */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** linear_and() ****************/
+/* intersects the words' postings in the order given, stepping */
+/* each cursor with cursor_next; fills hits, returns how many  */
+static int
+linear_and(index_t* index, char** words, int numWords, hit_t* hits)
+{
+    cursor_t* cursors[4];
+    for (int w = 0; w < numWords; w++) {
+        cursors[w] = index_open(index, words[w]);
+    }
+    int numHits = 0;
+    bool more = true;
+    while (more && cursor_next(cursors[0])) {
+        int docID = cursor_docID(cursors[0]);
+        int score = cursor_count(cursors[0]);
+        bool all = true;
+        for (int w = 1; w < numWords && all; w++) {
+            while (cursor_docID(cursors[w]) < docID && (more = cursor_next(cursors[w]))) {
+            }
+            if (!more) {
+                all = false;    // a word has no more documents
+            } else if (cursor_docID(cursors[w]) != docID) {
+                all = false;
+            } else if (cursor_count(cursors[w]) < score) {
+                score = cursor_count(cursors[w]);
+            }
+        }
+        if (all) {
+            hits[numHits].docID = docID;
+            hits[numHits].score = score;
+            numHits++;
+        }
+    }
+    for (int w = 0; w < numWords; w++) {
+        cursor_delete(cursors[w]);
+    }
+    return numHits;
+}
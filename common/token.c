@@ -0,0 +1,490 @@
+/* token.c - CS50 'token' module
+ *
+ * Zero-copy tokenizer for page HTML, with scalar, SSE2 and AVX2 byte
+ * scanners. See token.h for documentation.
+ *
+ * Words and links are found by two scans: to the next letter or '<' and
+ * then to the end of that word (text between words, then a word), and
+ * to the next given byte (skipping a tag to its '>', or finding '<', '='
+ * and quotes in links). The SIMD kernels classify a whole vector of bytes
+ * at once and find the first match from its movemask.
+ *
+ * The vector kernels read from aligned addresses only, and an aligned
+ * load never crosses a page boundary, so reading the whole vector that
+ * holds the NUL, past the end of the string, cannot fault. They are
+ * left out of AddressSanitizer's checks for that reason.
+ *
+ * Kyrylo Bakumenko, 17 May 2023
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "token.h"
+#include "mem.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TOKEN_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define TOKEN_ASAN
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(TOKEN_ASAN)
+#define NO_ASAN __attribute__((no_sanitize_address))
+#else
+#define NO_ASAN
+#endif
+
+/**************** file-local types ****************/
+typedef struct kernel {
+    const char* name;
+    const char* (*word)(const char* p, const char** end);  // see scalar_word
+    const char* (*find)(const char* p, const char c);       // to c or NUL
+} kernel_t;
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static inline bool is_letter(const char c);
+static inline bool is_space(const char c);
+static const char* scalar_word(const char* p, const char** end);
+static const char* scalar_find(const char* p, const char c);
+static const kernel_t* kernel_best(void);
+static bool kernel_supported(const kernel_t* kernel);
+
+#ifdef TOKEN_X86
+static const char* sse2_word(const char* p, const char** end);
+static const char* sse2_find(const char* p, const char c);
+static const char* avx2_word(const char* p, const char** end);
+static const char* avx2_find(const char* p, const char c);
+#endif
+
+/**************** file-local global variables ****************/
+static const kernel_t kernels[] = {
+    { "scalar", scalar_word, scalar_find },
+#ifdef TOKEN_X86
+    { "sse2", sse2_word, sse2_find },
+    { "avx2", avx2_word, avx2_find },
+#endif
+};
+static const int NUM_KERNELS = sizeof(kernels) / sizeof(kernels[0]);
+
+// chosen on first use; see token_select
+static const kernel_t* kernel = NULL;
+
+/**************** token_next() ****************/
+bool
+token_next(const char* html, size_t* pos, token_t* token)
+{
+    if (html == NULL || pos == NULL || token == NULL) {
+        return false;
+    }
+    if (kernel == NULL) {
+        kernel = kernel_best();
+    }
+
+    // skip anything but letters, and whole tags
+    const char* end;
+    const char* p = kernel->word(&html[*pos], &end);
+    while (*p == '<') {
+        const char* close = kernel->find(p, '>');
+        if (*close == '\0' || close[1] == '\0') {
+            // ran out of html
+            *pos = (*close == '\0' ? close : close + 1) - html;
+            return false;
+        }
+        p = kernel->word(close + 1, &end);
+    }
+    if (*p == '\0') {
+        *pos = p - html;
+        return false;
+    }
+
+    token->word = p;
+    token->len = end - p;
+    *pos = end - html;
+    return true;
+}
+
+/**************** token_nextLink() ****************/
+bool
+token_nextLink(const char* html, size_t* pos, link_t* link)
+{
+    if (html == NULL || pos == NULL || link == NULL) {
+        return false;
+    }
+    if (kernel == NULL) {
+        kernel = kernel_best();
+    }
+
+    const char* p = &html[*pos];
+    while (true) {
+        // the next "<a" or "<A"
+        const char* lnk = kernel->find(p, '<');
+        while (*lnk != '\0' && (lnk[1] | 0x20) != 'a') {
+            lnk = kernel->find(lnk + 1, '<');
+        }
+        if (*lnk == '\0') {
+            return false;
+        }
+
+        // the next "href=", in any case, from there
+        const char* href = kernel->find(lnk, '=');
+        while (*href != '\0' && (href - lnk < 4 || strncasecmp(href - 4, "href", 4) != 0)) {
+            href = kernel->find(href + 1, '=');
+        }
+        if (*href == '\0') {
+            return false;
+        }
+        href -= 4;
+
+        // an href past the end of this tag belongs to a later one;
+        // like webpage_getNextURL, look again two bytes further on
+        const char* end = kernel->find(lnk, '>');
+        if (*end != '\0' && end < href) {
+            p = lnk + 2;
+            continue;
+        }
+
+        // the url: quoted, or up to the '>'
+        const char* url = href + 5;
+        if (*url == '\'' || *url == '"') {
+            end = kernel->find(url + 1, *url);
+            url++;
+        } else {
+            end = kernel->find(url, '>');
+        }
+        if (*end == '\0') {
+            p = lnk + 2;
+            continue;
+        }
+        const char* hash = memchr(url, '#', end - url);
+        if (hash != NULL) {
+            end = hash;
+        }
+        if (*url == '#') {
+            // a reference within the page
+            p = lnk + 2;
+            continue;
+        }
+
+        // absolute if a ':' comes before any '/', '?' or '#'
+        const char* mark = strpbrk(url, ":/?#");
+        bool relative = mark == NULL || *mark != ':';
+        if (!relative && strncasecmp(url, "http", 4) != 0) {
+            p = lnk + 2;
+            continue;
+        }
+
+        link->tag = lnk - html;
+        link->url.word = url;
+        link->url.len = end - url;
+        link->relative = relative;
+        *pos = end - html;
+        return true;
+    }
+}
+
+/**************** token_squeeze() ****************/
+void
+token_squeeze(char* html)
+{
+    if (html == NULL) {
+        return;
+    }
+    char* out = html;
+    for (const char* in = html; *in != '\0'; in++) {
+        if (!is_space(*in)) {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+/**************** token_lower() ****************/
+char*
+token_lower(const token_t* token, scratch_t* scratch)
+{
+    if (token == NULL || scratch == NULL) {
+        return NULL;
+    }
+    if (token->len + 1 > scratch->cap) {
+        size_t cap = scratch->cap == 0 ? 64 : scratch->cap;
+        while (cap < token->len + 1) {
+            cap *= 2;
+        }
+        char* buf = mem_malloc(cap);
+        if (buf == NULL) {
+            return NULL;
+        }
+        if (scratch->buf != NULL) {
+            mem_free(scratch->buf);
+        }
+        scratch->buf = buf;
+        scratch->cap = cap;
+    }
+    // letters only: setting bit 5 lowercases
+    for (size_t i = 0; i < token->len; i++) {
+        scratch->buf[i] = token->word[i] | 0x20;
+    }
+    scratch->buf[token->len] = '\0';
+    return scratch->buf;
+}
+
+/**************** token_free() ****************/
+void
+token_free(scratch_t* scratch)
+{
+    if (scratch != NULL && scratch->buf != NULL) {
+        mem_free(scratch->buf);
+        scratch->buf = NULL;
+        scratch->cap = 0;
+    }
+}
+
+/**************** token_select() ****************/
+bool
+token_select(const char* name)
+{
+    if (name == NULL) {
+        return false;
+    }
+    if (strcmp(name, "auto") == 0) {
+        kernel = kernel_best();
+        return true;
+    }
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        if (strcmp(name, kernels[k].name) == 0 && kernel_supported(&kernels[k])) {
+            kernel = &kernels[k];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************** token_kernel() ****************/
+const char*
+token_kernel(void)
+{
+    if (kernel == NULL) {
+        kernel = kernel_best();
+    }
+    return kernel->name;
+}
+
+/**************** kernel_supported() ****************/
+/* asks the CPU (cpuid) whether it has the kernel's instructions */
+static bool
+kernel_supported(const kernel_t* k)
+{
+#ifdef TOKEN_X86
+    __builtin_cpu_init();
+    if (k->word == avx2_word) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (k->word == sse2_word) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return true;
+}
+
+/**************** kernel_best() ****************/
+/* the last (widest) supported kernel */
+static const kernel_t*
+kernel_best(void)
+{
+    const kernel_t* best = &kernels[0];
+    for (int k = 1; k < NUM_KERNELS; k++) {
+        if (kernel_supported(&kernels[k])) {
+            best = &kernels[k];
+        }
+    }
+    return best;
+}
+
+/**************** is_letter() ****************/
+/* isalpha in the C locale, without the table lookup */
+static inline bool
+is_letter(const char c)
+{
+    return (unsigned)(((unsigned char)c | 0x20) - 'a') < 26;
+}
+
+/**************** is_space() ****************/
+/* isspace in the C locale, as removed by webpage_getNextURL */
+static inline bool
+is_space(const char c)
+{
+    return c == ' ' || (unsigned)(c - '\t') < 5;
+}
+
+/**************** scalar kernels ****************/
+/* word: returns the first letter, '<' or NUL at or after p; */
+/* if a letter, *end is set to the first non-letter after it */
+static const char*
+scalar_word(const char* p, const char** end)
+{
+    while (*p != '\0' && *p != '<' && !is_letter(*p)) {
+        p++;
+    }
+    const char* q = p;
+    while (is_letter(*q)) {
+        q++;
+    }
+    *end = q;
+    return p;
+}
+
+static const char*
+scalar_find(const char* p, const char c)
+{
+    while (*p != '\0' && *p != c) {
+        p++;
+    }
+    return p;
+}
+
+#ifdef TOKEN_X86
+/**************** SSE2 kernels ****************/
+/* Each scans the aligned 16-byte block holding p, ignoring the bytes
+ * before p, then the blocks after it, until a byte matches.
+ * A letter is a byte that, ORed with 0x20 and shifted so that 'a' is
+ * -128, is below -128 + 26 (SSE2 has only signed byte compares).
+ */
+__attribute__((target("sse2")))
+static inline __m128i
+sse2_letters(const __m128i bytes)
+{
+    __m128i shifted = _mm_add_epi8(_mm_or_si128(bytes, _mm_set1_epi8(0x20)),
+                                   _mm_set1_epi8((char)(128 - 'a')));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(-128 + 26));
+}
+
+__attribute__((target("sse2"))) NO_ASAN
+static const char*
+sse2_word(const char* p, const char** end)
+{
+    const __m128i* block = (const __m128i*)((uintptr_t)p & ~(uintptr_t)15);
+    unsigned above = 0xffffu << (p - (const char*)block);
+    __m128i bytes;
+    unsigned letters;
+    unsigned mask;
+    while (true) {
+        bytes = _mm_load_si128(block);
+        letters = (unsigned)_mm_movemask_epi8(sse2_letters(bytes));
+        unsigned stops = (unsigned)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('<')),
+                         _mm_cmpeq_epi8(bytes, _mm_setzero_si128())));
+        mask = (letters | stops) & above;
+        if (mask != 0) {
+            break;
+        }
+        block++;
+        above = 0xffffu;
+    }
+    int first = __builtin_ctz(mask);
+    p = (const char*)block + first;
+
+    // the word's end, usually in the same block
+    mask = ~letters & (0xffffu << first) & 0xffffu;
+    while (mask == 0) {
+        block++;
+        bytes = _mm_load_si128(block);
+        mask = ~(unsigned)_mm_movemask_epi8(sse2_letters(bytes)) & 0xffffu;
+    }
+    *end = (const char*)block + __builtin_ctz(mask);
+    return p;
+}
+
+__attribute__((target("sse2"))) NO_ASAN
+static const char*
+sse2_find(const char* p, const char c)
+{
+    const __m128i* block = (const __m128i*)((uintptr_t)p & ~(uintptr_t)15);
+    unsigned mask = 0xffffu << (p - (const char*)block);
+    const __m128i want = _mm_set1_epi8(c);
+    while (true) {
+        __m128i bytes = _mm_load_si128(block);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(bytes, want),
+                                   _mm_cmpeq_epi8(bytes, _mm_setzero_si128()));
+        mask &= (unsigned)_mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return (const char*)block + __builtin_ctz(mask);
+        }
+        block++;
+        mask = 0xffffu;
+    }
+}
+
+/**************** AVX2 kernels ****************/
+/* as the SSE2 kernels, 32 bytes at a time */
+__attribute__((target("avx2")))
+static inline __m256i
+avx2_letters(const __m256i bytes)
+{
+    __m256i shifted = _mm256_add_epi8(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)),
+                                      _mm256_set1_epi8((char)(128 - 'a')));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), shifted);
+}
+
+__attribute__((target("avx2"))) NO_ASAN
+static const char*
+avx2_word(const char* p, const char** end)
+{
+    const __m256i* block = (const __m256i*)((uintptr_t)p & ~(uintptr_t)31);
+    uint32_t above = 0xffffffffu << (p - (const char*)block);
+    __m256i bytes;
+    uint32_t letters;
+    uint32_t mask;
+    while (true) {
+        bytes = _mm256_load_si256(block);
+        letters = (uint32_t)_mm256_movemask_epi8(avx2_letters(bytes));
+        uint32_t stops = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('<')),
+                            _mm256_cmpeq_epi8(bytes, _mm256_setzero_si256())));
+        mask = (letters | stops) & above;
+        if (mask != 0) {
+            break;
+        }
+        block++;
+        above = 0xffffffffu;
+    }
+    int first = __builtin_ctz(mask);
+    p = (const char*)block + first;
+
+    // the word's end, usually in the same block
+    mask = ~letters & (0xffffffffu << first);
+    while (mask == 0) {
+        block++;
+        bytes = _mm256_load_si256(block);
+        mask = ~(uint32_t)_mm256_movemask_epi8(avx2_letters(bytes));
+    }
+    *end = (const char*)block + __builtin_ctz(mask);
+    return p;
+}
+
+__attribute__((target("avx2"))) NO_ASAN
+static const char*
+avx2_find(const char* p, const char c)
+{
+    const __m256i* block = (const __m256i*)((uintptr_t)p & ~(uintptr_t)31);
+    uint32_t mask = 0xffffffffu << (p - (const char*)block);
+    const __m256i want = _mm256_set1_epi8(c);
+    while (true) {
+        __m256i bytes = _mm256_load_si256(block);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, want),
+                                      _mm256_cmpeq_epi8(bytes, _mm256_setzero_si256()));
+        mask &= (uint32_t)_mm256_movemask_epi8(hit);
+        if (mask != 0) {
+            return (const char*)block + __builtin_ctz(mask);
+        }
+        block++;
+        mask = 0xffffffffu;
+    }
+}
+#endif
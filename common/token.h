@@ -0,0 +1,115 @@
+/*
+ * token.h    Kyrylo Bakumenko    17 May, 2023
+ *
+ * Tokenizer for page HTML that allocates nothing per word. Each word is
+ * returned as a view, a pointer into the HTML and a length, and can be
+ * lowercased into a scratch buffer that the caller reuses for every
+ * word. Words are found as by webpage_getNextWord: runs of letters,
+ * outside of <...> tags. Links are found as by webpage_getNextURL, and
+ * likewise returned as views.
+ *
+ * The scans run on SSE2 or AVX2 when the CPU has them, 16 or 32 bytes
+ * at a time, with a scalar fallback; see token_select.
+ */
+
+#ifndef __TOKEN_H
+#define __TOKEN_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct token {
+    const char* word;           // first letter, inside the HTML
+    size_t len;                 // number of letters
+} token_t;
+
+// a link of an <a href=...> tag
+typedef struct link {
+    token_t url;                // as written, without any #fragment
+    size_t tag;                 // position of its "<a" in the HTML
+    bool relative;              // to be resolved against the page's URL
+} link_t;
+
+// a growable buffer for token_lower
+typedef struct scratch {
+    char* buf;
+    size_t cap;
+} scratch_t;
+
+/**************** functions ****************/
+
+/**************** token_next ****************/
+/* Find the next word of html at or after *pos.
+ *
+ * Caller provides:
+ *   NUL-terminated html, pos (0 on the first call), a token to fill.
+ * We return:
+ *   true, with token set and *pos just past the word;
+ *   false if there are no more words.
+ * We guarantee:
+ *   html is unchanged, and nothing is allocated.
+ * Notes:
+ *   a '<' starts a tag that runs to the next '>'; as with
+ *   webpage_getNextWord, an unclosed tag, or one closed by the
+ *   last character, ends the words of the page.
+ */
+bool token_next(const char* html, size_t* pos, token_t* token);
+
+/**************** token_nextLink ****************/
+/* Find the next link of html at or after *pos.
+ *
+ * Caller provides:
+ *   NUL-terminated html, already squeezed by token_squeeze;
+ *   pos (0 on the first call), a link to fill.
+ * We return:
+ *   true, with link set and *pos just past its url;
+ *   false if there are no more links.
+ * We guarantee:
+ *   html is unchanged, nothing is allocated, and the links are those,
+ *   in the same order, that webpage_getNextURL would return: only
+ *   http(s) or relative ones, not references within the page.
+ * Notes:
+ *   a relative url is not resolved; webpage_getNextURL, started at
+ *   link->tag, returns it resolved against the page's URL.
+ */
+bool token_nextLink(const char* html, size_t* pos, link_t* link);
+
+/**************** token_squeeze ****************/
+/* Remove every whitespace character from html, in place, as
+ * webpage_getNextURL does on its first call.
+ */
+void token_squeeze(char* html);
+
+/**************** token_lower ****************/
+/* Copy the token, lowercased and NUL-terminated, into scratch,
+ * growing it only if the word is longer than any before.
+ *
+ * Caller provides:
+ *   a token from token_next; a scratch initialized to {NULL, 0}.
+ * We return:
+ *   scratch's buffer holding the word; NULL if out of memory.
+ * Caller is responsible for:
+ *   later calling token_free on scratch.
+ */
+char* token_lower(const token_t* token, scratch_t* scratch);
+
+/**************** token_free ****************/
+/* Free a scratch buffer of token_lower, leaving it empty. */
+void token_free(scratch_t* scratch);
+
+/**************** token_select ****************/
+/* Choose the scanner used by token_next and token_nextLink:
+ * "auto", "scalar", "sse2" or "avx2".
+ *
+ * We return:
+ *   true if selected; false if the name is unknown or the CPU
+ *   lacks the instructions, in which case nothing changes.
+ */
+bool token_select(const char* name);
+
+/**************** token_kernel ****************/
+/* Return the name of the scanner currently in use. */
+const char* token_kernel(void);
+
+#endif // __TOKEN_H
@@ -0,0 +1,300 @@
+/* tokenbench.c    Kyrylo Bakumenko    17 May, 2023
+ *
+ * Tokenizer throughput on saved crawl pages. Loads the HTML of every page
+ * of a crawler directory into memory, then times finding, lowercasing and
+ * length-filtering every word as indexPage does,
+ *   - with webpage_getNextWord, which allocates and copies each word
+ *   - with token_next and token_lower, which allocate nothing per word,
+ *     on each scanner the CPU supports (scalar, sse2, avx2)
+ * and then finding every link as pageScan does,
+ *   - with webpage_getNextURL
+ *   - with token_nextLink, resolving relative links with webpage_getNextURL
+ * checking that each finds the same words or links, and reports MB of
+ * HTML per second.
+ *
+ * usage: ./tokenbench pageDirectory [repeats]
+ *
+ * Exit codes: 1 -> invalid arguments
+ *             2 -> no pages could be read
+ *             3 -> the tokenizers disagree
+ *             4 -> the link extractors disagree
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include "token.h"
+#include "webpage.h"
+#include "file.h"
+#include "mem.h"
+
+// what a tokenizer found, to compare them
+typedef struct tally {
+    long words;                 // words of at least 3 letters
+    uint64_t checksum;          // of those words, lowercased
+} tally_t;
+
+static double now(void);
+static char* page_html(const char* pageDirectory, int docID, char** url);
+static void tally_word(tally_t* tally, const char* word, size_t len);
+static double words_view(webpage_t** pages, int numPages, int repeats, tally_t* tally);
+static double words_scan(webpage_t** pages, int numPages, int repeats, tally_t* tally);
+static double links_view(webpage_t** pages, int numPages, int repeats, tally_t* tally);
+
+/* ***************************
+ *  main function
+ *  Accepts 1-2 arguments: pageDirectory, repeats
+ */
+int main(int argc, char* argv[])
+{
+    int repeats = 10;
+    if (argc < 2 || argc > 3 || (argc > 2 && (repeats = atoi(argv[2])) <= 0)) {
+        fprintf(stderr, "usage: %s pageDirectory [repeats]\n", argv[0]);
+        exit(1);
+    }
+
+    // every page's HTML, as a webpage for webpage_getNextWord
+    int numPages = 0;
+    int capacity = 64;
+    webpage_t** pages = mem_malloc_assert(capacity * sizeof(webpage_t*), "pages");
+    size_t bytes = 0;
+    char* html;
+    char* url;
+    while ((html = page_html(argv[1], numPages + 1, &url)) != NULL) {
+        if (numPages == capacity) {
+            capacity *= 2;
+            webpage_t** grown = mem_malloc_assert(capacity * sizeof(webpage_t*), "pages");
+            memcpy(grown, pages, numPages * sizeof(webpage_t*));
+            mem_free(pages);
+            pages = grown;
+        }
+        bytes += strlen(html);
+        pages[numPages++] = webpage_new(url, 0, html);
+    }
+    if (numPages == 0) {
+        fprintf(stderr, "ERROR: No pages in %s\n", argv[1]);
+        mem_free(pages);
+        exit(2);
+    }
+    printf("%d pages, %.1f MB of HTML\n", numPages, bytes / 1e6);
+
+    tally_t before = { 0, 0 };
+    double start = now();
+    for (int r = 0; r < repeats; r++) {
+        for (int p = 0; p < numPages; p++) {
+            int pos = 0;
+            char* word;
+            while ((word = webpage_getNextWord(pages[p], &pos)) != NULL) {
+                size_t len = strlen(word);
+                if (len >= 3) {
+                    for (char* c = word; *c; c++) {
+                        *c = tolower(*c);
+                    }
+                    tally_word(&before, word, len);
+                }
+                free(word);
+            }
+        }
+    }
+    double copySecs = now() - start;
+
+    double mb = (double)bytes * repeats / 1e6;
+    printf("%ld words per pass\n", before.words / repeats);
+    printf("webpage_getNextWord %8.1f MB/s\n", mb / copySecs);
+    tally_t after = { 0, 0 };
+    double viewSecs = words_view(pages, numPages, repeats, &after);
+    if (before.words != after.words || before.checksum != after.checksum) {
+        fprintf(stderr, "ERROR: webpage_getNextWord found %ld words, token_next %ld\n",
+                before.words, after.words);
+        exit(3);
+    }
+    printf("token_next %-8s %8.1f MB/s   %6.1fx\n", token_kernel(),
+           mb / viewSecs, copySecs / viewSecs);
+
+    // the scanners alone, each finding the same words as the first
+    static const char* scanners[] = { "scalar", "sse2", "avx2" };
+    tally_t first = { 0, 0 };
+    for (int k = 0; k < 3; k++) {
+        if (!token_select(scanners[k])) {
+            continue;
+        }
+        tally_t scanned = { 0, 0 };
+        double scanSecs = words_scan(pages, numPages, repeats, &scanned);
+        if (first.words == 0) {
+            first = scanned;
+        } else if (first.words != scanned.words || first.checksum != scanned.checksum) {
+            fprintf(stderr, "ERROR: the scalar scanner found %ld words, %s %ld\n",
+                    first.words, scanners[k], scanned.words);
+            exit(3);
+        }
+        printf("  scan only %-7s %8.1f MB/s\n", scanners[k], mb / scanSecs);
+    }
+    token_select("auto");
+
+    // links, as pageScan finds them; the first pass squeezes the html
+    tally_t links = { 0, 0 };
+    start = now();
+    for (int r = 0; r < repeats; r++) {
+        for (int p = 0; p < numPages; p++) {
+            int pos = 0;
+            char* link;
+            while ((link = webpage_getNextURL(pages[p], &pos)) != NULL) {
+                tally_word(&links, link, strlen(link));
+                free(link);
+            }
+        }
+    }
+    double urlSecs = now() - start;
+    tally_t found = { 0, 0 };
+    double linkSecs = links_view(pages, numPages, repeats, &found);
+    if (links.words != found.words || links.checksum != found.checksum) {
+        fprintf(stderr, "ERROR: webpage_getNextURL found %ld links, token_nextLink %ld\n",
+                links.words, found.words);
+        exit(4);
+    }
+    printf("%ld links per pass\n", links.words / repeats);
+    printf("webpage_getNextURL  %8.1f MB/s\n", mb / urlSecs);
+    printf("token_nextLink %-4s %8.1f MB/s   %6.1fx\n", token_kernel(),
+           mb / linkSecs, urlSecs / linkSecs);
+
+    for (int p = 0; p < numPages; p++) {
+        webpage_delete(pages[p]);
+    }
+    mem_free(pages);
+    return 0;
+}
+
+/**************** now() ****************/
+/* wall-clock seconds */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** page_html() ****************/
+/* returns the HTML of page docID (the file after its URL and depth */
+/* lines), to be freed, and sets *url to its URL, to be freed;      */
+/* NULL if the page cannot be read                                  */
+static char*
+page_html(const char* pageDirectory, int docID, char** url)
+{
+    char path[strlen(pageDirectory) + 24];
+    sprintf(path, "%s/%d", pageDirectory, docID);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+    *url = file_readLine(fp);
+    char* depth = file_readLine(fp);
+    if (depth != NULL) {
+        mem_free(depth);
+    }
+    char* html = file_readFile(fp);
+    fclose(fp);
+    if (*url == NULL || html == NULL) {
+        if (*url != NULL) {
+            mem_free(*url);
+        }
+        if (html != NULL) {
+            mem_free(html);
+        }
+        return NULL;
+    }
+    return html;
+}
+
+/**************** tally_word() ****************/
+/* counts a word and adds its FNV-1a hash to the checksum */
+static void
+tally_word(tally_t* tally, const char* word, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)word[i]) * 1099511628211ULL;
+    }
+    tally->words++;
+    tally->checksum += hash;
+}
+
+/**************** words_view() ****************/
+/* finds every word with token_next and token_lower; returns seconds */
+static double
+words_view(webpage_t** pages, int numPages, int repeats, tally_t* tally)
+{
+    scratch_t scratch = { NULL, 0 };
+    double start = now();
+    for (int r = 0; r < repeats; r++) {
+        for (int p = 0; p < numPages; p++) {
+            const char* doc = webpage_getHTML(pages[p]);
+            size_t pos = 0;
+            token_t token;
+            while (token_next(doc, &pos, &token)) {
+                if (token.len >= 3) {
+                    tally_word(tally, token_lower(&token, &scratch), token.len);
+                }
+            }
+        }
+    }
+    double secs = now() - start;
+    token_free(&scratch);
+    return secs;
+}
+
+/**************** words_scan() ****************/
+/* finds every word with token_next, tallying only where each */
+/* is and its length; returns seconds                          */
+static double
+words_scan(webpage_t** pages, int numPages, int repeats, tally_t* tally)
+{
+    double start = now();
+    for (int r = 0; r < repeats; r++) {
+        for (int p = 0; p < numPages; p++) {
+            const char* doc = webpage_getHTML(pages[p]);
+            size_t pos = 0;
+            token_t token;
+            while (token_next(doc, &pos, &token)) {
+                tally->words++;
+                tally->checksum += (token.word - doc) * 31 + token.len;
+            }
+        }
+    }
+    return now() - start;
+}
+
+/**************** links_view() ****************/
+/* finds every link with token_nextLink, as pageScan does; returns seconds */
+static double
+links_view(webpage_t** pages, int numPages, int repeats, tally_t* tally)
+{
+    double start = now();
+    for (int r = 0; r < repeats; r++) {
+        for (int p = 0; p < numPages; p++) {
+            char* doc = webpage_getHTML(pages[p]);
+            token_squeeze(doc);
+            size_t pos = 0;
+            link_t link;
+            while (token_nextLink(doc, &pos, &link)) {
+                if (link.relative) {
+                    int tag = link.tag;
+                    char* url = webpage_getNextURL(pages[p], &tag);
+                    if (url == NULL) {
+                        break;
+                    }
+                    tally_word(tally, url, strlen(url));
+                    free(url);
+                } else {
+                    tally_word(tally, link.url.word, link.url.len);
+                }
+            }
+        }
+    }
+    return now() - start;
+}
@@ -0,0 +1,282 @@
+/* urlset.c    Kyrylo Bakumenko    27 May, 2023
+ *
+ * The set of URLs seen. See urlset.h for documentation.
+ *
+ * A set of fingerprints is an array of slots, a power of two of them,
+ * each a fingerprint or 0 for an empty slot (a fingerprint of 0 is taken
+ * as 1). A URL's slot is its fingerprint masked, or the first empty one
+ * after it, linear probing; the array doubles before it is 3/4 full, and
+ * moving a fingerprint needs no hashing. Eight slots fill a cache line,
+ * so a probe seldom touches more than one.
+ *
+ * A Bloom filter is an array of blocks of 512 bits, a cache line each.
+ * A URL's block is picked by the high half of its fingerprint, and each
+ * of its k bits in the block by the top 9 bits of the fingerprint times
+ * an odd constant, once more for each bit; double hashing, which steps
+ * by a fixed stride, would give URLs of one stride most bits in common
+ * in so small a block. k is bits per URL times ln 2, which makes the
+ * fewest false positives.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "urlset.h"
+#include "hash.h"
+#include "mem.h"
+
+static const size_t MIN_SLOTS = 64;
+// a Bloom filter block: 8 words, 512 bits
+#define BLOCK_WORDS 8
+static const int BLOCK_BITS = BLOCK_WORDS * 64;
+
+/**************** global types ****************/
+typedef struct urlset {
+    uint64_t seed;              // for hash_bytes
+    int count;                  // URLs added
+    // a set of fingerprints
+    uint64_t* slots;            // NULL for a Bloom filter
+    size_t mask;                // number of slots - 1
+    // a Bloom filter
+    uint64_t* blocks;           // BLOCK_WORDS words each
+    size_t numBlocks;
+    int k;                      // bits set per URL
+} urlset_t;
+
+/**************** local functions ****************/
+static uint64_t urlsetPrint(urlset_t* set, const char* url);
+static bool urlsetGrow(urlset_t* set);
+static bool urlsetPlace(uint64_t* slots, const size_t mask, const uint64_t print);
+static bool urlsetBloom(urlset_t* set, const uint64_t print, const bool add);
+
+/**************** urlset_new() ****************/
+/* see urlset.h for description */
+urlset_t*
+urlset_new(const int expected, const int bits)
+{
+    if (expected <= 0 || bits < 0 || bits > 64) {
+        return NULL;
+    }
+    urlset_t* set = mem_malloc(sizeof(urlset_t));
+    if (set == NULL) {
+        return NULL;
+    }
+    set->seed = hash_seed();
+    set->count = 0;
+    set->slots = NULL;
+    set->mask = 0;
+    set->blocks = NULL;
+    set->numBlocks = 0;
+    set->k = 0;
+    if (bits == 0) {
+        // room for expected below 3/4 full
+        size_t numSlots = MIN_SLOTS;
+        while (numSlots / 4 * 3 < (size_t)expected) {
+            numSlots *= 2;
+        }
+        set->slots = mem_calloc(numSlots, sizeof(uint64_t));
+        set->mask = numSlots - 1;
+    } else {
+        set->numBlocks = ((size_t)expected * bits + BLOCK_BITS - 1) / BLOCK_BITS;
+        set->blocks = mem_calloc(set->numBlocks * BLOCK_WORDS, sizeof(uint64_t));
+        // bits * ln 2, rounded
+        set->k = (bits * 693 + 500) / 1000;
+        if (set->k < 1) {
+            set->k = 1;
+        } else if (set->k > 16) {
+            set->k = 16;
+        }
+    }
+    if (set->slots == NULL && set->blocks == NULL) {
+        mem_free(set);
+        return NULL;
+    }
+    return set;
+}
+
+/**************** urlset_insert() ****************/
+/* see urlset.h for description */
+bool
+urlset_insert(urlset_t* set, const char* url)
+{
+    if (set == NULL || url == NULL) {
+        return false;
+    }
+    uint64_t print = urlsetPrint(set, url);
+    if (set->slots == NULL) {
+        if (!urlsetBloom(set, print, true)) {
+            return false;
+        }
+    } else {
+        if ((size_t)set->count + 1 > (set->mask + 1) / 4 * 3 && !urlsetGrow(set)) {
+            return false;
+        }
+        if (!urlsetPlace(set->slots, set->mask, print)) {
+            return false;
+        }
+    }
+    set->count++;
+    return true;
+}
+
+/**************** urlset_find() ****************/
+/* see urlset.h for description */
+bool
+urlset_find(urlset_t* set, const char* url)
+{
+    if (set == NULL || url == NULL) {
+        return false;
+    }
+    uint64_t print = urlsetPrint(set, url);
+    if (set->slots == NULL) {
+        return !urlsetBloom(set, print, false);
+    }
+    for (size_t s = print & set->mask; set->slots[s] != 0; s = (s + 1) & set->mask) {
+        if (set->slots[s] == print) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************** urlset_count() ****************/
+/* see urlset.h for description */
+int
+urlset_count(urlset_t* set)
+{
+    return set == NULL ? 0 : set->count;
+}
+
+/**************** urlset_bytes() ****************/
+/* see urlset.h for description */
+size_t
+urlset_bytes(urlset_t* set)
+{
+    if (set == NULL) {
+        return 0;
+    }
+    if (set->slots != NULL) {
+        return sizeof(urlset_t) + (set->mask + 1) * sizeof(uint64_t);
+    }
+    return sizeof(urlset_t) + set->numBlocks * BLOCK_WORDS * sizeof(uint64_t);
+}
+
+/**************** urlset_falsePositive() ****************/
+/* see urlset.h for description */
+double
+urlset_falsePositive(urlset_t* set)
+{
+    if (set == NULL) {
+        return 0;
+    }
+    if (set->slots != NULL) {
+        // a new fingerprint matches one of count
+        return set->count / 18446744073709551616.0;
+    }
+    // a new URL finds its k bits set in its block with a chance of
+    // about (bits set / 512)^k; average that over the blocks
+    double sum = 0;
+    for (size_t b = 0; b < set->numBlocks; b++) {
+        int ones = 0;
+        for (int w = 0; w < BLOCK_WORDS; w++) {
+            ones += __builtin_popcountll(set->blocks[b * BLOCK_WORDS + w]);
+        }
+        double fill = (double)ones / BLOCK_BITS;
+        double chance = 1;
+        for (int i = 0; i < set->k; i++) {
+            chance *= fill;
+        }
+        sum += chance;
+    }
+    return sum / set->numBlocks;
+}
+
+/**************** urlset_delete() ****************/
+/* see urlset.h for description */
+void
+urlset_delete(urlset_t* set)
+{
+    if (set == NULL) {
+        return;
+    }
+    if (set->slots != NULL) {
+        mem_free(set->slots);
+    }
+    if (set->blocks != NULL) {
+        mem_free(set->blocks);
+    }
+    mem_free(set);
+}
+
+/**************** urlsetPrint() ****************/
+/* the fingerprint of url, never 0 */
+static uint64_t
+urlsetPrint(urlset_t* set, const char* url)
+{
+    uint64_t print = hash_bytes(url, strlen(url), set->seed);
+    return print == 0 ? 1 : print;
+}
+
+/**************** urlsetGrow() ****************/
+/* doubles the slots of set; false if out of memory */
+static bool
+urlsetGrow(urlset_t* set)
+{
+    size_t numSlots = 2 * (set->mask + 1);
+    uint64_t* slots = mem_calloc(numSlots, sizeof(uint64_t));
+    if (slots == NULL) {
+        return false;
+    }
+    for (size_t s = 0; s <= set->mask; s++) {
+        if (set->slots[s] != 0) {
+            urlsetPlace(slots, numSlots - 1, set->slots[s]);
+        }
+    }
+    mem_free(set->slots);
+    set->slots = slots;
+    set->mask = numSlots - 1;
+    return true;
+}
+
+/**************** urlsetPlace() ****************/
+/* puts print in the first empty slot from its own, unless it */
+/* is there already; true if it was not                       */
+static bool
+urlsetPlace(uint64_t* slots, const size_t mask, const uint64_t print)
+{
+    for (size_t s = print & mask; ; s = (s + 1) & mask) {
+        if (slots[s] == 0) {
+            slots[s] = print;
+            return true;
+        }
+        if (slots[s] == print) {
+            return false;
+        }
+    }
+}
+
+/**************** urlsetBloom() ****************/
+/* true if any bit of print in set's Bloom filter is not set; */
+/* if add, sets them all                                      */
+static bool
+urlsetBloom(urlset_t* set, const uint64_t print, const bool add)
+{
+    uint64_t* block = set->blocks + ((print >> 32) * set->numBlocks >> 32) * BLOCK_WORDS;
+    uint64_t mixed = print;
+    bool added = false;
+    for (int i = 0; i < set->k; i++) {
+        // the top 9 bits of the fingerprint, mixed once more for each bit
+        mixed *= 0x9e3779b97f4a7c15ULL;
+        uint32_t bit = mixed >> 55;
+        uint64_t one = 1ULL << (bit % 64);
+        if ((block[bit / 64] & one) == 0) {
+            if (!add) {
+                return true;
+            }
+            block[bit / 64] |= one;
+            added = true;
+        }
+    }
+    return added;
+}
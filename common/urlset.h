@@ -0,0 +1,89 @@
+/*
+ * urlset.h    Kyrylo Bakumenko    27 May, 2023
+ *
+ * A set of URLs seen, for the crawler's pagesSeen, which keeps no URL
+ * strings: only a 64-bit fingerprint of each (hash_bytes, under the
+ * process's seed), in one array of slots with open addressing. That is
+ * 8 bytes a slot, 11 to 21 bytes a URL as the array doubles, where a
+ * hashtable holds a 24-byte slot and a copy of the key for each.
+ *
+ * Two URLs may share a fingerprint, and the second is then taken as seen:
+ * with n URLs in the set, a new one is taken so with a chance of n / 2^64.
+ *
+ * Made with bits per URL, a urlset is instead a Bloom filter of that many
+ * bits for each of the URLs expected, split into blocks of one cache line,
+ * each URL setting bits in one block. It does not grow, and takes a new
+ * URL as seen more often, more so once more URLs than expected are in it;
+ * urlset_falsePositive estimates how often from how full its blocks are.
+ * At 16 bits per URL, 2 bytes, that is about 1 in 1000 at the size
+ * expected. A crawl with a Bloom filter skips the pages of those URLs.
+ *
+ * A urlset is not thread-safe.
+ */
+
+#ifndef __URLSET_H
+#define __URLSET_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct urlset urlset_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** urlset_new ****************/
+/* Create a new, empty set.
+ *
+ * Caller provides:
+ *   expected > 0, the number of URLs expected;
+ *   bits, 0 for a set of fingerprints, which grows past expected as it
+ *   must, or 1 to 64, the bits per URL of a Bloom filter for expected.
+ * We return:
+ *   pointer to the new set; NULL if error (out of memory, or expected
+ *   or bits out of range).
+ * Caller is responsible for:
+ *   later calling urlset_delete.
+ */
+urlset_t* urlset_new(const int expected, const int bits);
+
+/**************** urlset_insert ****************/
+/* Add url to the set.
+ *
+ * Caller provides:
+ *   valid set pointer; url, any string.
+ * We return:
+ *   true if url was not in the set; false if it was (or is taken to
+ *   be: see above), if any parameter is NULL, or out of memory.
+ */
+bool urlset_insert(urlset_t* set, const char* url);
+
+/**************** urlset_find ****************/
+/* Return true if url is in the set (or is taken to be: see above);
+ * false if not, or if any parameter is NULL.
+ */
+bool urlset_find(urlset_t* set, const char* url);
+
+/**************** urlset_count ****************/
+/* Return the number of URLs added (0 if set is NULL). */
+int urlset_count(urlset_t* set);
+
+/**************** urlset_bytes ****************/
+/* Return the bytes of memory the set holds (0 if set is NULL). */
+size_t urlset_bytes(urlset_t* set);
+
+/**************** urlset_falsePositive ****************/
+/* Return the chance that a URL not in the set would be taken as seen,
+ * as the set is now (0 if set is NULL).
+ */
+double urlset_falsePositive(urlset_t* set);
+
+/**************** urlset_delete ****************/
+/* Free the set.
+ *
+ * Caller provides:
+ *   valid set pointer, or NULL (ignored).
+ */
+void urlset_delete(urlset_t* set);
+
+#endif // __URLSET_H
@@ -4,26 +4,129 @@
  * Accepts internal url, existing directory, and max depth int parameters
  * Performs dfs search (__crawl__) for internal links on a given url (__pageScan__).
  * found pages are added to the given directory through __pagedir_save__.
+ * When the crawl completes, a manifest of the pages is written to .crawler
+ * through __pagedir_finish__.
+ *
+ * With -j N, N worker threads fetch pages (__crawlWorker__): each takes
+ * the next page from a shared frontier, fetches it through a fetch_t of
+ * its own (fetch_page, see fetch.h, which keeps its connection alive
+ * from one page to the next where the server allows), scans
+ * it for links, adding new ones to the frontier (pagesSeen is shared
+ * too), and hands it to the main thread, the only writer, which assigns
+ * docIDs and saves the pages. -c host:port sends every fetch to a
+ * stand-in server (see testsite.c). Any of these options selects the
+ * worker pool, even with one thread.
+ *
+ * With -e N instead of -j, the main thread alone keeps up to N fetches in
+ * flight, on non-blocking sockets (a fetch_t, see fetch.h), and saves and
+ * scans each page as its fetch completes (__crawlEvents__). Connections
+ * are kept alive and taken again, and -p D pipelines up to D requests
+ * on each (so N * D fetches in flight), once the server has kept one
+ * connection alive.
+ *
+ * Every crawl takes its pages from a politeness scheduler (a polite_t,
+ * see polite.h), which keeps the frontier per host and gives out a page
+ * only once its host may be fetched from again, so a crawl waits only
+ * when every host with pages left is throttled. Each host has a bucket
+ * of -b tokens (default 1), one per fetch, refilled at one per -d seconds
+ * (default 1): a burst of 1 is a minimum delay between fetches from the
+ * host. -r host=delay[,burst] gives a host its own (repeatable). With no
+ * options, that is a second between fetches, as webpage_fetch kept.
+ *
+ * pagesSeen keeps a 64-bit fingerprint of each URL, not the URL (a
+ * urlset_t, see urlset.h). With -f N, it is a Bloom filter of 16 bits a
+ * URL for N URLs instead, 2 bytes a URL, which may take an unseen URL as
+ * seen, and skip its page. The crawl ends with the bytes pagesSeen held
+ * per URL, and the chance it had come to of taking a new URL as seen.
  * 
- * Exit codes: 1 -> invalid number of arguments
+ * Exit codes: 1 -> invalid number of arguments, or invalid option
  *           : 2 -> one or multiple arguments are null
  *           : 3 -> given url is not internal
  *           : 4 -> maximum depth passed is out of range [0, 10]
  */
 
+#define _POSIX_C_SOURCE 200809L // clock_gettime, nanosleep
+
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include "pagedir.h"
+#include "token.h"
+#include "fetch.h"
+#include "polite.h"
+#include "urlset.h"
 #include "webpage.h"
-#include "hashtable.h"
 #include "bag.h"
 #include "mem.h"
 
+// the pages saved so far, for the manifest
+typedef struct saved {
+    int docID;                  // of the last page saved
+    int capacity;               // of lengths
+    size_t* lengths;            // size of each page file, by docID - 1
+} saved_t;
+
+// the politeness profile: -d, -b, and each -r
+typedef struct profile {
+    double delay;               // seconds per token, for every host
+    int burst;                  // tokens a host's bucket holds
+    int numRates;
+    char** rates;               // "host=delay[,burst]", from argv
+} profile_t;
+
+// the state the threads of a -j crawl share, under lock
+typedef struct crawlpool {
+    polite_t* pagesToCrawl;     // the frontier
+    urlset_t* pagesSeen;        // every URL ever added to the frontier
+    bag_t* fetched;             // fetched pages, for the writer
+    int busy;                   // workers holding a page from the frontier
+    int workers;                // workers still running
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // the frontier grew, or the crawl is over
+    pthread_cond_t done;        // a page was fetched, or a worker exited
+    // read-only once the workers start
+    int maxDepth;
+    const char* connectTo;      // for fetch_new; NULL for the URL's host
+} crawlpool_t;
+
+// the state of a -e crawl, for the callback of its fetches
+typedef struct crawlevents {
+    polite_t* pagesToCrawl;
+    urlset_t* pagesSeen;
+    saved_t saved;
+    char* pageDirectory;
+    int maxDepth;
+} crawlevents_t;
+
+// bits per URL of the Bloom filter of -f
+static const int BLOOM_BITS = 16;
+
 // internal function prototypes
 static void parseArgs(const int argc, char* argv[], char** seedURL, char** pageDirectory, int* maxDepth);
 static void crawl(char* seedURL, char* pageDirectory, const int maxDepth);
-static void pageScan(webpage_t* page, bag_t* pagesToCrawl, hashtable_t* pagesSeen);
+static void crawlPool(char* seed, char* pageDirectory, const int maxDepth,
+                      const int numThreads, const profile_t* profile, const char* connectTo,
+                      const int bloomURLs);
+static void* crawlWorker(void* arg);
+static void crawlEvents(char* seed, char* pageDirectory, const int maxDepth,
+                        const int numConns, const int pipeline, const profile_t* profile,
+                        const char* connectTo, const int bloomURLs);
+static void crawlFetched(void* arg, const char* url, void* item, char* html);
+static webpage_t* poolTake(crawlpool_t* pool);
+static polite_t* profileScheduler(const profile_t* profile);
+static bool profileRate(const char* rate, char* host, double* delay, int* burst);
+static urlset_t* seenSet(const int bloomURLs);
+static void seenReport(urlset_t* pagesSeen);
+static void pageScan(webpage_t* page, polite_t* pagesToCrawl, urlset_t* pagesSeen, crawlpool_t* pool);
+static bool pageAdd(char* url, const int depth, polite_t* pagesToCrawl, urlset_t* pagesSeen, crawlpool_t* pool);
+static void pageSave(webpage_t* page, char* pageDirectory, saved_t* saved);
+static void savedFinish(saved_t* saved, char* pageDirectory);
+static double now(void);
+static void sleepFor(const double seconds);
 static void logr(const char* word, const int depth, const char* url);
 
 /* ***************************
@@ -33,11 +136,91 @@ static void logr(const char* word, const int depth, const char* url);
  */
 int main(int argc, char *argv[])
 {
+    // options: -j threads, -e connections, -p pipeline depth, -d delay,
+    // -b burst, -r host=delay[,burst], -c host:port, -f URLs
+    bool pool = false;
+    int numThreads = 1;
+    int numConns = 0;
+    int pipeline = 0;
+    profile_t profile = { 1, 1, 0, NULL };
+    char* rates[argc];
+    profile.rates = rates;
+    const char* connectTo = NULL;
+    int bloomURLs = 0;
+    while (argc > 2 && argv[1] != NULL && argv[1][0] == '-' && argv[2] != NULL) {
+        if (strcmp(argv[1], "-j") == 0) {
+            if ((numThreads = atoi(argv[2])) <= 0) {
+                fprintf(stderr, "ERROR: -j expects a positive number of threads\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[1], "-e") == 0) {
+            if ((numConns = atoi(argv[2])) <= 0) {
+                fprintf(stderr, "ERROR: -e expects a positive number of connections\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[1], "-p") == 0) {
+            if ((pipeline = atoi(argv[2])) <= 0 || pipeline > 16) {
+                fprintf(stderr, "ERROR: -p expects a pipeline depth of 1 to 16\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[1], "-d") == 0) {
+            char* end;
+            profile.delay = strtod(argv[2], &end);
+            if (end == argv[2] || *end != '\0' || profile.delay < 0) {
+                fprintf(stderr, "ERROR: -d expects a delay of 0 or more seconds\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[1], "-b") == 0) {
+            if ((profile.burst = atoi(argv[2])) <= 0) {
+                fprintf(stderr, "ERROR: -b expects a positive number of fetches\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[1], "-r") == 0) {
+            char host[strlen(argv[2]) + 1];
+            double hostDelay;
+            int hostBurst;
+            if (!profileRate(argv[2], host, &hostDelay, &hostBurst)) {
+                fprintf(stderr, "ERROR: -r expects host=delay or host=delay,burst\n");
+                exit(1);
+            }
+            profile.rates[profile.numRates++] = argv[2];
+        } else if (strcmp(argv[1], "-c") == 0) {
+            if (strchr(argv[2], ':') == NULL) {
+                fprintf(stderr, "ERROR: -c expects host:port\n");
+                exit(1);
+            }
+            connectTo = argv[2];
+        } else if (strcmp(argv[1], "-f") == 0) {
+            if ((bloomURLs = atoi(argv[2])) <= 0) {
+                fprintf(stderr, "ERROR: -f expects a positive number of URLs\n");
+                exit(1);
+            }
+        } else {
+            fprintf(stderr, "ERROR: unknown option %s\n", argv[1]);
+            exit(1);
+        }
+        pool = true;
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (pipeline > 0 && numConns == 0) {
+        fprintf(stderr, "ERROR: -p pipelines the connections of -e\n");
+        exit(1);
+    }
+
     char* seedURL = NULL;
     char* pageDirectory = NULL;
     int maxDepth = 0;
     parseArgs(argc, argv, &seedURL, &pageDirectory, &maxDepth);
-    crawl(argv[1], argv[2], maxDepth);
+    if (numConns > 0) {
+        crawlEvents(argv[1], argv[2], maxDepth, numConns, pipeline > 0 ? pipeline : 1,
+                    &profile, connectTo, bloomURLs);
+    } else if (pool) {
+        crawlPool(argv[1], argv[2], maxDepth, numThreads, &profile, connectTo, bloomURLs);
+    } else {
+        crawl(argv[1], argv[2], maxDepth);
+    }
 
     return 0; // exit status
 }
@@ -45,84 +228,423 @@ int main(int argc, char *argv[])
 /**************** crawl() ****************/
 /* accepts internal url, existing directory, and max depth int parameters */
 /* this function performs a dfs search for internal links on a given url, */
-/* found pages are added to the given directory through __pagedir_save__  */
+/* found pages are added to the given directory through __pagedir_save__; */
+/* fetches from a host are a second apart, the default profile            */
 static void 
 crawl(char* seed, char* pageDirectory, const int maxDepth)
 {
     char* seedURL = mem_malloc(strlen(seed) + 1);
     strcpy(seedURL, seed);
 
-    // initialize hashtable (size=200, assume collisions)
-    hashtable_t* pagesSeen = hashtable_new(200);
+    // initialize the set of URLs seen, and add seedURL
+    urlset_t* pagesSeen = seenSet(0);
+    urlset_insert(pagesSeen, seedURL);
 
-    // add seedURL
-    hashtable_insert(pagesSeen, seedURL, "");
-
-    // initialize the bag and add a webpage representing the seedURL at depth 0
-    bag_t* pagesToCrawl = bag_new();
+    // initialize the frontier and add a webpage representing the seedURL at depth 0
+    const profile_t profile = { 1, 1, 0, NULL };
+    polite_t* pagesToCrawl = profileScheduler(&profile);
     webpage_t* seedPage = webpage_new(seedURL, 0, NULL);
-    bag_insert(pagesToCrawl, seedPage);
-
-    // docID counter
-    int docID = 0;
-
-    // while there are more webpages in the bag: extract a page
-    webpage_t* curPage = NULL;
-    while ((curPage = (webpage_t*) bag_extract(pagesToCrawl)) != NULL) {
-        // Sleep for one second if succesful
-        sleep(1);
-        // fetch url; page->html = NULL at call and page->html = html_content after 
-        // if succesful, 
-        if (webpage_fetch(curPage)) {
+    polite_add(pagesToCrawl, seedURL, seedPage, now());
+    // one connection, kept alive from page to page where the server allows
+    fetch_t* fetch = mem_assert(fetch_new(1, NULL), "fetch");
+
+    // docID counter, and the size of each saved page for the manifest
+    saved_t saved = { 0, 0, NULL };
+
+    // while there are more webpages in the frontier: take a page once
+    // its host may be fetched from, sleeping until then
+    webpage_t* page = NULL;
+    double wait;
+    while ((page = polite_next(pagesToCrawl, now(), &wait)) != NULL || wait >= 0) {
+        if (page == NULL) {
+            sleepFor(wait);
+            continue;
+        }
+        // fetch url with fetch_page, as webpage_fetch would sleep a second more;
+        // if succesful, the page becomes a webpage_t with that html
+        char* html = fetch_page(fetch, webpage_getURL(page));
+        if (html != NULL) {
+            char* url = mem_malloc_assert(strlen(webpage_getURL(page)) + 1, "url");
+            strcpy(url, webpage_getURL(page));
+            webpage_t* curPage = webpage_new(url, webpage_getDepth(page), html);
+            webpage_delete(page);
+            page = curPage;
             // log fetch
-            logr("Fetched", webpage_getDepth(curPage), webpage_getURL(curPage));
+            logr("Fetched", webpage_getDepth(page), webpage_getURL(page));
             // save the webpage to pageDirectory
-            pagedir_save(curPage, pageDirectory, ++docID);
+            pageSave(page, pageDirectory, &saved);
 		    // if the webpage is not at maxDepth,
-            if (webpage_getDepth(curPage) < maxDepth) {
+            if (webpage_getDepth(page) < maxDepth) {
                 // pageScan that HTML
                 // log scan
-                logr("Scanning", webpage_getDepth(curPage), webpage_getURL(curPage));
-                pageScan(curPage, pagesToCrawl, pagesSeen);
+                logr("Scanning", webpage_getDepth(page), webpage_getURL(page));
+                pageScan(page, pagesToCrawl, pagesSeen, NULL);
+            }
+        }
+        // delete webpage object attached to page
+        webpage_delete(page);
+    }
+
+    // the crawl is complete: record its pages
+    savedFinish(&saved, pageDirectory);
+    seenReport(pagesSeen);
+
+    fetch_delete(fetch);
+    urlset_delete(pagesSeen);
+    polite_delete(pagesToCrawl, webpage_delete);
+}
+
+/**************** crawlPool() ****************/
+/* crawls as crawl does, with numThreads workers fetching and  */
+/* scanning pages while this thread, the only writer, saves   */
+/* them; docIDs follow the order in which fetches complete     */
+static void
+crawlPool(char* seed, char* pageDirectory, const int maxDepth,
+          const int numThreads, const profile_t* profile, const char* connectTo,
+          const int bloomURLs)
+{
+    crawlpool_t pool;
+    pool.pagesToCrawl = profileScheduler(profile);
+    pool.pagesSeen = seenSet(bloomURLs);
+    pool.fetched = bag_new();
+    pool.busy = 0;
+    pool.workers = numThreads;
+    pthread_mutex_init(&pool.lock, NULL);
+    // poolTake's timed waits are on the clock of now()
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pool.work, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&pool.done, NULL);
+    pool.maxDepth = maxDepth;
+    pool.connectTo = connectTo;
+
+    char* seedURL = mem_malloc_assert(strlen(seed) + 1, "seedURL");
+    strcpy(seedURL, seed);
+    urlset_insert(pool.pagesSeen, seedURL);
+    polite_add(pool.pagesToCrawl, seedURL, webpage_new(seedURL, 0, NULL), now());
+
+    // the tokenizer picks its kernel once, before the threads share it
+    token_kernel();
+    pthread_t threads[numThreads];
+    for (int t = 0; t < numThreads; t++) {
+        if (pthread_create(&threads[t], NULL, crawlWorker, &pool) != 0) {
+            fprintf(stderr, "ERROR: Cannot start crawler thread %d\n", t + 1);
+            exit(1);
+        }
+    }
+
+    // save each fetched page until every worker is done
+    saved_t saved = { 0, 0, NULL };
+    pthread_mutex_lock(&pool.lock);
+    while (true) {
+        webpage_t* page = bag_extract(pool.fetched);
+        if (page == NULL) {
+            if (pool.workers == 0) {
+                break;
+            }
+            pthread_cond_wait(&pool.done, &pool.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool.lock);
+        pageSave(page, pageDirectory, &saved);
+        webpage_delete(page);
+        pthread_mutex_lock(&pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    for (int t = 0; t < numThreads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    savedFinish(&saved, pageDirectory);
+    seenReport(pool.pagesSeen);
+
+    urlset_delete(pool.pagesSeen);
+    polite_delete(pool.pagesToCrawl, webpage_delete);
+    bag_delete(pool.fetched, webpage_delete);
+    pthread_cond_destroy(&pool.done);
+    pthread_cond_destroy(&pool.work);
+    pthread_mutex_destroy(&pool.lock);
+}
+
+/**************** crawlWorker() ****************/
+/* fetches pages from the frontier until the crawl is over; */
+/* scans each one below maxDepth for links, then hands it   */
+/* to the writer                                            */
+static void*
+crawlWorker(void* arg)
+{
+    crawlpool_t* pool = arg;
+    fetch_t* fetch = mem_assert(fetch_new(1, pool->connectTo), "fetch");
+    webpage_t* page;
+    while ((page = poolTake(pool)) != NULL) {
+        const char* url = webpage_getURL(page);
+        const int depth = webpage_getDepth(page);
+        char* html = fetch_page(fetch, url);
+        if (html != NULL) {
+            logr("Fetched", depth, url);
+            // pageScan squeezes the html, so it scans a copy
+            if (depth < pool->maxDepth) {
+                logr("Scanning", depth, url);
+                char* scanURL = mem_malloc_assert(strlen(url) + 1, "url");
+                strcpy(scanURL, url);
+                char* scanHTML = mem_assert(malloc(strlen(html) + 1), "html");
+                strcpy(scanHTML, html);
+                webpage_t* scan = webpage_new(scanURL, depth, scanHTML);
+                pageScan(scan, pool->pagesToCrawl, pool->pagesSeen, pool);
+                webpage_delete(scan);
+            }
+            char* savedURL = mem_malloc_assert(strlen(url) + 1, "url");
+            strcpy(savedURL, url);
+            webpage_t* fetched = webpage_new(savedURL, depth, html);
+            pthread_mutex_lock(&pool->lock);
+            bag_insert(pool->fetched, fetched);
+            pthread_cond_signal(&pool->done);
+            pthread_mutex_unlock(&pool->lock);
+        }
+        webpage_delete(page);
+
+        // the page's links are in the frontier, or there were none
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) {
+            pthread_cond_broadcast(&pool->work);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    fetch_delete(fetch);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->workers--;
+    pthread_cond_signal(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**************** crawlEvents() ****************/
+/* crawls as crawl does, paced by profile, with up to numConns  */
+/* connections, each                                            */
+/* with up to pipeline fetches in flight at once, all from this */
+/* thread; each page is saved, and below maxDepth scanned, as   */
+/* its fetch completes (crawlFetched), so docIDs follow the     */
+/* order in which fetches complete                              */
+static void
+crawlEvents(char* seed, char* pageDirectory, const int maxDepth,
+            const int numConns, const int pipeline, const profile_t* profile,
+            const char* connectTo, const int bloomURLs)
+{
+    crawlevents_t crawl = { profileScheduler(profile), seenSet(bloomURLs), { 0, 0, NULL },
+                            pageDirectory, maxDepth };
+    fetch_t* fetch = mem_assert(fetch_new(numConns, connectTo), "fetch");
+    fetch_pipeline(fetch, pipeline);
+
+    char* seedURL = mem_malloc_assert(strlen(seed) + 1, "seedURL");
+    strcpy(seedURL, seed);
+    urlset_insert(crawl.pagesSeen, seedURL);
+    polite_add(crawl.pagesToCrawl, seedURL, webpage_new(seedURL, 0, NULL), now());
+
+    // start a fetch whenever there is room in flight and a host may be
+    // fetched from; otherwise wait for a fetch to complete, or for a host
+    while (true) {
+        int timeout = -1;
+        if (fetch_pending(fetch) < numConns * pipeline) {
+            double wait;
+            webpage_t* next = polite_next(crawl.pagesToCrawl, now(), &wait);
+            if (next != NULL) {
+                if (!fetch_add(fetch, webpage_getURL(next), next)) {
+                    fprintf(stderr, "ERROR: Cannot queue the fetch of %s\n", webpage_getURL(next));
+                    exit(99);
+                }
+                continue;
+            }
+            if (wait < 0 && fetch_pending(fetch) == 0) {
+                break;
+            }
+            if (wait >= 0) {
+                timeout = (int)(wait * 1000) + 1;
             }
         }
-        // delete webpage object attached to curPage
-        webpage_delete(curPage);
+        fetch_run(fetch, timeout, crawlFetched, &crawl);
     }
+    savedFinish(&crawl.saved, pageDirectory);
+    seenReport(crawl.pagesSeen);
 
-    hashtable_delete(pagesSeen, NULL);
-    bag_delete(pagesToCrawl, webpage_delete);
+    fetch_delete(fetch);
+    urlset_delete(crawl.pagesSeen);
+    polite_delete(crawl.pagesToCrawl, webpage_delete);
+}
+
+/**************** crawlFetched() ****************/
+/* the callback of crawlEvents' fetches: saves the page of item */
+/* if its fetch succeeded, and scans it below maxDepth          */
+static void
+crawlFetched(void* arg, const char* url, void* item, char* html)
+{
+    crawlevents_t* crawl = arg;
+    webpage_t* page = item;
+    if (html != NULL) {
+        const int depth = webpage_getDepth(page);
+        logr("Fetched", depth, url);
+        char* fetchedURL = mem_malloc_assert(strlen(url) + 1, "url");
+        strcpy(fetchedURL, url);
+        webpage_t* fetched = webpage_new(fetchedURL, depth, html);
+        pageSave(fetched, crawl->pageDirectory, &crawl->saved);
+        if (depth < crawl->maxDepth) {
+            logr("Scanning", depth, url);
+            pageScan(fetched, crawl->pagesToCrawl, crawl->pagesSeen, NULL);
+        }
+        webpage_delete(fetched);
+    }
+    webpage_delete(page);
+}
+
+/**************** poolTake() ****************/
+/* the next page of the frontier whose host may be fetched */
+/* from, waiting while there is none but a host's turn is  */
+/* yet to come or other workers may yet add to it; NULL    */
+/* once the crawl is over: the frontier is empty and no    */
+/* worker is busy                                          */
+static webpage_t*
+poolTake(crawlpool_t* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    webpage_t* page;
+    double wait;
+    while ((page = polite_next(pool->pagesToCrawl, now(), &wait)) == NULL
+           && (wait >= 0 || pool->busy > 0)) {
+        if (wait < 0) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        } else {
+            // every host with pages is throttled
+            double until = now() + wait;
+            struct timespec ts = { (time_t)until, (long)((until - (time_t)until) * 1e9) };
+            pthread_cond_timedwait(&pool->work, &pool->lock, &ts);
+        }
+    }
+    if (page != NULL) {
+        pool->busy++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return page;
+}
+
+/**************** profileScheduler() ****************/
+/* a new politeness scheduler for profile; exits if out of memory */
+static polite_t*
+profileScheduler(const profile_t* profile)
+{
+    polite_t* polite = mem_assert(polite_new(profile->delay, profile->burst), "polite");
+    for (int r = 0; r < profile->numRates; r++) {
+        char host[strlen(profile->rates[r]) + 1];
+        double delay;
+        int burst;
+        if (!profileRate(profile->rates[r], host, &delay, &burst)
+            || !polite_rate(polite, host, delay, burst < 0 ? profile->burst : burst)) {
+            fprintf(stderr, "ERROR: Cannot set the rate %s\n", profile->rates[r]);
+            exit(99);
+        }
+    }
+    return polite;
+}
+
+/**************** profileRate() ****************/
+/* parses rate, "host=delay[,burst]", into host (which must hold */
+/* strlen(rate) + 1 bytes), delay and burst (-1 if none); false  */
+/* if it is not of that form                                     */
+static bool
+profileRate(const char* rate, char* host, double* delay, int* burst)
+{
+    const char* eq = strchr(rate, '=');
+    if (eq == NULL || eq == rate) {
+        return false;
+    }
+    memcpy(host, rate, eq - rate);
+    host[eq - rate] = '\0';
+    char* end;
+    *delay = strtod(eq + 1, &end);
+    if (end == eq + 1 || *delay < 0) {
+        return false;
+    }
+    *burst = -1;
+    if (*end == ',') {
+        char* last;
+        long b = strtol(end + 1, &last, 10);
+        if (last == end + 1 || b <= 0 || b > 1000000) {
+            return false;
+        }
+        *burst = (int)b;
+        end = last;
+    }
+    return *end == '\0';
+}
+
+/**************** seenSet() ****************/
+/* a new set of URLs seen: fingerprints, or with bloomURLs > 0 */
+/* a Bloom filter for that many; exits if out of memory        */
+static urlset_t*
+seenSet(const int bloomURLs)
+{
+    if (bloomURLs > 0) {
+        return mem_assert(urlset_new(bloomURLs, BLOOM_BITS), "pagesSeen");
+    }
+    return mem_assert(urlset_new(200, 0), "pagesSeen");
+}
+
+/**************** seenReport() ****************/
+/* prints the URLs in pagesSeen, the bytes it held per URL, and */
+/* its chance of taking a new URL as seen                       */
+static void
+seenReport(urlset_t* pagesSeen)
+{
+    const int count = urlset_count(pagesSeen);
+    const size_t bytes = urlset_bytes(pagesSeen);
+    printf("Seen %d URLs in %zu bytes, %.1f bytes per URL; false positive rate %.2g\n",
+           count, bytes, count > 0 ? (double)bytes / count : 0.0,
+           urlset_falsePositive(pagesSeen));
 }
 
 /**************** pageScan() ****************/
 /* recursively searches a given webpage for internal links in DFS approach */
-/* the source page is added to the hashtable pagesSeen and the found links */
-/* are added to pagesToCrawl */ 
+/* the source page is added to the set pagesSeen and the found links      */
+/* are added to pagesToCrawl; under pool's lock, if pool is not NULL */ 
 static void
-pageScan(webpage_t* page, bag_t* pagesToCrawl, hashtable_t* pagesSeen)
+pageScan(webpage_t* page, polite_t* pagesToCrawl, urlset_t* pagesSeen, crawlpool_t* pool)
 {
     // current depth
     int curDepth = webpage_getDepth(page);
+    // links are found in the html without whitespace, as by webpage_getNextURL
+    char* html = webpage_getHTML(page);
+    token_squeeze(html);
     // pointer to position in html
-    int pos = 0;
-    // get URL
-    char* nextUrl = NULL;
-    // while URL in the page is not null
-    while ((nextUrl = webpage_getNextURL(page, &pos)) != NULL) {
+    size_t pos = 0;
+    link_t link;
+    // while there is another link in the page
+    while (token_nextLink(html, &pos, &link)) {
+        // get URL: absolute ones as written, relative ones resolved by libcs50
+        char* nextUrl = NULL;
+        if (link.relative) {
+            int tag = link.tag;
+            nextUrl = webpage_getNextURL(page, &tag);
+        } else {
+            nextUrl = mem_malloc(link.url.len + 1);
+            if (nextUrl != NULL) {
+                memcpy(nextUrl, link.url.word, link.url.len);
+                nextUrl[link.url.len] = '\0';
+            }
+        }
+        if (nextUrl == NULL) {
+            // as webpage_getNextURL, stop at a link that cannot be resolved
+            break;
+        }
         // normalize
         char* normURL = normalizeURL(nextUrl);
         // log found
         logr("Found", webpage_getDepth(page), normURL);
-        // if internal, try to insert webpage into hashtable
+        // if internal, try to insert webpage into pagesSeen
         if (isInternalURL(normURL)) {
             // verify that the url has not been scanned
-            if (hashtable_insert(pagesSeen, normURL, "")) { 
-                // if succesful, create a webpage_t and insert into bag
-                // log added
-                logr("Added", webpage_getDepth(page), normURL);
-                webpage_t* newPage = webpage_new(normURL, curDepth+1, NULL);
-                bag_insert(pagesToCrawl, newPage);
-            } else {
+            // pageAdd logs it as added: once it is in the frontier,
+            // another worker may take it and free it
+            if (!pageAdd(normURL, curDepth+1, pagesToCrawl, pagesSeen, pool)) {
                 // log IgnDupl
                 logr("IgnDupl", webpage_getDepth(page), normURL);
                 // free the norm URL
@@ -138,9 +660,75 @@ pageScan(webpage_t* page, bag_t* pagesToCrawl, hashtable_t* pagesSeen)
         mem_free(nextUrl);
 
     }
-    // add url to hashtable
-    hashtable_insert(pagesSeen, webpage_getURL(page), "");
-        
+    // add url to pagesSeen
+    if (pool != NULL) {
+        pthread_mutex_lock(&pool->lock);
+    }
+    urlset_insert(pagesSeen, webpage_getURL(page));
+    if (pool != NULL) {
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/**************** pageAdd() ****************/
+/* adds url to pagesSeen and, if it was not there, a webpage_t */
+/* for it to pagesToCrawl, which takes url, logging it Added   */
+/* (by a page at depth - 1); under pool's lock, waking a       */
+/* worker, if pool is not NULL                                 */
+/* returns false if url was seen before (url is not taken)     */
+static bool
+pageAdd(char* url, const int depth, polite_t* pagesToCrawl, urlset_t* pagesSeen, crawlpool_t* pool)
+{
+    if (pool != NULL) {
+        pthread_mutex_lock(&pool->lock);
+    }
+    bool added = urlset_insert(pagesSeen, url);
+    if (added) {
+        // if succesful, create a webpage_t and queue it on its host
+        logr("Added", depth - 1, url);
+        if (!polite_add(pagesToCrawl, url, webpage_new(url, depth, NULL), now())) {
+            fprintf(stderr, "ERROR: Cannot queue %s\n", url);
+            exit(99);
+        }
+    }
+    if (pool != NULL) {
+        if (added) {
+            pthread_cond_signal(&pool->work);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return added;
+}
+
+/**************** pageSave() ****************/
+/* saves page as the next docID, remembering its size */
+static void
+pageSave(webpage_t* page, char* pageDirectory, saved_t* saved)
+{
+    if (saved->docID == saved->capacity) {
+        saved->capacity = saved->capacity == 0 ? 64 : 2 * saved->capacity;
+        size_t* grown = mem_malloc_assert(saved->capacity * sizeof(size_t), "lengths");
+        if (saved->lengths != NULL) {
+            memcpy(grown, saved->lengths, saved->docID * sizeof(size_t));
+            mem_free(saved->lengths);
+        }
+        saved->lengths = grown;
+    }
+    saved->lengths[saved->docID] = pagedir_save(page, pageDirectory, saved->docID + 1);
+    saved->docID++;
+}
+
+/**************** savedFinish() ****************/
+/* writes the manifest of the saved pages */
+static void
+savedFinish(saved_t* saved, char* pageDirectory)
+{
+    if (!pagedir_finish(pageDirectory, saved->docID, saved->lengths)) {
+        fprintf(stderr, "ERROR: Cannot write the manifest to %s/.crawler\n", pageDirectory);
+    }
+    if (saved->lengths != NULL) {
+        mem_free(saved->lengths);
+    }
 }
 /**************** parseArgs() ****************/
 /* this method assures that passed arguments to crawl are valid */
@@ -181,6 +769,26 @@ parseArgs(const int argc, char* argv[], char** seedURL, char** pageDirectory, in
     }
 
 }
+/**************** now() ****************/
+/* monotonic seconds */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** sleepFor() ****************/
+/* sleeps for seconds */
+static void
+sleepFor(const double seconds)
+{
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
 /**************** logr() ****************/
 /* this function logs the actions of __crawl__ and __pageScan__ */
 /* namely when a page is Found, Added, or Ignored (duplicate or */ 
@@ -65,6 +65,52 @@ do
     # diff -r ../data-correct/wikipedia_"${i}" ../data/wikipedia_"${i}"
 done
 
+## Worker pool, against the local stand-in site ##
+# 300 pages in a binary tree, all within depth 8 of page 0, with
+# connections kept alive; and again, closing each after one page
+port=8123
+./testsite $port 300 &
+./testsite $((port + 1)) 300 close &
+sleep 1
+site=http://cs50tse.cs.dartmouth.edu/tse/site/0.html
+# invalid options
+./crawler -j 0 $site ../data/site-1 10
+./crawler -d -1 $site ../data/site-1 10
+./crawler -c nowhere $site ../data/site-1 10
+./crawler -e 0 $site ../data/site-1 10
+./crawler -e 16 -p 17 $site ../data/site-1 10
+./crawler -j 8 -p 8 $site ../data/site-1 10
+./crawler -b 0 $site ../data/site-1 10
+./crawler -r cs50tse.cs.dartmouth.edu $site ../data/site-1 10
+./crawler -r cs50tse.cs.dartmouth.edu=0.1,0 $site ../data/site-1 10
+./crawler -f 0 $site ../data/site-1 10
+echo "comparing 1 and 8 workers, and 16 connections, pipelined or not, or paced . . ."
+for opt in "-j 1" "-j 8" "-e 16" "-e 16 -p 8" "-j 4 -d 0.002 -b 4" "-e 16 -r cs50tse.cs.dartmouth.edu=0.002,8" "-e 16 -f 100000" "close -j 8" "close -e 16 -p 8"
+do
+    name=site${opt// /}
+    to=127.0.0.1:$port
+    if [ "${opt%% *}" == close ]
+    then
+        to=127.0.0.1:$((port + 1))
+        opt=${opt#close }
+    fi
+    echo "running ${name}"
+    rm -rf ../data/"${name}"
+    mkdir -p ../data/"${name}"
+    # the last line: the URLs seen, and the bytes per URL they took
+    ./crawler -c $to -d 0 $opt $site ../data/"${name}" 10 | tail -1
+    echo "pages saved: `ls ../data/"${name}" | wc -l` [Should be 300]"
+done
+# docIDs depend on the order pages arrive; the pages themselves must not
+for name in site-j8 site-e16 site-e16-p8 site-j4-d0.002-b4 site-e16-rcs50tse.cs.dartmouth.edu=0.002,8 site-e16-f100000 siteclose-j8 siteclose-e16-p8
+do
+    echo "Difference in pages crawled by site-j1 and ${name} [Should be EMPTY]"
+    diff <(for f in ../data/site-j1/[0-9]*; do md5sum < $f; done | sort) \
+         <(for f in ../data/"${name}"/[0-9]*; do md5sum < $f; done | sort)
+done
+kill %1 %2
+wait
+
 exit 0
 
 
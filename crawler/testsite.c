@@ -0,0 +1,270 @@
+/* testsite.c    Kyrylo Bakumenko    24 May, 2023
+ *
+ * A local stand-in for the CS50 web server, for testing the crawler
+ * without the network. Serves a generated site of numPages pages,
+ *   http://cs50tse.cs.dartmouth.edu/tse/site/N.html   for N in 0..numPages-1
+ * on 127.0.0.1:port, to a crawler run with -c 127.0.0.1:port. The pages
+ * form a binary tree: page n links to its children 2n+1 and 2n+2, each
+ * written more than one way (relative and absolute, with and without a
+ * #fragment, quoted and not), and back to its parent and to page 0, plus
+ * an external link and a link to a page that does not exist (a 404).
+ * Every page is thus found first through its parent, at depth
+ * floor(log2(n+1)), however the crawl is ordered: a crawl of maxDepth 10
+ * finds all of up to 2047 pages, the same pages for any number of workers.
+ *
+ * Each connection gets a thread, which answers its requests in turn,
+ * those pipelined included, and keeps it open until the crawler closes it
+ * or asks for Connection: close; with "close", it answers one request per
+ * connection and closes it, as webpage_fetch expects. Even pages, and
+ * 404s, are sent with a Content-Length; odd pages in chunks.
+ *
+ * usage: ./testsite port numPages [close]
+ *
+ * Exit codes: 1 -> invalid arguments
+ *             2 -> cannot listen on the port
+ */
+
+#define _POSIX_C_SOURCE 200809L // sockets
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// where the site lives, as the crawler sees it
+static const char* SITE = "http://cs50tse.cs.dartmouth.edu/tse/site/";
+static const char* SITE_PATH = "/tse/site/";
+
+// largest request read
+static const size_t REQUEST_MAX = 8192;
+
+// the site, read-only once connections are served
+static int numPages;
+static bool closeEach;          // one request per connection
+
+static void* serve(void* arg);
+static bool answer(int fd, char* request);
+static char* page(int n, size_t* len);
+static bool reply(int fd, const char* status, const char* body, size_t len,
+                  const bool chunked, const bool close);
+static bool writeAll(int fd, const char* data, size_t len);
+
+/* ***************************
+ *  main function
+ *  Accepts 2-3 arguments: port, numPages, "close"
+ */
+int main(int argc, char* argv[])
+{
+    int port = 0;
+    if (argc < 3 || argc > 4
+        || (port = atoi(argv[1])) <= 0 || port > 65535
+        || (numPages = atoi(argv[2])) <= 0
+        || (argc == 4 && strcmp(argv[3], "close") != 0)) {
+        fprintf(stderr, "usage: %s port numPages [close]\n", argv[0]);
+        exit(1);
+    }
+    closeEach = argc == 4;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener < 0
+        || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || listen(listener, 128) != 0) {
+        fprintf(stderr, "ERROR: Cannot listen on 127.0.0.1:%d: %s\n", port, strerror(errno));
+        exit(2);
+    }
+    // a crawler gone away shows as a failed write, not a signal
+    signal(SIGPIPE, SIG_IGN);
+
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        // a reply goes out at once, though the last is not yet ACKed
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve, (void*)(intptr_t)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+/**************** serve() ****************/
+/* answers the requests of a connection as they come, then */
+/* closes it                                               */
+static void*
+serve(void* arg)
+{
+    int fd = (int)(intptr_t)arg;
+    char request[REQUEST_MAX + 1];
+    size_t len = 0;
+    bool open = true;
+    while (open && len < REQUEST_MAX) {
+        ssize_t n = read(fd, &request[len], REQUEST_MAX - len);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+        request[len] = '\0';
+        // every request now whole, in order
+        char* end;
+        while (open && (end = strstr(request, "\r\n\r\n")) != NULL) {
+            end[2] = '\0';
+            open = answer(fd, request);
+            end += 4;
+            len -= end - request;
+            memmove(request, end, len + 1);
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+/**************** answer() ****************/
+/* replies to the request, its header NUL-terminated; false */
+/* if the connection is to be closed                        */
+static bool
+answer(int fd, char* request)
+{
+    // Connection: close, in any case
+    bool closing = closeEach;
+    for (char* c = request; *c != '\0'; c++) {
+        *c = tolower((unsigned char)*c);
+    }
+    char* line = strstr(request, "\nconnection:");
+    if (line != NULL) {
+        char* value = line + strlen("\nconnection:");
+        char* word = strstr(value, "close");
+        closing = closing || (word != NULL && word < strchr(value, '\r'));
+    }
+
+    // get /tse/site/n.html
+    char path[REQUEST_MAX + 1];
+    int n = -1;
+    char rest[8];
+    if (sscanf(request, "get %s http/1.", path) == 1
+        && strncmp(path, SITE_PATH, strlen(SITE_PATH)) == 0
+        && sscanf(path + strlen(SITE_PATH), "%d%7s", &n, rest) == 2
+        && strcmp(rest, ".html") == 0 && n >= 0 && n < numPages) {
+        size_t bodyLen;
+        char* body = page(n, &bodyLen);
+        bool sent = body != NULL && reply(fd, "200 OK", body, bodyLen, n % 2 == 1, closing);
+        free(body);
+        return sent && !closing;
+    }
+    const char* missing = "<html><body>Not Found</body></html>\n";
+    return reply(fd, "404 Not Found", missing, strlen(missing), false, closing) && !closing;
+}
+
+/**************** page() ****************/
+/* the HTML of page n, malloc'd, and its length */
+static char*
+page(int n, size_t* len)
+{
+    size_t cap = 2048;
+    char* html = malloc(cap);
+    if (html == NULL) {
+        *len = 0;
+        return NULL;
+    }
+    size_t at = snprintf(html, cap,
+                         "<html>\n<head><title>Page %d</title></head>\n<body>\n"
+                         "<p>Stand-in page number %d of %d, for the crawler tests.</p>\n",
+                         n, n, numPages);
+    // children, each twice over
+    int left = 2 * n + 1;
+    int right = 2 * n + 2;
+    if (left < numPages) {
+        at += snprintf(&html[at], cap - at,
+                       "<a href=\"%d.html\">left</a>\n"
+                       "<a class=\"x\" href=%d.html>left again</a>\n",
+                       left, left);
+    }
+    if (right < numPages) {
+        at += snprintf(&html[at], cap - at,
+                       "<A HREF=\"%s%d.html#top\">right</A>\n"
+                       "<a href=\"./%d.html\">right again</a>\n",
+                       SITE, right, right);
+    }
+    // pages already seen, then pages not to be crawled
+    at += snprintf(&html[at], cap - at,
+                   "<a href=\"%d.html\">up</a>\n<a href=\"%s0.html\">home</a>\n"
+                   "<a href=\"http://www.example.com/\">elsewhere</a>\n"
+                   "<a href=\"%d.html\">missing</a>\n</body>\n</html>\n",
+                   (n - 1) / 2, SITE, numPages + n);
+    *len = at;
+    return html;
+}
+
+/**************** reply() ****************/
+/* writes a response with body, in chunks if chunked, saying */
+/* Connection: close if closing; false if the write fails    */
+static bool
+reply(int fd, const char* status, const char* body, size_t len,
+      const bool chunked, const bool closing)
+{
+    // the header, then the body, in chunks of 100 bytes and a last of
+    // none, each with a line of its size in hex and a CRLF after
+    size_t cap = 256 + len + (len / 100 + 1) * 16;
+    char* response = malloc(cap);
+    if (response == NULL) {
+        return false;
+    }
+    size_t at = snprintf(response, cap, "HTTP/1.1 %s\r\nContent-Type: text/html\r\n", status);
+    if (chunked) {
+        at += snprintf(&response[at], cap - at, "Transfer-Encoding: chunked\r\n");
+    } else {
+        at += snprintf(&response[at], cap - at, "Content-Length: %zu\r\n", len);
+    }
+    at += snprintf(&response[at], cap - at, "%s\r\n", closing ? "Connection: close\r\n" : "");
+    if (!chunked) {
+        memcpy(&response[at], body, len);
+        at += len;
+    } else {
+        for (size_t done = 0; done < len; done += 100) {
+            size_t size = len - done < 100 ? len - done : 100;
+            at += snprintf(&response[at], cap - at, "%zx\r\n", size);
+            memcpy(&response[at], body + done, size);
+            at += size;
+            at += snprintf(&response[at], cap - at, "\r\n");
+        }
+        at += snprintf(&response[at], cap - at, "0\r\n\r\n");
+    }
+    bool sent = writeAll(fd, response, at);
+    free(response);
+    return sent;
+}
+
+/**************** writeAll() ****************/
+/* writes all len bytes of data; false if that fails */
+static bool
+writeAll(int fd, const char* data, size_t len)
+{
+    for (size_t sent = 0; sent < len; ) {
+        ssize_t n = write(fd, data + sent, len - sent);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
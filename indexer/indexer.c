@@ -5,8 +5,21 @@
  * indexer reads all output files and creates an index with
  * word keys, and a counter item stating how many times the word
  * has appeared in that specific file.
+ *
+ * It also writes a document table, pageDirectory/.docs, recording the
+ * URL, depth and size of each page for the querier (see doctable.h).
+ *
+ * With -j N, N threads index the pages: each claims the next docID from
+ * a shared counter and adds the page to its own partial index, and the
+ * partial indexes are merged (index_merge) once every page is read.
+ *
+ * With -m MB, the index is kept within about MB megabytes: whenever it
+ * grows past that, it is written to a sorted run file next to
+ * indexFilename and emptied, and at the end the runs are merged into
+ * indexFilename (index_mergeRuns). Peak memory and the number of runs
+ * are reported on stdout.
  * 
- * Exit codes: 1 -> invalid number of arguments
+ * Exit codes: 1 -> invalid number of arguments, or invalid option
  *             2 -> one or more arguments are null
  *             3 -> directory path is not valid
  *             4 -> provided directory is not a crawler directory
@@ -14,28 +27,112 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <ctype.h>
 #include <string.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include "index.h"
-#include "webpage.h"
-#include "file.h"
+#include "doctable.h"
+#include "pagedir.h"
+#include "token.h"
 #include "mem.h"
 
+// a page's entry for the document table, kept until pages are in order
+typedef struct docinfo {
+    char* url;                  // NULL if the page could not be read
+    int depth;
+    size_t length;
+} docinfo_t;
+
+// the pages shared by indexing threads
+typedef struct indexjob {
+    char* pageDirectory;
+    int numDocs;
+    atomic_int nextDoc;         // the next docID to claim
+    docinfo_t* infos;           // infos[docID - 1], written by its thread
+} indexjob_t;
+
+// one indexing thread and its partial index
+typedef struct indexworker {
+    pthread_t thread;
+    index_t* index;
+    indexjob_t* job;
+} indexworker_t;
+
+// a page file read whole; buf is reused for every page a thread loads
+typedef struct pagefile {
+    char* buf;                  // the file, NUL-terminated, its header split in place
+    size_t cap;                 // bytes allocated for buf
+    size_t length;              // the file's size
+    char* url;                  // the first line, in buf
+    int depth;                  // the second line
+    char* html;                 // the rest of the file, in buf
+} pagefile_t;
+
+// the runs written when the index outgrows its memory budget
+typedef struct runset {
+    char* indexFilename;        // run r is indexFilename.r.run
+    size_t budget;              // largest index_memory before a run
+    int numRuns;
+    size_t peak;                // largest index_memory seen
+} runset_t;
+
 // internal function prototypes
-static void indexBuild(index_t* index, char* pageDirectory);
-static void indexPage(index_t* index, webpage_t* page, int docID);
+static void indexBuild(index_t* index, doctable_t* docs, char* pageDirectory, int numThreads, runset_t* runs);
+static void indexBuildParallel(index_t* index, doctable_t* docs, char* pageDirectory, int numThreads);
+static void* indexWorker(void* arg);
+static bool pageLoad(char* pageDirectory, int docID, pagefile_t* page);
+static void pageFree(pagefile_t* page);
+static void indexPage(index_t* index, const char* html, int docID);
+static void runCheck(index_t* index, runset_t* runs);
+static void runWrite(index_t* index, runset_t* runs);
+static char* runName(runset_t* runs, int run);
+static void runsFinish(index_t* index, runset_t* runs, int numDocs);
 
 /* ***************************
  *  main function
  *  Accepts 2 arguments: (pageDirectory indexFilename)
+ *  optionally preceded by -j N, the number of indexing threads,
+ *  or by -m MB, a memory budget for the index in megabytes
  *  creates an index from pageDirectory
  *  writes inverted index into indexFilenmae
  */
 int main(int argc, char *argv[])
 {
     /* parse the command line, validate parameters */ 
+    int numThreads = 1;
+    double budgetMB = 0;
+    while (argc > 1 && argv[1] != NULL && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-j") == 0) {
+            if (argc < 3 || argv[2] == NULL || (numThreads = atoi(argv[2])) <= 0) {
+                fprintf(stderr, "ERROR: -j expects a positive number of threads\n");
+                exit(1);
+            }
+            argc--;
+            argv++;
+        } else if (strcmp(argv[1], "-m") == 0) {
+            if (argc < 3 || argv[2] == NULL || (budgetMB = atof(argv[2])) <= 0) {
+                fprintf(stderr, "ERROR: -m expects a positive number of megabytes\n");
+                exit(1);
+            }
+            argc--;
+            argv++;
+        } else {
+            fprintf(stderr, "ERROR: unknown option %s\n", argv[1]);
+            exit(1);
+        }
+        argc--;
+        argv++;
+    }
+    if (budgetMB > 0 && numThreads > 1) {
+        fprintf(stderr, "ERROR: -m cannot be combined with -j\n");
+        exit(1);
+    }
     // check num parameters
     if (argc != 3) {
         fprintf(stderr, "ERROR: Expected 2 arguments but recieved %d\n", argc-1);
@@ -57,10 +154,24 @@ int main(int argc, char *argv[])
     char* indexFilename = argv[2];
     /* creates a new 'index' object */ 
     index = index_new(200);
-    indexBuild(index, pageDirectory);
+    doctable_t* docs = doctable_new();
+    runset_t runs = { indexFilename, budgetMB * 1024 * 1024, 0, 0 };
+    indexBuild(index, docs, pageDirectory, numThreads, budgetMB > 0 ? &runs : NULL);
+
+    /* record each docID's URL for the querier; it can do without */
+    if (!doctable_save(docs, pageDirectory)) {
+        fprintf(stderr, "WARNING: Cannot write document table to %s\n", pageDirectory);
+    }
+    int numDocs = doctable_size(docs);
+    doctable_delete(docs);
 
     /* create a file indexFilename and write the index to that file, in the format described below. */
-    index_save(index, indexFilename);
+    if (budgetMB > 0) {
+        // merges the runs, if the index ever outgrew the budget
+        runsFinish(index, &runs, numDocs);
+    } else {
+        index_save(index, indexFilename);
+    }
     index_delete(index);
     mem_free(index);
 
@@ -72,16 +183,15 @@ int main(int argc, char *argv[])
 /* For every output file from pageDirectory (crawled dircetory),    */
 /* extracts url, depth, and html data, creates a webpage            */
 /* pass this into indexPage for indexing of word data               */
+/* and records url, depth, and size in the document table           */
+/* with more than one thread, the pages are shared among them       */
+/* with runs, the index is written out to a run and    */
+/* emptied whenever it outgrows the memory budget       */
 static void
-indexBuild(index_t* index, char* pageDirectory)
+indexBuild(index_t* index, doctable_t* docs, char* pageDirectory, int numThreads, runset_t* runs)
 {
-    // ASSUMPTION, docID is less than 10^19, this is a purposeful overestimate of the number of files possible in a directory 
-    int docID = 1;
-    static int const DOC_ID_MAX_LEN = 20;
-    char docString[DOC_ID_MAX_LEN];
-    char* filePath = mem_malloc(strlen(pageDirectory) + DOC_ID_MAX_LEN + 1);
     FILE* fp;
-    webpage_t* page;
+    char* filePath = mem_malloc(strlen(pageDirectory) + strlen("/.crawler") + 1);
     // check if this is a crawler directory
     strcpy(filePath, pageDirectory);
     DIR* dir = opendir(filePath);
@@ -101,110 +211,307 @@ indexBuild(index_t* index, char* pageDirectory)
         exit(4);
     }
     fclose(fp);
+    mem_free(filePath);
 
-    // initialize filePath from directory and docID
-    strcpy(filePath, pageDirectory);
-    strcat(filePath, "/");
-    sprintf(docString, "%d", docID);
-    strcat(filePath, docString);
+    if (numThreads > 1) {
+        indexBuildParallel(index, docs, pageDirectory, numThreads);
+        return;
+    }
+
+    // pages 1..numDocs, as listed by the crawl manifest; without
+    // one (-1), read pages until a page file is missing
+    int numDocs = pagedir_count(pageDirectory);
 
     /* loops over document ID numbers, counting from 1               */
-    while ((fp = fopen(filePath, "r")) != NULL) {
+    pagefile_t page = { NULL, 0 };
+    for (int docID = 1; numDocs < 0 || docID <= numDocs; docID++) {
         /* loads a webpage from the document file 'pageDirectory/id' */
-        // find number of chars in file
-        // assumption, less than that of MAX_INT
-        int numChars = 0;
-        while (fgetc(fp) != EOF) {
-            numChars++;
+        if (!pageLoad(pageDirectory, docID, &page)) {
+            break;
         }
-        // rewind stream to start
-        rewind(fp);
-
-        // save url from file
-        char* url;
-        if (!feof(fp)) {
-            url = file_readLine(fp);
-            if (url == NULL) {
-                // variable cleanup
-                mem_free(filePath);
-                fclose(fp);
-                exit(1);
-            }
-            // dont mem_free, should be cleared by webpage
+        doctable_add(docs, docID, page.url, page.depth, page.length);
+        /* if successful, passes the html and docID to indexPage */
+        indexPage(index, page.html, docID);
+        runCheck(index, runs);
+    } 
+    pageFree(&page);
+}
+
+/**************** indexBuildParallel() ****************/
+/* indexes pages 1..numDocs with numThreads threads,     */
+/* each into a partial index, then merges them in index  */
+/* as with one thread, pages after a missing page are    */
+/* left out                                              */
+static void
+indexBuildParallel(index_t* index, doctable_t* docs, char* pageDirectory, int numThreads)
+{
+    indexjob_t job;
+    job.pageDirectory = pageDirectory;
+    job.numDocs = num_docs_crawled(pageDirectory);
+    atomic_init(&job.nextDoc, 1);
+    job.infos = mem_calloc_assert(job.numDocs + 1, sizeof(docinfo_t), "docinfos");
+
+    // the tokenizer and the postings decoder pick their kernels once,
+    // before the threads share them
+    token_kernel();
+    index_decoder();
+    indexworker_t* workers = mem_malloc_assert(numThreads * sizeof(indexworker_t), "workers");
+    int numWorkers = 0;
+    for (int t = 0; t < numThreads; t++) {
+        workers[t].index = index_new(200);
+        workers[t].job = &job;
+        if (pthread_create(&workers[t].thread, NULL, indexWorker, &workers[t]) != 0) {
+            // run with the threads we have
+            index_delete(workers[t].index);
+            mem_free(workers[t].index);
+            break;
         }
-        // save depth from file
-        int depth;
-        char* line;
-        if (!feof(fp)) {
-            line = file_readLine(fp);
-            if (line == NULL) {
-                // variable cleanup
-                mem_free(filePath);
-                fclose(fp);
-                exit(1);
-            }
-            sscanf(line, "%d", &depth);
-            mem_free(line);
+        numWorkers++;
+    }
+    if (numWorkers == 0) {
+        fprintf(stderr, "ERROR: Cannot start indexing threads\n");
+        exit(1);
+    }
+    index_t* parts[numWorkers];
+    for (int t = 0; t < numWorkers; t++) {
+        pthread_join(workers[t].thread, NULL);
+        parts[t] = workers[t].index;
+    }
+
+    // the table is built in docID order, up to the first missing page
+    int lastDoc = 0;
+    while (lastDoc < job.numDocs && job.infos[lastDoc].url != NULL) {
+        docinfo_t* info = &job.infos[lastDoc];
+        lastDoc++;
+        doctable_add(docs, lastDoc, info->url, info->depth, info->length);
+    }
+    for (int d = 0; d < job.numDocs; d++) {
+        if (job.infos[d].url != NULL) {
+            mem_free(job.infos[d].url);
         }
-        // save HTML from file
-        char* html = mem_malloc(numChars - strlen(url) + 1);
-        strcpy(html, "");
-        while (!feof(fp)) {
-            line = file_readLine(fp);
-            if (line != NULL) {
-                strcat(html, line);
-                mem_free(line);
-            } 
+    }
+    mem_free(job.infos);
+
+    if (lastDoc > 0) {
+        index_merge(index, parts, numWorkers, lastDoc);
+    }
+    for (int t = 0; t < numWorkers; t++) {
+        index_delete(parts[t]);
+        mem_free(parts[t]);
+    }
+    mem_free(workers);
+}
+
+/**************** indexWorker() ****************/
+/* indexes pages into its own index, claiming docIDs */
+/* one at a time until every page is taken           */
+static void*
+indexWorker(void* arg)
+{
+    indexworker_t* worker = arg;
+    indexjob_t* job = worker->job;
+    int docID;
+    pagefile_t page = { NULL, 0 };
+    while ((docID = atomic_fetch_add(&job->nextDoc, 1)) <= job->numDocs) {
+        if (!pageLoad(job->pageDirectory, docID, &page)) {
+            continue;
         }
+        // each docID is claimed by exactly one thread
+        docinfo_t* info = &job->infos[docID - 1];
+        info->url = mem_malloc_assert(strlen(page.url) + 1, "url");
+        strcpy(info->url, page.url);
+        info->depth = page.depth;
+        info->length = page.length;
+        indexPage(worker->index, page.html, docID);
+    }
+    pageFree(&page);
+    return NULL;
+}
 
-        // generate webpage_t from URL, depth, and HTML
-        page = webpage_new(url, depth, html);
-        /* if successful, passes the webpage and docID to indexPage */
-        indexPage(index, page, docID);
-        // delete webpage
-        webpage_delete(page);
-
-        // loop to next docID
-        docID++;
-        strcpy(filePath, pageDirectory);
-        strcat(filePath, "/");
-        sprintf(docString, "%d", docID);
-        strcat(filePath, docString);
-        fclose(fp);
-    } 
+/**************** pageLoad() ****************/
+/* reads the page file 'pageDirectory/docID' with one read   */
+/* into page's buffer, growing it only for a larger file,    */
+/* then splits its url and depth lines off in place; the     */
+/* html is the rest of the file, newlines and all            */
+/* returns false if there is no such file                    */
+static bool
+pageLoad(char* pageDirectory, int docID, pagefile_t* page)
+{
+    // ASSUMPTION, docID is less than 10^19, this is a purposeful overestimate of the number of files possible in a directory 
+    static int const DOC_ID_MAX_LEN = 20;
+    char filePath[strlen(pageDirectory) + DOC_ID_MAX_LEN + 2];
+    sprintf(filePath, "%s/%d", pageDirectory, docID);
+    int fd = open(filePath, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
 
-    mem_free(filePath);
+    size_t size = st.st_size;
+    if (size + 1 > page->cap) {
+        size_t cap = page->cap == 0 ? 65536 : page->cap;
+        while (cap < size + 1) {
+            cap *= 2;
+        }
+        if (page->buf != NULL) {
+            mem_free(page->buf);
+        }
+        page->buf = mem_malloc_assert(cap, "page");
+        page->cap = cap;
+    }
+    // one read, unless the kernel returns less
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, &page->buf[got], size - got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    close(fd);
+    page->buf[got] = '\0';
+    page->length = size;
+
+    // url and depth lines, NUL-terminated where their newlines were
+    page->url = page->buf;
+    char* eol = strchr(page->url, '\n');
+    char* rest = &page->buf[got];
+    if (eol != NULL) {
+        *eol = '\0';
+        rest = eol + 1;
+    }
+    page->depth = atoi(rest);
+    eol = strchr(rest, '\n');
+    page->html = eol != NULL ? eol + 1 : &page->buf[got];
+    return true;
+}
+
+/**************** pageFree() ****************/
+/* frees the buffer of pageLoad */
+static void
+pageFree(pagefile_t* page)
+{
+    if (page->buf != NULL) {
+        mem_free(page->buf);
+        page->buf = NULL;
+        page->cap = 0;
+    }
 }
 
 /**************** indexPage() ****************/
 /* Scans html data, creating an inverted index linking found words to counters                     */
 /* The counters has the docID for the scan page as a key and the number of occurences as the item. */
+/* Words are views into the html, lowercased into one scratch buffer: nothing is allocated per word */
 static void
-indexPage(index_t* index, webpage_t* page, int docID)
+indexPage(index_t* index, const char* html, int docID)
 {
-    char* word;
-    int pos = 0;
+    scratch_t scratch = { NULL, 0 };
+    token_t token;
+    size_t pos = 0;
     /* steps through each word of the webpage, */
-    // allocs memory for new word
-    while((word = webpage_getNextWord(page, &pos)) != NULL) {
+    while (token_next(html, &pos, &token)) {
         /* skips trivial words (less than length 3), */
-        if (strlen(word) < 3) {
-            free(word);
+        if (token.len < 3) {
             continue;
         }
         /* normalizes the word (converts to lower case), */
-        // adjust word to lowercase
-        char* ptr = word;
-        // iterate char* pointer to lower every character
-        while (*ptr) {
-            *ptr = tolower(*ptr);
-            ptr++;
+        char* word = token_lower(&token, &scratch);
+        if (word == NULL) {
+            fprintf(stderr, "ERROR: Out of memory indexing page %d\n", docID);
+            exit(1);
         }
         /* looks up the word in the index */
         // word count for docID is incremented if already present
-        // counters_t* is created for word key with docID if absent
+        // postings are created for word key with docID if absent
         index_add(index, word, docID);
-        // free word
-        mem_free(word);
+    }
+    token_free(&scratch);
+}
+
+/**************** runCheck() ****************/
+/* writes the index to a new run if it has outgrown */
+/* the budget; does nothing if runs is NULL         */
+static void
+runCheck(index_t* index, runset_t* runs)
+{
+    if (runs == NULL) {
+        return;
+    }
+    size_t memory = index_memory(index);
+    if (memory > runs->peak) {
+        runs->peak = memory;
+    }
+    if (memory > runs->budget) {
+        runWrite(index, runs);
+    }
+}
+
+/**************** runWrite() ****************/
+/* writes the index, sorted by word, to the next run */
+/* file, then empties it                             */
+static void
+runWrite(index_t* index, runset_t* runs)
+{
+    runs->numRuns++;
+    char* run = runName(runs, runs->numRuns);
+    index_saveBinary(index, run);
+    mem_free(run);
+    index_clear(index);
+}
+
+/**************** runName() ****************/
+/* returns indexFilename.run.run, to be mem_free'd */
+static char*
+runName(runset_t* runs, int run)
+{
+    static int const RUN_MAX_LEN = 32;
+    char* name = mem_malloc_assert(strlen(runs->indexFilename) + RUN_MAX_LEN, "run name");
+    sprintf(name, "%s.%d.run", runs->indexFilename, run);
+    return name;
+}
+
+/**************** runsFinish() ****************/
+/* writes indexFilename: from the index, if no run  */
+/* was needed, else by merging the runs (the index  */
+/* holding the last); removes the runs and reports  */
+/* peak memory and the number of runs on stdout     */
+static void
+runsFinish(index_t* index, runset_t* runs, int numDocs)
+{
+    bool ok = true;
+    if (runs->numRuns == 0) {
+        index_save(index, runs->indexFilename);
+    } else {
+        if (index_memory(index) > 0) {
+            runWrite(index, runs);
+        }
+        // there may be thousands of runs: too many for the stack
+        char** names = mem_malloc_assert(runs->numRuns * sizeof(char*), "run names");
+        for (int r = 0; r < runs->numRuns; r++) {
+            names[r] = runName(runs, r + 1);
+        }
+        ok = index_mergeRuns(names, runs->numRuns, runs->indexFilename);
+        for (int r = 0; r < runs->numRuns; r++) {
+            remove(names[r]);
+            mem_free(names[r]);
+        }
+        mem_free(names);
+    }
+
+    // ru_maxrss is in kilobytes on Linux
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Indexed %d pages in %d runs: peak index memory %.1f MiB (budget %.1f MiB), peak RSS %.1f MiB\n",
+           numDocs, runs->numRuns, runs->peak / 1048576.0, runs->budget / 1048576.0,
+           usage.ru_maxrss / 1024.0);
+    if (!ok) {
+        exit(1);
     }
 }
@@ -5,25 +5,38 @@
  * and verify expected behaviour by recreating another file from that read index. 
  * The expectation is that the two files, once sorted, are identical.
  *
+ * With -b or -t it instead converts between formats: the old index
+ * (text or binary, detected from the file) is written to the new file
+ * in binary (-b) or text (-t) format.
+ *
  * Exit codes: 1 -> invalid number of arguments
  *             2 -> one or more arguments are null
  *             3 -> file cannot be read from or written to
  */
 
 #include <stdio.h>
-#include "index.c"
+#include <string.h>
+#include "index.h"
 #include "file.h"
 
 // internal function prototypes
 
 /* ***************************
- *  executed with syntax: ./indextest oldIndexFilename newIndexFilename
+ *  executed with syntax: ./indextest [-b|-t] oldIndexFilename newIndexFilename
  *  testing module for indexer, recreates inverted index file from
  *  oldIndexFilename and writes it to newIndexFilename.
+ *  -b writes the binary format, -t (the default) the text format.
  */
 int main(int argc, char *argv[])
 {
     /* parse the command line, validate parameters */ 
+    // optional format flag
+    bool binary = false;
+    if (argc == 4 && (strcmp(argv[1], "-b") == 0 || strcmp(argv[1], "-t") == 0)) {
+        binary = (strcmp(argv[1], "-b") == 0);
+        argc--;
+        argv++;
+    }
     // check num parameters
     if (argc != 3) {
         fprintf(stderr, "ERROR: Expected 2 arguments but recieved %d\n", argc-1);
@@ -39,25 +52,36 @@ int main(int argc, char *argv[])
     char* oldIndexFilename = argv[1];
     char* newIndexFilename = argv[2];
 
-    // initiate index from num of lines in file
     index_t* index = NULL;
-    FILE* fp;
-    if ((fp = fopen(oldIndexFilename, "r")) == NULL) {
-        fprintf(stderr, "ERROR: Cannot open file %s\n", oldIndexFilename);
+    if (index_isBinary(oldIndexFilename)) {
+        /* map binary index from oldIndexFilename */
+        if ((index = index_map(oldIndexFilename)) == NULL) {
+            fprintf(stderr, "ERROR: Cannot map index file %s\n", oldIndexFilename);
+            exit(3);
+        }
+    } else {
+        // initiate index from num of lines in file
+        FILE* fp;
+        if ((fp = fopen(oldIndexFilename, "r")) == NULL) {
+            fprintf(stderr, "ERROR: Cannot open file %s\n", oldIndexFilename);
+            exit(3);
+        }
+        // if succesful, determine length of file
+        const int size = file_numLines(fp);
         fclose(fp);
-        exit(3);
+        // initialize index to length of file (same as num of words)
+        index = index_new(size > 0 ? size : 1);
+
+        /* load index from oldIndexFilename*/
+        index_load(index, oldIndexFilename);
     }
-    // if succesful, determine length of file
-    const int size = file_numLines(fp);
-    fclose(fp);
-    // initialize index to length of file (same as num of words)
-    index = index_new(size);
-    
-    /* load index from oldIndexFilename*/
-    index_load(index, oldIndexFilename);
 
     /* writes index to newIndexFilename */
-    index_save(index, newIndexFilename);
+    if (binary) {
+        index_saveBinary(index, newIndexFilename);
+    } else {
+        index_save(index, newIndexFilename);
+    }
     index_delete(index);
     mem_free(index);
 
@@ -55,6 +55,13 @@ chmod -w ../data/letters-1/index.ndx
 chmod +w ../data/letters-1/index.ndx
 rm ../data/letters-1/index.ndx
 
+# invalid -j
+echo -e "\ntesting with invalid -j"
+./indexer -j 0 ../data/letters-1 ../data/letters-1/index.ndx
+./indexer -j ../data/letters-1 ../data/letters-1/index.ndx
+./indexer -m 0 ../data/letters-1 ../data/letters-1/index.ndx
+./indexer -m 1 -j 2 ../data/letters-1 ../data/letters-1/index.ndx
+
 ### Test indexer ons everal valid pageDirectories, validated by indextest ###
 echo -e "\ntesting on pageDirectory ../data/letters-1 ..."
 ./indexer ../data/letters-1 ../data/letters-1/index.ndx
@@ -69,6 +76,31 @@ fi
 # cleanup
 rm ../data/letters-1/index.ndx ../data/letters-1/index_new.ndx
 
+# several threads must build the same index as one
+echo -e "\ntesting on pageDirectory ../data/letters-2 with -j 4 ..."
+./indexer ../data/letters-2 ../data/letters-2/index.ndx
+./indexer -j 4 ../data/letters-2 ../data/letters-2/index_j4.ndx
+var="$(diff <(sort ../data/letters-2/index.ndx) <(sort ../data/letters-2/index_j4.ndx))"
+if [ -z "$var" ]
+then
+      echo -e "\noutput matches!"
+else
+      echo -e "\nOUTPUT DOES NOT MATCH"
+fi
+rm ../data/letters-2/index_j4.ndx
+
+# a tiny memory budget spills runs that are merged into the same index
+echo -e "\ntesting on pageDirectory ../data/letters-2 with -m 0.01 ..."
+./indexer -m 0.01 ../data/letters-2 ../data/letters-2/index_m.ndx
+var="$(diff <(sort ../data/letters-2/index.ndx) <(sort ../data/letters-2/index_m.ndx))"
+if [ -z "$var" ]
+then
+      echo -e "\noutput matches!"
+else
+      echo -e "\nOUTPUT DOES NOT MATCH"
+fi
+rm ../data/letters-2/index.ndx ../data/letters-2/index_m.ndx
+
 echo -e "\ntesting on pageDirectory ../data/letters-2 ..."
 ./indexer ../data/letters-2 ../data/letters-2/index.ndx
 ./indextest ../data/letters-2/index.ndx ../data/letters-2/index_new.ndx
@@ -95,6 +127,37 @@ fi
 # cleanup
 rm ../data/letters-3/index.ndx ../data/letters-3/index_new.ndx
 
+# words on either side of a newline stay separate words
+echo -e "\ntesting words across lines on a one-page pageDirectory ..."
+mkdir -p ../data/lines-0
+touch ../data/lines-0/.crawler
+printf 'http://localhost/lines.html\n0\n<p>first\nsecond\n</p>third\n' > ../data/lines-0/1
+./indexer ../data/lines-0 ../data/lines-0/index.ndx
+var="$(diff <(sort ../data/lines-0/index.ndx) <(printf 'first 1 1\nsecond 1 1\nthird 1 1\n'))"
+if [ -z "$var" ]
+then
+      echo -e "\noutput matches!"
+else
+      echo -e "\nOUTPUT DOES NOT MATCH"
+fi
+# cleanup
+rm -r ../data/lines-0
+
+### Test conversion between text and binary index formats ###
+echo -e "\ntesting binary round trip on pageDirectory ../data/letters-3 ..."
+./indexer ../data/letters-3 ../data/letters-3/index.ndx
+./indextest -b ../data/letters-3/index.ndx ../data/letters-3/index.idx
+./indextest -t ../data/letters-3/index.idx ../data/letters-3/index_new.ndx
+var="$(diff <(sort ../data/letters-3/index.ndx) <(sort ../data/letters-3/index_new.ndx))"
+if [ -z "$var" ]
+then
+      echo -e "\noutput matches!"
+else
+      echo -e "\nOUTPUT DOES NOT MATCH"
+fi
+# cleanup
+rm ../data/letters-3/index.ndx ../data/letters-3/index.idx ../data/letters-3/index_new.ndx
+
 ### Run valgrind on both indexer and indextest to ensure no memory leaks or errors ###
 echo -e "\nrunning valgrind in indexer to check for memory leaks"
 valgrind --leak-check=full --show-leak-kinds=all -s ./indexer ../data/letters-1 ../data/letters-1/index.ndx
@@ -0,0 +1,228 @@
+/*
+ * arena.c - CS50 'arena' module
+ *
+ * see arena.h for more information.
+ *
+ * Blocks are mapped with mmap, each starting with a small header that
+ * links it to the arena's other blocks, and are unmapped by arena_delete.
+ * The first block is 256 KiB and each next one twice the last, up to
+ * 16 MiB, so a small arena stays small and a large one needs only a
+ * handful of blocks.  A size class larger than a quarter of the first
+ * block gets a block of its own.
+ *
+ * Sizes are rounded up to a power of two, so a freed piece is exactly the
+ * size of any later request of its class; freed pieces are kept on one
+ * list per class, linked through their first word.
+ *
+ * Kyrylo Bakumenko, May 2023
+ */
+
+#define _DEFAULT_SOURCE       // MAP_ANONYMOUS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "arena.h"
+#include "mem.h"
+
+/**************** file-local global variables ****************/
+static const size_t BLOCK_MIN = 256 * 1024;       // bytes in the first block
+static const size_t BLOCK_MAX = 16 * 1024 * 1024; // largest shared block
+#define MIN_CLASS 4                               // 16 bytes, for alignment
+#define NUM_CLASSES 48
+
+/**************** local types ****************/
+typedef struct block {
+  struct block* next;         // older blocks
+  size_t size;                // bytes mapped, including this header
+} block_t;
+
+typedef struct piece {
+  struct piece* next;         // freed pieces of the same class
+} piece_t;
+
+/**************** global types ****************/
+typedef struct arena {
+  block_t* blocks;            // every block mapped, newest first
+  char* next;                 // next free byte of the newest shared block
+  char* end;                  // end of the newest shared block
+  size_t nextSize;            // size of the next shared block
+  size_t mapped;              // bytes mapped, for arena_size
+  piece_t* freed[NUM_CLASSES];  // freed pieces, by size class
+} arena_t;
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static int arena_class(const size_t size);
+static block_t* arena_map(arena_t* arena, const size_t size);
+
+/**************** arena_new() ****************/
+/* see arena.h for description */
+arena_t*
+arena_new(void)
+{
+  arena_t* arena = mem_malloc(sizeof(arena_t));
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->blocks = NULL;
+  arena->next = NULL;
+  arena->end = NULL;
+  arena->nextSize = BLOCK_MIN;
+  arena->mapped = 0;
+  for (int c = 0; c < NUM_CLASSES; c++) {
+    arena->freed[c] = NULL;
+  }
+  return arena;
+}
+
+/**************** arena_alloc() ****************/
+/* see arena.h for description */
+void*
+arena_alloc(arena_t* arena, const size_t size)
+{
+  if (arena == NULL || size == 0) {
+    return NULL;
+  }
+  int c = arena_class(size);
+  if (c < 0) {
+    return NULL;
+  }
+  // a piece of this class given back earlier
+  piece_t* piece = arena->freed[c];
+  if (piece != NULL) {
+    arena->freed[c] = piece->next;
+    return piece;
+  }
+
+  size_t bytes = (size_t)1 << c;
+  if (bytes > BLOCK_MIN / 4) {
+    // too large to share a block
+    block_t* block = arena_map(arena, sizeof(block_t) + bytes);
+    return block == NULL ? NULL : (char*)block + sizeof(block_t);
+  }
+  if ((size_t)(arena->end - arena->next) < bytes) {
+    // the rest of the current block is left unused
+    block_t* block = arena_map(arena, arena->nextSize);
+    if (block == NULL) {
+      return NULL;
+    }
+    arena->next = (char*)block + sizeof(block_t);
+    arena->end = (char*)block + block->size;
+    if (arena->nextSize < BLOCK_MAX) {
+      arena->nextSize *= 2;
+    }
+  }
+  void* ptr = arena->next;
+  arena->next += bytes;
+  return ptr;
+}
+
+/**************** arena_free() ****************/
+/* see arena.h for description */
+void
+arena_free(arena_t* arena, void* ptr, const size_t size)
+{
+  if (arena == NULL || ptr == NULL || size == 0) {
+    return;
+  }
+  int c = arena_class(size);
+  if (c >= 0) {
+    piece_t* piece = ptr;
+    piece->next = arena->freed[c];
+    arena->freed[c] = piece;
+  }
+}
+
+/**************** arena_join() ****************/
+/* see arena.h for description */
+void
+arena_join(arena_t* arena, arena_t* other)
+{
+  if (arena == NULL || other == NULL || arena == other) {
+    return;
+  }
+  // other's blocks, then ours
+  if (other->blocks != NULL) {
+    block_t* last = other->blocks;
+    while (last->next != NULL) {
+      last = last->next;
+    }
+    last->next = arena->blocks;
+    arena->blocks = other->blocks;
+  }
+  arena->mapped += other->mapped;
+  // other's freed pieces are ours to reuse
+  for (int c = 0; c < NUM_CLASSES; c++) {
+    piece_t* piece = other->freed[c];
+    while (piece != NULL) {
+      piece_t* next = piece->next;
+      piece->next = arena->freed[c];
+      arena->freed[c] = piece;
+      piece = next;
+    }
+  }
+  mem_free(other);
+}
+
+/**************** arena_size() ****************/
+/* see arena.h for description */
+size_t
+arena_size(arena_t* arena)
+{
+  return arena == NULL ? 0 : arena->mapped;
+}
+
+/**************** arena_delete() ****************/
+/* see arena.h for description */
+void
+arena_delete(arena_t* arena)
+{
+  if (arena == NULL) {
+    return;
+  }
+  block_t* block = arena->blocks;
+  while (block != NULL) {
+    block_t* next = block->next;
+    munmap(block, block->size);
+    block = next;
+  }
+  mem_free(arena);
+
+#ifdef MEMTEST
+  mem_report(stdout, "End of arena_delete");
+#endif
+}
+
+/**************** arena_class() ****************/
+/* the size class of size: the power of two, at least 16, that */
+/* holds it; -1 if size is too large for any class             */
+static int
+arena_class(const size_t size)
+{
+  if (size <= ((size_t)1 << MIN_CLASS)) {
+    return MIN_CLASS;
+  }
+  int c = 64 - __builtin_clzll(size - 1);
+  return c < NUM_CLASSES ? c : -1;
+}
+
+/**************** arena_map() ****************/
+/* maps a block of size bytes, including its header, and links */
+/* it into the arena; NULL if out of memory                    */
+static block_t*
+arena_map(arena_t* arena, const size_t size)
+{
+  void* map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  block_t* block = map;
+  block->next = arena->blocks;
+  block->size = size;
+  arena->blocks = block;
+  arena->mapped += size;
+  return block;
+}
@@ -0,0 +1,98 @@
+/*
+ * arena.h - header file for CS50 arena module
+ *
+ * An *arena* hands out memory from large blocks mapped from the system,
+ * bumping a pointer through each, so an allocation costs a few
+ * instructions and no malloc.  Memory is given back all at once, when
+ * the arena is deleted, with one munmap per block; a structure built of
+ * many small allocations can thus be freed without visiting them.
+ *
+ * Memory given back early with arena_free is kept, by size, for reuse
+ * by a later arena_alloc of the same size class; an object that grows
+ * by doubling (a buffer) so reuses what it outgrew.
+ *
+ * The arena itself is allocated with mem_malloc and freed with mem_free,
+ * so an arena that is never deleted shows in mem_net like any other leak.
+ * An arena is not thread-safe: give each thread its own, and join them
+ * (arena_join) once the threads are done.
+ *
+ * Kyrylo Bakumenko, May 2023
+ */
+
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**************** global types ****************/
+typedef struct arena arena_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** arena_new ****************/
+/* Create a new (empty) arena; no block is mapped until the first alloc.
+ *
+ * We return:
+ *   pointer to the new arena; return NULL if error.
+ * Caller is responsible for:
+ *   later calling arena_delete.
+ */
+arena_t* arena_new(void);
+
+/**************** arena_alloc ****************/
+/* Allocate size bytes, aligned for any type, from the arena.
+ *
+ * Caller provides:
+ *   valid arena pointer, size > 0.
+ * We return:
+ *   pointer to uninitialized memory, valid until the arena is deleted;
+ *   NULL if arena is NULL, size is 0, or the system is out of memory.
+ * Notes:
+ *   sizes are rounded up to a power of two (at least 16), the size class,
+ *   so that freed memory can be reused; up to a quarter of a block is
+ *   bumped from the current block, larger sizes get a block of their own.
+ */
+void* arena_alloc(arena_t* arena, const size_t size);
+
+/**************** arena_free ****************/
+/* Give back memory from arena_alloc, for reuse by the arena.
+ *
+ * Caller provides:
+ *   valid arena pointer, ptr returned by arena_alloc(arena, size)
+ *   with the same size; ptr may be NULL.
+ * We do:
+ *   keep the memory for a later arena_alloc of its size class;
+ *   nothing is returned to the system before arena_delete.
+ */
+void arena_free(arena_t* arena, void* ptr, const size_t size);
+
+/**************** arena_join ****************/
+/* Move every block of other into arena, then delete other.
+ *
+ * Caller provides:
+ *   valid arena pointers; other is not used by any other thread.
+ * We do:
+ *   make the memory allocated from other belong to arena, so it stays
+ *   valid until arena is deleted; other is freed and must not be used.
+ */
+void arena_join(arena_t* arena, arena_t* other);
+
+/**************** arena_size ****************/
+/* Return the number of bytes mapped by the arena (0 if arena is NULL);
+ * pages never touched take address space but no memory.
+ */
+size_t arena_size(arena_t* arena);
+
+/**************** arena_delete ****************/
+/* Unmap every block of the arena, and free the arena.
+ *
+ * Caller provides:
+ *   valid arena pointer, or NULL (ignored).
+ * We do:
+ *   return all memory allocated from the arena at once;
+ *   every pointer from arena_alloc becomes invalid.
+ */
+void arena_delete(arena_t* arena);
+
+#endif // __ARENA_H
@@ -2,15 +2,27 @@
  * file utilities - reading a word, line, or entire file
  * 
  * See file.h for documentation.
+ *
+ * Buffers grow by doubling, so reading n characters costs O(log n)
+ * reallocs rather than one per character past the first 80. Lines are
+ * read with getline, whole files with fread and numLines with fread and
+ * memchr, so only file_readUntil, with its arbitrary stopfunc, still
+ * looks at one character at a time.
  * 
  * David Kotz - 2016, 2017, 2019, 2021
  */
 
+#define _POSIX_C_SOURCE 200809L   // getline, getc_unlocked
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <ctype.h>
 #include "file.h"
 
+// bytes read at a time by file_numLines and file_readFileBuf
+static const size_t CHUNK = 65536;
 
 /**************** file_numLines ****************/
 int
@@ -23,9 +35,10 @@ file_numLines(FILE* fp)
   rewind(fp);
 
   int nlines = 0;
-  char c = '\0';
-  while ( (c = fgetc(fp)) != EOF) {
-    if (c == '\n') {
+  char chunk[CHUNK];
+  size_t got;
+  while ( (got = fread(chunk, 1, CHUNK, fp)) > 0) {
+    for (char* c = chunk; (c = memchr(c, '\n', &chunk[got] - c)) != NULL; c++) {
       nlines++;
     }
   }
@@ -38,20 +51,98 @@ file_numLines(FILE* fp)
 /**************** utility stopfuncs ****************/
 // for use with readuntil()
 static int never(int c) { return (0); }
-static int isnewline(int c) { return (c == '\n'); }
 
 /**************** file_readFile ****************/
 /* See file.h for documentation. */
-char* file_readFile(FILE* fp) { return file_readUntil(fp, never); }
+char*
+file_readFile(FILE* fp)
+{
+  char* buf = NULL;
+  size_t cap = 0;
+  size_t len;
+  if (file_readFileBuf(fp, &buf, &cap, &len) == NULL) {
+    free(buf);
+    return NULL;
+  }
+  return buf;
+}
 
 /**************** file_readLine ****************/
 /* See file.h for documentation. */
-char* file_readLine(FILE* fp) { return file_readUntil(fp, isnewline); }
+char*
+file_readLine(FILE* fp)
+{
+  char* buf = NULL;
+  size_t cap = 0;
+  if (file_readLineBuf(fp, &buf, &cap) == NULL) {
+    free(buf);
+    return NULL;
+  }
+  return buf;
+}
 
 /**************** readword ****************/
 /* See file.h for documentation. */
 char* file_readWord(FILE* fp) { return file_readUntil(fp, isspace); }
 
+/**************** file_readLineBuf ****************/
+/* See file.h for documentation. */
+char*
+file_readLineBuf(FILE* fp, char** buf, size_t* cap)
+{
+  if (fp == NULL || buf == NULL || cap == NULL) {
+    return NULL;
+  }
+  ssize_t len = getline(buf, cap, fp);
+  if (len < 0) {
+    return NULL;
+  }
+  if (len > 0 && (*buf)[len - 1] == '\n') {
+    (*buf)[len - 1] = '\0';
+  }
+  return *buf;
+}
+
+/**************** file_readFileBuf ****************/
+/* See file.h for documentation. */
+char*
+file_readFileBuf(FILE* fp, char** buf, size_t* cap, size_t* len)
+{
+  if (fp == NULL || buf == NULL || cap == NULL || len == NULL) {
+    return NULL;
+  }
+
+  size_t pos = 0;
+  while (true) {
+    // room for a chunk and the terminating null
+    if (*buf == NULL || *cap - pos < CHUNK + 1) {
+      size_t newcap = *cap < CHUNK + 1 ? 2 * CHUNK : *cap;
+      while (newcap - pos < CHUNK + 1) {
+        newcap *= 2;
+      }
+      char* newbuf = realloc(*buf, newcap);
+      if (newbuf == NULL) {
+        return NULL;
+      }
+      *buf = newbuf;
+      *cap = newcap;
+    }
+    size_t got = fread(&(*buf)[pos], 1, CHUNK, fp);
+    pos += got;
+    if (got < CHUNK) {
+      break;
+    }
+  }
+
+  if (pos == 0) {
+    // EOF reached without reading anything
+    return NULL;
+  }
+  (*buf)[pos] = '\0';
+  *len = pos;
+  return *buf;
+}
+
 /**************** readuntil ****************/
 /* See file.h for documentation. */
 char* 
@@ -62,22 +153,23 @@ file_readUntil(FILE* fp, int (*stopfunc)(int c))
   }
 
   // allocate buffer big enough for "typical" words/lines
-  int len = 81;
+  size_t len = 81;
   char* buf = malloc(len * sizeof(char));
   if (buf == NULL) {
     return NULL;
   }
 
   // Read characters from file until stop-character or EOF, 
-  // expanding the buffer when needed to hold more.
-  int pos;
-  char c;
-  for (pos = 0; (c = fgetc(fp)) != EOF && !(*stopfunc)(c); pos++) {
+  // doubling the buffer when needed to hold more.
+  size_t pos;
+  int c;
+  for (pos = 0; (c = getc_unlocked(fp)) != EOF && !(*stopfunc)(c); pos++) {
     // We need to save buf[pos+1] for the terminating null
     // and buf[len-1] is the last usable slot, 
     // so if pos+1 is past that slot, we need to grow the buffer.
     if (pos+1 > len-1) {
-      char* newbuf = realloc(buf, ++len * sizeof(char));
+      len *= 2;
+      char* newbuf = realloc(buf, len * sizeof(char));
       if (newbuf == NULL) {
         free(buf);
         return NULL;
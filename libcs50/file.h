@@ -60,4 +60,28 @@ char* file_readLine(FILE* fp);
  */
 char* file_readWord(FILE* fp);
 
+/**************** file_readLineBuf ****************/
+/* 
+ * Read a line from the file, as file_readLine, but into a buffer the
+ * caller reuses from line to line: *buf is a malloc'd buffer of *cap
+ * bytes, or NULL with *cap 0, and is grown (doubling) as needed,
+ * updating *buf and *cap, as with getline(3).
+ * Returns *buf, holding the line with NO newline; NULL if error or
+ * EOF reached without reading a line.
+ * Caller must later free(*buf), whatever was returned.
+ */
+char* file_readLineBuf(FILE* fp, char** buf, size_t* cap);
+
+/**************** file_readFileBuf ****************/
+/* 
+ * Read remainder of the file, as file_readFile, but in large fread
+ * chunks into a buffer the caller may reuse: *buf and *cap as for
+ * file_readLineBuf. *len is set to the number of characters read,
+ * which may include nulls.
+ * Returns *buf, null-terminated; NULL if error or EOF reached
+ * without reading anything.
+ * Caller must later free(*buf), whatever was returned.
+ */
+char* file_readFileBuf(FILE* fp, char** buf, size_t* cap, size_t* len);
+
 #endif // __FILE_H
@@ -3,12 +3,134 @@
  *
  * Implementation details can be found at:
  *     http://www.burtleburtle.net/bob/hash/doobs.html
+ *
+ * hash_bytes follows Wang Yi's wyhash (final version 4, public domain):
+ *     https://github.com/wangyi-fudan/wyhash
+ * It reads 8 bytes at a time and mixes with 64x64->128-bit multiplies,
+ * where hash_jenkins takes a strlen pass and then several dependent
+ * shifts and adds per byte.
  * ========================================================================= 
  */
 
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+
 #include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
 #include "hash.h" 
 
+// 128-bit products; an extension, but in every GCC and Clang for 64-bit targets
+__extension__ typedef unsigned __int128 uint128_t;
+
+// wyhash's default secret
+static const uint64_t S0 = 0xa0761d6478bd642full;
+static const uint64_t S1 = 0xe7037ed1a0b428dbull;
+static const uint64_t S2 = 0x8ebc6af09c88c6e3ull;
+static const uint64_t S3 = 0x589965cc75374cc3ull;
+
+static inline uint64_t
+mix(const uint64_t a, const uint64_t b)
+{
+  uint128_t r = (uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+// unaligned little-endian reads; the hash differs, but works, on big-endian
+static inline uint64_t
+read8(const unsigned char* p)
+{
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t
+read4(const unsigned char* p)
+{
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+// hash_bytes - see header file for usage
+uint64_t
+hash_bytes(const void* ptr, const size_t len, uint64_t seed)
+{
+  const unsigned char* p = ptr;
+  uint64_t a;
+  uint64_t b;
+  seed ^= mix(seed ^ S0, S1);
+
+  if (len <= 16) {
+    if (len >= 4) {
+      // two overlapping pairs of 4-byte reads cover 4..16 bytes
+      size_t skip = (len >> 3) << 2;
+      a = (read4(p) << 32) | read4(p + skip);
+      b = (read4(p + len - 4) << 32) | read4(p + len - 4 - skip);
+    } else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed;
+      uint64_t see2 = seed;
+      do {
+        seed = mix(read8(p) ^ S1, read8(p + 8) ^ seed);
+        see1 = mix(read8(p + 16) ^ S2, read8(p + 24) ^ see1);
+        see2 = mix(read8(p + 32) ^ S3, read8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = mix(read8(p) ^ S1, read8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    // the last 16 bytes, overlapping what came before
+    a = read8(p + i - 16);
+    b = read8(p + i - 8);
+  }
+
+  a ^= S1;
+  b ^= seed;
+  uint128_t r = (uint128_t)a * b;
+  a = (uint64_t)r;
+  b = (uint64_t)(r >> 64);
+  return mix(a ^ S0 ^ len, b ^ S1);
+}
+
+// hash_seed - see header file for usage
+uint64_t
+hash_seed(void)
+{
+  static _Atomic uint64_t seed = 0;
+  uint64_t current = atomic_load(&seed);
+  if (current != 0) {
+    return current;
+  }
+  // from the kernel's random pool, or else the clock and pid
+  uint64_t fresh;
+  if (getrandom(&fresh, sizeof(fresh), 0) != sizeof(fresh)) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    fresh = mix(ts.tv_sec ^ S2, ts.tv_nsec ^ ((uint64_t)getpid() << 32));
+  }
+  fresh |= 1;
+  // the first thread to get here decides
+  if (!atomic_compare_exchange_strong(&seed, &current, fresh)) {
+    return current;
+  }
+  return fresh;
+}
+
 // hash_jenkins - see header file for usage
 unsigned long
 hash_jenkins(const char* str, const unsigned long mod)
@@ -9,6 +9,9 @@
 #ifndef HASH_H
 #define HASH_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /*
  * hash_jenkins - Bob Jenkins' one_at_a_time hash function
  * str: char buffer to hash (non-NULL)
@@ -18,4 +21,24 @@
  */
 unsigned long hash_jenkins(const char* str, const unsigned long mod);
 
+/*
+ * hash_bytes - a wyhash-style hash of len bytes at ptr, read 8 at a time
+ * ptr: bytes to hash (non-NULL if len > 0); need not be NUL-terminated
+ * len: number of bytes
+ * seed: varies the hash; keys that collide under one seed are unlikely
+ *   to under another, so a table with a secret seed cannot be flooded
+ *   with colliding keys chosen in advance
+ *
+ * Returns a full 64-bit hash: take a power-of-two range with a mask,
+ * hash_bytes(...) & (size - 1), rather than a modulus.
+ */
+uint64_t hash_bytes(const void* ptr, const size_t len, uint64_t seed);
+
+/*
+ * hash_seed - a random seed for hash_bytes, chosen once per process
+ *
+ * Returns the same nonzero value on every call.
+ */
+uint64_t hash_seed(void);
+
 #endif // HASH_H
@@ -0,0 +1,315 @@
+/*
+ * hashtable.c - CS50 'hashtable' module
+ *
+ * see hashtable.h for more information.
+ *
+ * This replaces the hashtable of libcs50-given.a, an array of num_slots
+ * sets, each a linked list searched with strcmp, which slows down in
+ * proportion to the number of keys per slot.  Here the table is one
+ * array of slots, open addressing with Robin Hood linear probing, and it
+ * doubles whenever it is 7/8 full, so a probe stays short however many
+ * keys are inserted.  num_slots is taken as the number of keys expected.
+ *
+ * Each slot caches its key's full hash, so probes compare hashes and
+ * call strcmp only on a match, and resizing does not rehash any key.
+ * Keys are hashed with hash_bytes, 8 bytes at a time, under a seed
+ * chosen at random per process (hash_seed), so crawled pages cannot
+ * be crafted to make their words collide; slots are picked by masking
+ * the hash, the table being a power of two.
+ * Key copies are packed into large blocks (a bump allocator), rather
+ * than malloc'd one by one, and freed a block at a time.
+ *
+ * Robin Hood: a key's distance is how far its slot is past the slot its
+ * hash asks for.  Inserting, a key takes the slot of any key nearer to
+ * home than itself, and that key moves on.  So a search can stop at the
+ * first key nearer to home than the probe is, and the distances, thus
+ * the probes, stay short even at high load.
+ *
+ * David Kotz, April 2016, 2017, 2019, 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "hashtable.h"
+#include "hash.h"
+#include "mem.h"
+
+/**************** file-local global variables ****************/
+static const size_t MIN_SLOTS = 8;
+static const size_t KEY_BLOCK = 65536;    // bytes per block of key copies
+
+/**************** local types ****************/
+typedef struct slot {
+  uint64_t hash;              // the key's hash; 0 if the slot is empty
+  const char* key;            // copy of the key, in a key block
+  void* item;                 // pointer to data for this item
+} slot_t;
+
+typedef struct keyblock {
+  struct keyblock* next;      // older blocks
+  size_t used;                // bytes of data handed out
+  size_t size;                // bytes of data
+  char data[];
+} keyblock_t;
+
+/**************** global types ****************/
+typedef struct hashtable {
+  slot_t* slots;              // a power of two of them
+  size_t mask;                // number of slots - 1
+  size_t count;               // number of keys
+  uint64_t seed;              // for hash_bytes
+  keyblock_t* keys;           // the newest block of key copies
+} hashtable_t;
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static uint64_t hashtable_hash(hashtable_t* ht, const char* key, size_t* len);
+static slot_t* hashtable_lookup(hashtable_t* ht, const char* key, const uint64_t hash);
+static void hashtable_place(hashtable_t* ht, slot_t entry);
+static bool hashtable_grow(hashtable_t* ht);
+static const char* hashtable_keycopy(hashtable_t* ht, const char* key, const size_t len);
+
+/**************** hashtable_new() ****************/
+/* see hashtable.h for description */
+hashtable_t*
+hashtable_new(const int num_slots)
+{
+  if (num_slots <= 0) {
+    return NULL;
+  }
+  // room for num_slots keys below the 7/8 load limit
+  size_t slots = MIN_SLOTS;
+  while (slots / 8 * 7 < (size_t)num_slots) {
+    slots *= 2;
+  }
+
+  hashtable_t* ht = mem_malloc(sizeof(hashtable_t));
+  if (ht == NULL) {
+    return NULL;
+  }
+  ht->slots = mem_calloc(slots, sizeof(slot_t));
+  if (ht->slots == NULL) {
+    mem_free(ht);
+    return NULL;
+  }
+  ht->mask = slots - 1;
+  ht->count = 0;
+  ht->seed = hash_seed();
+  ht->keys = NULL;
+  return ht;
+}
+
+/**************** hashtable_insert() ****************/
+/* see hashtable.h for description */
+bool
+hashtable_insert(hashtable_t* ht, const char* key, void* item)
+{
+  if (ht == NULL || key == NULL || item == NULL) {
+    return false;
+  }
+  size_t len;
+  uint64_t hash = hashtable_hash(ht, key, &len);
+  if (hashtable_lookup(ht, key, hash) != NULL) {
+    return false;             // key exists
+  }
+  if (ht->count + 1 > (ht->mask + 1) / 8 * 7 && !hashtable_grow(ht)) {
+    return false;
+  }
+  const char* copy = hashtable_keycopy(ht, key, len);
+  if (copy == NULL) {
+    return false;
+  }
+  slot_t entry = { hash, copy, item };
+  hashtable_place(ht, entry);
+  ht->count++;
+  return true;
+}
+
+/**************** hashtable_find() ****************/
+/* see hashtable.h for description */
+void*
+hashtable_find(hashtable_t* ht, const char* key)
+{
+  if (ht == NULL || key == NULL) {
+    return NULL;
+  }
+  size_t len;
+  slot_t* slot = hashtable_lookup(ht, key, hashtable_hash(ht, key, &len));
+  return slot == NULL ? NULL : slot->item;
+}
+
+/**************** hashtable_print() ****************/
+/* see hashtable.h for description */
+void
+hashtable_print(hashtable_t* ht, FILE* fp,
+                void (*itemprint)(FILE* fp, const char* key, void* item))
+{
+  if (fp == NULL) {
+    return;
+  }
+  if (ht == NULL) {
+    fputs("(null)\n", fp);
+    return;
+  }
+  // a slot holds at most one pair
+  for (size_t i = 0; i <= ht->mask; i++) {
+    slot_t* slot = &ht->slots[i];
+    if (itemprint != NULL && slot->hash != 0) {
+      (*itemprint)(fp, slot->key, slot->item);
+    }
+    fputc('\n', fp);
+  }
+}
+
+/**************** hashtable_iterate() ****************/
+/* see hashtable.h for description */
+void
+hashtable_iterate(hashtable_t* ht, void* arg,
+                  void (*itemfunc)(void* arg, const char* key, void* item) )
+{
+  if (ht == NULL || itemfunc == NULL) {
+    return;
+  }
+  for (size_t i = 0; i <= ht->mask; i++) {
+    slot_t* slot = &ht->slots[i];
+    if (slot->hash != 0) {
+      (*itemfunc)(arg, slot->key, slot->item);
+    }
+  }
+}
+
+/**************** hashtable_delete() ****************/
+/* see hashtable.h for description */
+void
+hashtable_delete(hashtable_t* ht, void (*itemdelete)(void* item) )
+{
+  if (ht == NULL) {
+    return;
+  }
+  if (itemdelete != NULL) {
+    for (size_t i = 0; i <= ht->mask; i++) {
+      if (ht->slots[i].hash != 0) {
+        (*itemdelete)(ht->slots[i].item);
+      }
+    }
+  }
+  // the keys go a block at a time
+  keyblock_t* block = ht->keys;
+  while (block != NULL) {
+    keyblock_t* next = block->next;
+    mem_free(block);
+    block = next;
+  }
+  mem_free(ht->slots);
+  mem_free(ht);
+
+#ifdef MEMTEST
+  mem_report(stdout, "End of hashtable_delete");
+#endif
+}
+
+/**************** hashtable_hash() ****************/
+/* the key's hash, never 0, which marks an empty slot; */
+/* len is set to the key's length, for its copy         */
+static uint64_t
+hashtable_hash(hashtable_t* ht, const char* key, size_t* len)
+{
+  *len = strlen(key);
+  uint64_t hash = hash_bytes(key, *len, ht->seed);
+  return hash == 0 ? 1 : hash;
+}
+
+/**************** hashtable_lookup() ****************/
+/* the slot holding key, or NULL if key is not in the table */
+static slot_t*
+hashtable_lookup(hashtable_t* ht, const char* key, const uint64_t hash)
+{
+  size_t i = hash & ht->mask;
+  for (size_t dist = 0; ; dist++) {
+    slot_t* slot = &ht->slots[i];
+    if (slot->hash == 0) {
+      return NULL;
+    }
+    // a key nearer home than we are means ours would have taken its slot
+    if (((i - slot->hash) & ht->mask) < dist) {
+      return NULL;
+    }
+    if (slot->hash == hash && strcmp(slot->key, key) == 0) {
+      return slot;
+    }
+    i = (i + 1) & ht->mask;
+  }
+}
+
+/**************** hashtable_place() ****************/
+/* puts a key that is not in the table into its Robin Hood slot, */
+/* moving along any nearer-home keys in the way                  */
+static void
+hashtable_place(hashtable_t* ht, slot_t entry)
+{
+  size_t i = entry.hash & ht->mask;
+  for (size_t dist = 0; ; dist++) {
+    slot_t* slot = &ht->slots[i];
+    if (slot->hash == 0) {
+      *slot = entry;
+      return;
+    }
+    size_t theirs = (i - slot->hash) & ht->mask;
+    if (theirs < dist) {
+      slot_t displaced = *slot;
+      *slot = entry;
+      entry = displaced;
+      dist = theirs;
+    }
+    i = (i + 1) & ht->mask;
+  }
+}
+
+/**************** hashtable_grow() ****************/
+/* doubles the slots, placing every key again by its cached hash */
+static bool
+hashtable_grow(hashtable_t* ht)
+{
+  size_t oldSlots = ht->mask + 1;
+  slot_t* old = ht->slots;
+  slot_t* slots = mem_calloc(2 * oldSlots, sizeof(slot_t));
+  if (slots == NULL) {
+    return false;
+  }
+  ht->slots = slots;
+  ht->mask = 2 * oldSlots - 1;
+  for (size_t i = 0; i < oldSlots; i++) {
+    if (old[i].hash != 0) {
+      hashtable_place(ht, old[i]);
+    }
+  }
+  mem_free(old);
+  return true;
+}
+
+/**************** hashtable_keycopy() ****************/
+/* copies key into the newest key block, starting a new */
+/* block when it is full; NULL if out of memory         */
+static const char*
+hashtable_keycopy(hashtable_t* ht, const char* key, size_t len)
+{
+  len++;                      // and its NUL
+  keyblock_t* block = ht->keys;
+  if (block == NULL || block->size - block->used < len) {
+    size_t size = len > KEY_BLOCK ? len : KEY_BLOCK;
+    block = mem_malloc(sizeof(keyblock_t) + size);
+    if (block == NULL) {
+      return NULL;
+    }
+    block->next = ht->keys;
+    block->used = 0;
+    block->size = size;
+    ht->keys = block;
+  }
+  char* copy = &block->data[block->used];
+  memcpy(copy, key, len);
+  block->used += len;
+  return copy;
+}
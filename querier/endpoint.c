@@ -0,0 +1,138 @@
+/* endpoint.c    Kyrylo Bakumenko    16 May, 2023
+ *
+ * Unix domain and loopback TCP sockets for the querier server,
+ * qclient and loadtest. See endpoint.h for documentation.
+ */
+
+#define _POSIX_C_SOURCE 200809L // sockets
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "endpoint.h"
+
+// pending connections the kernel queues for accept
+static const int BACKLOG = 64;
+
+/**************** local functions ****************/
+static int endpoint_port(const char* address);
+static int endpoint_open(const char* address, bool listening);
+
+/**************** endpoint_listen() ****************/
+int
+endpoint_listen(const char* address)
+{
+    return endpoint_open(address, true);
+}
+
+/**************** endpoint_connect() ****************/
+int
+endpoint_connect(const char* address)
+{
+    return endpoint_open(address, false);
+}
+
+/**************** endpoint_close() ****************/
+void
+endpoint_close(const char* address, int fd)
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (address != NULL && endpoint_port(address) < 0) {
+        unlink(address);
+    }
+}
+
+/**************** endpoint_port() ****************/
+/* returns the TCP port of a ":port" address; -1 for a path */
+static int
+endpoint_port(const char* address)
+{
+    static const char* hosts[] = { "", "localhost", "127.0.0.1", NULL };
+    for (int h = 0; hosts[h] != NULL; h++) {
+        size_t len = strlen(hosts[h]);
+        if (strncmp(address, hosts[h], len) == 0 && address[len] == ':') {
+            int port = atoi(&address[len + 1]);
+            return port > 0 && port < 65536 ? port : -1;
+        }
+    }
+    return -1;
+}
+
+/**************** endpoint_open() ****************/
+/* creates a socket for address, then binds and listens */
+/* on it, or connects to it                             */
+static int
+endpoint_open(const char* address, bool listening)
+{
+    if (address == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    int port = endpoint_port(address);
+    struct sockaddr_un unixAddr;
+    struct sockaddr_in tcpAddr;
+    struct sockaddr* addr;
+    socklen_t addrLen;
+    int fd;
+
+    if (port > 0) {
+        memset(&tcpAddr, 0, sizeof(tcpAddr));
+        tcpAddr.sin_family = AF_INET;
+        tcpAddr.sin_port = htons(port);
+        tcpAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr = (struct sockaddr*)&tcpAddr;
+        addrLen = sizeof(tcpAddr);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+    } else {
+        if (strlen(address) >= sizeof(unixAddr.sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memset(&unixAddr, 0, sizeof(unixAddr));
+        unixAddr.sun_family = AF_UNIX;
+        strcpy(unixAddr.sun_path, address);
+        addr = (struct sockaddr*)&unixAddr;
+        addrLen = sizeof(unixAddr);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (!listening) {
+        if (connect(fd, addr, addrLen) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        return fd;
+    }
+
+    if (port > 0) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    } else {
+        // a socket left by a server that did not exit cleanly
+        struct stat st;
+        if (lstat(address, &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(address);
+        }
+    }
+    if (bind(fd, addr, addrLen) != 0 || listen(fd, BACKLOG) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
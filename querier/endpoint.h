@@ -0,0 +1,38 @@
+/*
+ * endpoint.h    Kyrylo Bakumenko    16 May, 2023
+ *
+ * Local stream sockets for the querier server and its clients. An
+ * address is either a filesystem path, for a Unix domain socket, or
+ * ":port" (also "localhost:port" or "127.0.0.1:port") for TCP on the
+ * loopback interface only.
+ */
+
+#ifndef __ENDPOINT_H
+#define __ENDPOINT_H
+
+#include <stdbool.h>
+
+/**************** functions ****************/
+
+/**************** endpoint_listen ****************/
+/* Create a socket listening on address. A stale Unix socket file at
+ * the path is replaced; any other kind of file is left alone.
+ *
+ * We return:
+ *   the listening file descriptor; -1 on error (errno is set).
+ */
+int endpoint_listen(const char* address);
+
+/**************** endpoint_connect ****************/
+/* Connect to a listening address.
+ *
+ * We return:
+ *   the connected file descriptor; -1 on error (errno is set).
+ */
+int endpoint_connect(const char* address);
+
+/**************** endpoint_close ****************/
+/* Close a listening socket, removing its file for a Unix address. */
+void endpoint_close(const char* address, int fd);
+
+#endif // __ENDPOINT_H
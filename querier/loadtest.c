@@ -0,0 +1,245 @@
+/* loadtest.c    Kyrylo Bakumenko    16 May, 2023
+ *
+ * Load test for the querier server (querier -s address). Each of several
+ * threads opens its own connection and, until time is up, sends a batch
+ * of queries (taken in turn from queryFile) in one write, then waits for
+ * all of the batch's responses. Reports queries per second and the
+ * median and 99th percentile latency of a batch.
+ *
+ * usage: ./loadtest address queryFile [connections [seconds [batch]]]
+ *   defaults: 4 connections, 5 seconds, batches of 16 queries
+ *
+ * Exit codes: 1 -> invalid arguments
+ *             2 -> queryFile has no queries, or cannot be read
+ *             3 -> a connection failed
+ */
+
+#define _POSIX_C_SOURCE 200809L // sockets, clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include "endpoint.h"
+#include "file.h"
+#include "mem.h"
+
+// one connection's work and results
+typedef struct worker {
+    pthread_t thread;
+    int id;
+    int numBatches;             // batches answered
+    int capacity;               // latencies allocated
+    double* latencies;          // seconds per batch (malloc'd: mem is not thread-safe)
+    bool failed;
+} worker_t;
+
+// shared by every worker, read-only once they start
+static const char* address;
+static char** queries;
+static int numQueries;
+static int batch = 16;
+static double deadline;
+
+static double now(void);
+static void* worker_run(void* arg);
+static int latency_cmp(const void* a, const void* b);
+
+/* ***************************
+ *  main function
+ *  Accepts 2-5 arguments: address, queryFile, connections, seconds, batch
+ */
+int main(int argc, char* argv[])
+{
+    int connections = 4;
+    double seconds = 5;
+    if (argc < 3 || argc > 6
+        || (argc > 3 && (connections = atoi(argv[3])) <= 0)
+        || (argc > 4 && (seconds = atof(argv[4])) <= 0)
+        || (argc > 5 && (batch = atoi(argv[5])) <= 0)) {
+        fprintf(stderr, "usage: %s address queryFile [connections [seconds [batch]]]\n", argv[0]);
+        exit(1);
+    }
+    address = argv[1];
+
+    // the queries, one per non-empty line
+    FILE* fp = fopen(argv[2], "r");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: Cannot open %s\n", argv[2]);
+        exit(2);
+    }
+    int lines = file_numLines(fp);
+    queries = mem_malloc_assert((lines + 1) * sizeof(char*), "queries");
+    char* line;
+    while ((line = file_readLine(fp)) != NULL) {
+        if (line[0] != '\0' && numQueries < lines + 1) {
+            queries[numQueries++] = line;
+        } else {
+            mem_free(line);
+        }
+    }
+    fclose(fp);
+    if (numQueries == 0) {
+        fprintf(stderr, "ERROR: No queries in %s\n", argv[2]);
+        mem_free(queries);
+        exit(2);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    worker_t* workers = mem_malloc_assert(connections * sizeof(worker_t), "workers");
+    double start = now();
+    deadline = start + seconds;
+    for (int w = 0; w < connections; w++) {
+        memset(&workers[w], 0, sizeof(worker_t));
+        workers[w].id = w;
+        pthread_create(&workers[w].thread, NULL, worker_run, &workers[w]);
+    }
+
+    // gather every batch latency
+    int numBatches = 0;
+    bool failed = false;
+    for (int w = 0; w < connections; w++) {
+        pthread_join(workers[w].thread, NULL);
+        numBatches += workers[w].numBatches;
+        failed = failed || workers[w].failed;
+    }
+    double elapsed = now() - start;
+    double* latencies = mem_malloc_assert((numBatches + 1) * sizeof(double), "latencies");
+    int n = 0;
+    for (int w = 0; w < connections; w++) {
+        memcpy(&latencies[n], workers[w].latencies, workers[w].numBatches * sizeof(double));
+        n += workers[w].numBatches;
+        free(workers[w].latencies);
+    }
+    qsort(latencies, numBatches, sizeof(double), latency_cmp);
+
+    long numAnswered = (long)numBatches * batch;
+    printf("%d connections, batches of %d, %.1f s: %ld queries, %.0f queries/s\n",
+           connections, batch, elapsed, numAnswered, numAnswered / elapsed);
+    if (numBatches > 0) {
+        printf("batch latency: p50 %.1f us   p99 %.1f us   max %.1f us\n",
+               latencies[numBatches / 2] * 1e6,
+               latencies[(int)(numBatches * 0.99)] * 1e6,
+               latencies[numBatches - 1] * 1e6);
+    }
+
+    mem_free(latencies);
+    mem_free(workers);
+    for (int q = 0; q < numQueries; q++) {
+        mem_free(queries[q]);
+    }
+    mem_free(queries);
+    if (failed) {
+        fprintf(stderr, "ERROR: A connection to %s failed\n", address);
+        exit(3);
+    }
+    return 0;
+}
+
+/**************** now() ****************/
+/* wall-clock seconds */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** worker_run() ****************/
+/* sends batches on one connection until the deadline */
+static void*
+worker_run(void* arg)
+{
+    worker_t* worker = arg;
+    int fd = endpoint_connect(address);
+    if (fd < 0) {
+        worker->failed = true;
+        return NULL;
+    }
+
+    // workers start at different queries
+    int next = (worker->id * batch) % numQueries;
+    size_t cap = 4096;
+    char* request = malloc(cap);
+    char response[16384];
+    while (request != NULL && now() < deadline) {
+        // build the batch: one query per line
+        size_t len = 0;
+        for (int b = 0; b < batch; b++) {
+            const char* query = queries[next];
+            next = (next + 1) % numQueries;
+            size_t qlen = strlen(query);
+            if (len + qlen + 1 > cap) {
+                while (len + qlen + 1 > cap) {
+                    cap *= 2;
+                }
+                char* grown = realloc(request, cap);
+                if (grown == NULL) {
+                    worker->failed = true;
+                    break;
+                }
+                request = grown;
+            }
+            memcpy(&request[len], query, qlen);
+            request[len + qlen] = '\n';
+            len += qlen + 1;
+        }
+        if (worker->failed) {
+            break;
+        }
+
+        double start = now();
+        for (size_t sent = 0; sent < len; ) {
+            ssize_t n = write(fd, &request[sent], len - sent);
+            if (n <= 0) {
+                worker->failed = true;
+                break;
+            }
+            sent += n;
+        }
+        // one response line per query
+        int answered = 0;
+        while (!worker->failed && answered < batch) {
+            ssize_t n = read(fd, response, sizeof(response));
+            if (n <= 0) {
+                worker->failed = true;
+                break;
+            }
+            for (char* c = response; (c = memchr(c, '\n', &response[n] - c)) != NULL; c++) {
+                answered++;
+            }
+        }
+        if (worker->failed) {
+            break;
+        }
+
+        if (worker->numBatches == worker->capacity) {
+            worker->capacity = worker->capacity == 0 ? 1024 : 2 * worker->capacity;
+            double* grown = realloc(worker->latencies, worker->capacity * sizeof(double));
+            if (grown == NULL) {
+                worker->failed = true;
+                break;
+            }
+            worker->latencies = grown;
+        }
+        worker->latencies[worker->numBatches++] = now() - start;
+    }
+    free(request);
+    close(fd);
+    return NULL;
+}
+
+/**************** latency_cmp() ****************/
+/* orders latencies increasing, for qsort */
+static int
+latency_cmp(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
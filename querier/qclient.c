@@ -0,0 +1,121 @@
+/* qclient.c    Kyrylo Bakumenko    16 May, 2023
+ *
+ * Client for the querier server (querier -s address). Sends each line of
+ * stdin as a query and prints each response line to stdout, in order.
+ * Queries are pipelined: the client keeps writing while responses come
+ * back, so a file of queries costs one connection and no round trip per
+ * query.
+ *
+ * usage: ./qclient address < queries
+ *   address is a socket path, or :port for loopback TCP
+ *
+ * Exit codes: 1 -> invalid number of arguments
+ *             2 -> cannot connect to address
+ *             3 -> connection lost before every query was answered
+ */
+
+#define _POSIX_C_SOURCE 200809L // sockets, poll
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include "endpoint.h"
+
+// bytes moved per read or write
+static const size_t CHUNK = 16384;
+
+/* ***************************
+ *  main function
+ *  Accepts 1 argument: address
+ */
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s address < queries\n", argv[0]);
+        exit(1);
+    }
+    int fd = endpoint_connect(argv[1]);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Cannot connect to %s: %s\n", argv[1], strerror(errno));
+        exit(2);
+    }
+    // a server gone away shows as a failed write, not a signal
+    signal(SIGPIPE, SIG_IGN);
+
+    // stdin -> socket until EOF, then socket -> stdout until the server closes
+    char in[CHUNK];
+    char out[CHUNK];
+    size_t inLen = 0;       // bytes of in not yet sent
+    size_t inSent = 0;
+    bool inDone = false;
+    bool lost = false;
+    struct pollfd fds[2];
+
+    while (true) {
+        int n = 0;
+        int inSlot = -1;
+        if (!inDone) {
+            // read stdin only once the last read is sent
+            fds[n].fd = inLen == inSent ? STDIN_FILENO : fd;
+            fds[n].events = inLen == inSent ? POLLIN : POLLOUT;
+            inSlot = n++;
+        }
+        fds[n].fd = fd;
+        fds[n].events = POLLIN;
+        int outSlot = n++;
+        if (poll(fds, n, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            lost = true;
+            break;
+        }
+
+        if (inSlot >= 0 && fds[inSlot].revents != 0) {
+            if (inLen == inSent) {
+                ssize_t got = read(STDIN_FILENO, in, CHUNK);
+                if (got <= 0) {
+                    // no more queries; the server answers the rest, then closes
+                    inDone = true;
+                    shutdown(fd, SHUT_WR);
+                } else {
+                    inLen = got;
+                    inSent = 0;
+                }
+            } else {
+                ssize_t sent = write(fd, &in[inSent], inLen - inSent);
+                if (sent < 0 && errno != EINTR) {
+                    lost = true;
+                    break;
+                }
+                inSent += sent > 0 ? sent : 0;
+            }
+        }
+
+        if (fds[outSlot].revents != 0) {
+            ssize_t got = read(fd, out, CHUNK);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                // the server closes only after answering everything sent
+                lost = !inDone || got < 0;
+                break;
+            }
+            fwrite(out, 1, got, stdout);
+        }
+    }
+
+    fflush(stdout);
+    close(fd);
+    if (lost) {
+        fprintf(stderr, "ERROR: Lost connection to %s\n", argv[1]);
+        exit(3);
+    }
+    return 0;
+}
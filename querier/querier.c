@@ -1,43 +1,142 @@
 /* querier.c    Kyrylo Bakumenko    6 May, 2023
  *
  * This file implements the Querier module for the TSE.
+ *
+ * With -k N only the N best-scoring documents of each query are printed,
+ * found by pruned (WAND) evaluation that skips documents which cannot make
+ * the top N; -e evaluates exhaustively instead, for checking the pruning.
+ *
+ * Result URLs come from the document table pageDirectory/.docs written by
+ * the indexer, mapped once at startup; without one, each result's page
+ * file is opened to read its URL.
+ *
+ * With -s address the querier is a server instead: it loads the index
+ * once and answers queries from any number of connections on a Unix
+ * domain socket (address is a path) or loopback TCP (address is :port).
+ * Each request is one query per line; each response is one line of JSON,
+ * in request order, so clients may pipeline and batch their requests.
  * 
- * Exit codes: 1 -> invalid number of arguments
+ * Exit codes: 1 -> invalid number of arguments, or invalid option
  *             2 -> one or more arguments are null
  *             3 -> directory path is not valid
  *             4 -> provided directory is not a crawler director
  *             5 -> the file indexFilename cannot be read
+ *             6 -> cannot listen on the server address
  */
 
+#define _POSIX_C_SOURCE 200809L // sockets, poll, sigaction
+
 #include <unistd.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
 #include "index.h"
+#include "query.h"
+#include "doctable.h"
+#include "endpoint.h"
 #include "word.h"
 #include "file.h"
 #include "mem.h"
 
+// what every query is answered from, loaded once
+typedef struct querier {
+    index_t* index;
+    doctable_t* docs;           // NULL if there is no usable table
+    char* pageDirectory;
+    int numDocs;                // docs in pageDirectory
+    int k;                      // results per query; 0 for all
+    bool exhaustive;            // score every match even with k
+} querier_t;
+
+// a server connection, its unanswered input and its unsent answers
+typedef struct connection {
+    int fd;                     // non-blocking
+    char* buf;                  // bytes read but not yet answered
+    size_t len;
+    size_t cap;
+    bool eof;                   // no more will be read
+    char* out;                  // answers not yet sent; NULL if none
+    size_t outLen;
+    size_t outSent;
+} connection_t;
+
+// room for an error message of verify_query, besides the query's words
+static const int ERROR_MAX = 64;
+// the longest query line answered, from stdin or a client; a longer one
+// is an error, and a connection that sends more without a newline is closed
+static const size_t QUERY_MAX = 4096;
+// answers are written until this many bytes wait to be sent; the rest
+// of the input waits for the client to read them
+static const size_t OUTPUT_MAX = 262144;
+// connections served at once; more wait in the listen backlog
+#define MAX_CONNECTIONS 64
+
+// set by SIGINT or SIGTERM to stop the server
+static volatile sig_atomic_t stopping = 0;
+
 // provided by stdio
 int fileno(FILE *stream);
 // internal function prototypes
-static void query(index_t* index, char* pageDirectory);
-static void page_rank(int* scores, int size, char* pageDirectory);
-static bool parse_query(char** words, char* query, int* numWords);
-static bool verify_query(char** words, int numWords);
-// helper functions
-static void mergeSort(int scores[], int l, int r, int idxs[]);
-static void merge(int scores[], int l, int m, int r, int idxs[]);
+static void query(querier_t* querier);
+static int search(querier_t* querier, char** words, int numWords, hit_t** hits);
+static void page_rank(querier_t* querier, hit_t* hits, int numHits);
+static char* page_url(querier_t* querier, int docID);
+static bool parse_query(char** words, char* query, int* numWords, char* error);
+static bool verify_query(char** words, int numWords, char* error);
+// server mode
+static void serve(querier_t* querier, char* address);
+static bool serve_read(querier_t* querier, connection_t* conn);
+static void serve_answer(querier_t* querier, connection_t* conn);
+static void serve_close(connection_t* conn);
+static void serve_line(querier_t* querier, char* line, FILE* out);
+static void json_string(FILE* out, const char* string);
+static void on_signal(int signal);
 
 /* ***************************
  *  main function
  *  Accepts 2 arguments: pageDirectory, indexFilename
+ *  optionally preceded by -k N, the number of results to show,
+ *  -e, to score every matching document even with -k,
+ *  and -s address, to serve queries on a socket
  */
 int main(int argc, char *argv[])
 {
     /* parse the command line, validate parameters */ 
+    // optional number of results; 0 shows every matching document
+    int k = 0;
+    bool exhaustive = false;
+    char* address = NULL;
+    while (argc > 1 && argv[1] != NULL && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-k") == 0) {
+            if (argc < 3 || argv[2] == NULL || (k = atoi(argv[2])) <= 0) {
+                fprintf(stderr, "ERROR: -k expects a positive number of results\n");
+                exit(1);
+            }
+            argc--;
+            argv++;
+        } else if (strcmp(argv[1], "-e") == 0) {
+            exhaustive = true;
+        } else if (strcmp(argv[1], "-s") == 0) {
+            if (argc < 3 || argv[2] == NULL) {
+                fprintf(stderr, "ERROR: -s expects a socket path or :port\n");
+                exit(1);
+            }
+            address = argv[2];
+            argc--;
+            argv++;
+        } else {
+            fprintf(stderr, "ERROR: unknown option %s\n", argv[1]);
+            exit(1);
+        }
+        argc--;
+        argv++;
+    }
     // check num parameters
     if (argc != 3) {
         fprintf(stderr, "ERROR: Expected 2 arguments but recieved %d\n", argc-1);
@@ -85,19 +184,44 @@ int main(int argc, char *argv[])
         exit(5);
     }
 
-    // if succesful, determine length of file
-    const int size = file_numLines(fp);
-    fclose(fp);
-    // initialize index to length of file (same as num of words)
-    index = index_new(size);
+    if (index_isBinary(indexFilename)) {
+        fclose(fp);
+        /* binary index is mapped and used in place, with no parsing */
+        if ((index = index_map(indexFilename)) == NULL) {
+            fprintf(stderr, "ERROR: Cannot map index file %s\n", indexFilename);
+            exit(5);
+        }
+    } else {
+        // if succesful, determine length of file
+        const int size = file_numLines(fp);
+        fclose(fp);
+        // initialize index to length of file (same as num of words)
+        index = index_new(size);
+
+        /* load the index from indexFilename into an internal data structure */
+        index_load(index, indexFilename);
+    }
 
-    /* load the index from indexFilename into an internal data structure */
-    index_load(index, indexFilename);
+    querier_t querier = { index, NULL, pageDirectory, 0, k, exhaustive };
+    querier.numDocs = num_docs_crawled(pageDirectory);
+    // a document table from another crawl of the directory is stale:
+    // doctable_open refuses one saved before .crawler was last written
+    querier.docs = doctable_open(pageDirectory);
+    if (querier.docs != NULL && doctable_size(querier.docs) != querier.numDocs) {
+        doctable_delete(querier.docs);
+        querier.docs = NULL;
+    }
 
-    /* read search queries from stdin, one per line, until EOF */
-    query(index, pageDirectory);
+    if (address != NULL) {
+        /* answer queries from socket connections until signalled */
+        serve(&querier, address);
+    } else {
+        /* read search queries from stdin, one per line, until EOF */
+        query(&querier);
+    }
     
     // memory cleanup
+    doctable_delete(querier.docs);
     index_delete(index);
     mem_free(index);
 
@@ -107,178 +231,147 @@ int main(int argc, char *argv[])
 /**************** query() ****************/
 /* loops through stdin query entries        */
 /* evokes parse_query to parse query        */
-/* evokes index_search to get page scores   */
+/* evokes search to get page scores         */
 /* evokes page_rank to rank pages by score  */
 static void
-query(index_t* index, char* pageDirectory)
+query(querier_t* querier)
 {
-    /* read search queries from stdin, one per line, until EOF */
+    /* read search queries from stdin, one per line, until EOF, */
+    /* into one buffer reused for every query                    */
+    char* buf = NULL;
+    size_t cap = 0;
     char* query;
-    int numDocs = num_docs_crawled(pageDirectory);
     while (!feof(stdin)) {
         if (isatty(fileno(stdin))) {
             fprintf(stdout, "\nPlease enter your query: ");
         }
-        query = file_readLine(stdin);
+        query = file_readLineBuf(stdin, &buf, &cap);
+        // words and error are on the stack
+        if (query != NULL && strlen(query) > QUERY_MAX) {
+            fprintf(stderr, "ERROR: query too long\n");
+            continue;
+        }
         if (query != NULL && strlen(query) != 0) {
             // there must be less words in query than characters (FACT)
             char* words[strlen(query)];
             int numWords = 0;
+            char error[strlen(query) + ERROR_MAX];
 
-            if (!parse_query(words, query, &numWords)) {
-                // if there is an error with the query, ignore
-                mem_free(query);
+            if (!parse_query(words, query, &numWords, error)) {
+                // if there is an error with the query, report and ignore
+                fprintf(stderr, "%s", error);
                 continue;
             }
-            /* use the index to identify the set of documents that satisfy the query, as described below */
-
-            // the number of docID's from the directory
-            int scores[numDocs];
-            // initialize to zeros
-            for (int i = 0; i < numDocs; i++) {
-                scores[i] = 0;
+            /* print the 'clean' query for user to see */
+            printf("\nQuery:");
+            for (int i = 0; i < numWords; i++) {
+                printf(" %s", words[i]);
             }
-            index_search(index, words, scores, numDocs, numWords);
 
-            page_rank(scores, numDocs, pageDirectory);
+            /* use the index to identify the set of documents that satisfy the query, as described below */
+            hit_t* hits;
+            int numHits = search(querier, words, numWords, &hits);
+            page_rank(querier, hits, numHits);
+            if (hits != NULL) {
+                mem_free(hits);
+            }
             // formatting between queries
             fprintf(stdout, "-----------------------------------------------");
         } 
-        mem_free(query);
     }
+    free(buf);
     // formatting: after EOF add new line
     fprintf(stdout, "\n");
 }
 
+/**************** search() ****************/
+/* scores the documents matching a parsed query,   */
+/* and ranks the best k (or all, if k is 0)        */
+/* returns the number of hits; *hits is to be      */
+/* mem_free'd if not NULL                          */
+static int
+search(querier_t* querier, char** words, int numWords, hit_t** hits)
+{
+    // only documents that contain query words are scored
+    int numHits;
+    if (querier->k > 0 && !querier->exhaustive) {
+        // documents beyond the directory must not take places in the top k
+        numHits = query_prune(querier->index, words, numWords, querier->k,
+                              querier->numDocs, hits);
+    } else {
+        numHits = query_evaluate(querier->index, words, numWords, hits);
+    }
+    // keep the hits in the directory, in order
+    int kept = 0;
+    for (int h = 0; h < numHits; h++) {
+        if ((*hits)[h].docID <= querier->numDocs) {
+            (*hits)[kept++] = (*hits)[h];
+        }
+    }
+    // select the best k with a bounded heap; ties go to the higher docID
+    return query_top(*hits, kept, querier->k);
+}
+
 /**************** page_rank() ****************/
-/* rank pages in decreasing order of score   */
 /* print score, docID, and URL for each      */
+/* ranked hit, in decreasing order of score  */
 static void
-page_rank(int* scores, int size, char* pageDirectory)
+page_rank(querier_t* querier, hit_t* hits, int numHits)
 {
-    int idxs[size];
-    
-    for (int i = 0; i < size; i++) {
-        idxs[i] = i+1;
-    }
-    // sort
-    mergeSort(scores, 0, size-1, idxs);
-
     // check if empty results
-    if (scores[size-1] == 0) {
+    if (numHits == 0) {
         fprintf(stdout, "\nNo documents match.\n");
         return;
     }
 
-    // print in decreasing order
-    int i = size-1;
-    FILE* fp;
-    int DOC_ID_MAX_LEN = 20; // ASSUMPTION: there are less than 10^19 docID's
-    char docString[DOC_ID_MAX_LEN];
-    char* filePath;
-
-
-    // if score non-trivial (greater than 0)
-    while (scores[i] > 0 && i >= 0) {
-        // create filePath string
-        filePath = mem_malloc(strlen(pageDirectory) + DOC_ID_MAX_LEN + 1);
-        sprintf(docString, "%d", idxs[i]);
-        strcpy(filePath, pageDirectory);
-        strcat(filePath, "/");
-        strcat(filePath, docString);
-        if ((fp = fopen(filePath, "r")) == NULL) {
-            fprintf(stdout, "DOC ID: %d FROM IDXS AT INDEX %d\n", idxs[i], i);
-            fprintf(stderr, "ERROR: Cannot read %s\n", filePath);
-            mem_free(filePath);
-            i--;
+    // every hit has a non-trivial score (greater than 0)
+    for (int i = 0; i < numHits; i++) {
+        char* URL = page_url(querier, hits[i].docID);
+        if (URL == NULL) {
+            fprintf(stdout, "DOC ID: %d FROM HITS AT INDEX %d\n", hits[i].docID, i);
+            fprintf(stderr, "ERROR: Cannot read %s/%d\n", querier->pageDirectory, hits[i].docID);
             continue;
         }
-        // read URL
-        char* URL;
-        if (!feof(fp)) {
-            URL = file_readLine(fp);
-            fclose(fp);
-        }
-        fprintf(stdout, "\nScore:\t%d\tDocID:\t%d\tURL:\t%s\n", scores[i], idxs[i], URL);
-        mem_free(filePath);
+        fprintf(stdout, "\nScore:\t%d\tDocID:\t%d\tURL:\t%s\n", hits[i].score, hits[i].docID, URL);
         mem_free(URL);
-        i--;
-    }
-
-
-}
-
-/**************** mergeSort() ****************/
-/* performs recursive merge sort on scores array   */
-/* sort on scores is copied onto idxs array        */
-static void 
-mergeSort(int scores[], int l, int r, int idxs[])
-{
-    if (l < r) {
-        int m = l + (r - l) / 2;
-
-        mergeSort(scores, l, m, idxs);
-        mergeSort(scores, m + 1, r, idxs);
- 
-        merge(scores, l, m, r, idxs);
     }
 }
 
-/**************** merge() ****************/
-/* performs merge sort on scores array          */
-/* sort on scores is copied onto idxs array     */
-static void 
-merge(int scores[], int l, int m, int r, int idxs[])
+/**************** page_url() ****************/
+/* returns the URL of docID, to be mem_free'd,     */
+/* from the document table if there is one, else   */
+/* from the first line of the page file            */
+/* returns NULL if the page cannot be read         */
+static char*
+page_url(querier_t* querier, int docID)
 {
-    int i, j, k;
-    int len1 = m - l + 1;
-    int len2 = r - m;
-    // temp arrays
-    int L[len1], R[len2];
-    int L2[len1], R2[len2];
- 
-    // copy data
-    for (i = 0; i < len1; i++) {
-        L[i] = scores[l + i];
-        L2[i] = idxs[l + i];
-    }
-    for (j = 0; j < len2; j++) {
-        R[j] = scores[m + 1 + j];
-        R2[j] = idxs[m + 1 + j];
-    }
- 
-    // merge arrays, sorting
-    i = 0; // idx of left subarray
-    j = 0; // idx of right subarray
-    k = l; // idx of merged array
-    while (i < len1 && j < len2) {
-        if (L[i] <= R[j]) {
-            scores[k] = L[i];
-            idxs[k] = L2[i];
-            i++;
-        }
-        else {
-            scores[k] = R[j];
-            idxs[k] = R2[j];
-            j++;
-        }
-        k++;
-    }
-    while (i < len1) {
-        scores[k] = L[i];
-        idxs[k++] = L2[i++];
+    const char* docURL = doctable_url(querier->docs, docID);
+    if (docURL != NULL) {
+        char* URL = mem_malloc_assert(strlen(docURL) + 1, "URL");
+        strcpy(URL, docURL);
+        return URL;
     }
-    while (j < len2) {
-        scores[k] = R[j];
-        idxs[k++] = R2[j++];
+    // no table: read the URL from the page file
+    FILE* fp;
+    int DOC_ID_MAX_LEN = 20; // ASSUMPTION: there are less than 10^19 docID's
+    char* filePath = mem_malloc(strlen(querier->pageDirectory) + DOC_ID_MAX_LEN + 1);
+    sprintf(filePath, "%s/%d", querier->pageDirectory, docID);
+    fp = fopen(filePath, "r");
+    mem_free(filePath);
+    if (fp == NULL) {
+        return NULL;
     }
+    char* URL = file_readLine(fp);
+    fclose(fp);
+    return URL;
 }
 
 /**************** parse_query() ****************/
 /* prepares query for parse_words by converting to lowercase  */
-/* evokes parse_words, prints cleaned query                   */
+/* evokes parse_words and verify_query; on a bad query,       */
+/* error holds the message (empty for a blank query)          */
 static bool
-parse_query(char** words, char* query, int* numWords)
+parse_query(char** words, char* query, int* numWords, char* error)
 {
     /* translate all upper-case letters on the input line into lower-case */
     char* ptr = query;
@@ -294,26 +387,21 @@ parse_query(char** words, char* query, int* numWords)
     parse_words(words, query, numWords);
 
     // verify query
-    if (!verify_query(words, *numWords)) {
+    if (!verify_query(words, *numWords, error)) {
         // if query contians error, return false
         return false;
     }
-
-    /* print the 'clean' query for user to see */
-    printf("\nQuery:");
-    int i = 0;
-    while (words[i] != NULL) {
-        printf(" %s", words[i++]);
-    }
-
     return true;
 }
 
 /**************** verify_query() ****************/
 /* verifies that query complies with requirments as outlined in README.md  */
+/* otherwise writes the message into error, which has room for the query */
+/* plus ERROR_MAX chars                                                    */
 static bool
-verify_query(char** words, int numWords)
+verify_query(char** words, int numWords, char* error)
 {
+    error[0] = '\0';
     // defensive programming for empty / only whitespace
     if (words == NULL || words[0] == NULL) {
         return false;
@@ -324,28 +412,326 @@ verify_query(char** words, int numWords)
         size_t j;
         for (j = 0; word[j]; j++) {
             if (!isalpha(word[j])) {
-                fprintf(stderr, "\nERROR: bad character '%c' in query\n", word[j]);
+                sprintf(error, "\nERROR: bad character '%c' in query\n", word[j]);
                 return false;
             }
         }
     }
     // check for start with and/or
     if (strcmp(words[0], "and") == 0 || strcmp(words[0], "or") == 0) {
-        fprintf(stderr, "ERROR: '%s' cannot be first\n", words[0]);
+        sprintf(error, "ERROR: '%s' cannot be first\n", words[0]);
         return false;
     }
     // check for end with and/or
     if (strcmp(words[numWords-1], "and") == 0 || strcmp(words[numWords-1], "or") == 0) {
-        fprintf(stderr, "ERROR: '%s' cannot be last\n", words[numWords-1]);
+        sprintf(error, "ERROR: '%s' cannot be last\n", words[numWords-1]);
         return false;
     }
     // check for adjacent and/or
     for (int i = 1; i < numWords; i++) {
         if ( (strcmp(words[i], "and") == 0 || strcmp(words[i], "or") == 0)
         && (strcmp(words[i-1], "and") == 0 || strcmp(words[i-1], "or") == 0)) {
-            fprintf(stderr, "ERROR: '%s' and '%s' cannot be adjacent\n", words[i-1], words[i]);
+            sprintf(error, "ERROR: '%s' and '%s' cannot be adjacent\n", words[i-1], words[i]);
             return false;
         }
     }
     return true;
 }
+
+/**************** serve() ****************/
+/* answers queries from connections on address     */
+/* until SIGINT or SIGTERM; each line of input is  */
+/* one query, answered by one line of JSON         */
+static void
+serve(querier_t* querier, char* address)
+{
+    int listener = endpoint_listen(address);
+    if (listener < 0) {
+        fprintf(stderr, "ERROR: Cannot listen on %s: %s\n", address, strerror(errno));
+        doctable_delete(querier->docs);
+        index_delete(querier->index);
+        mem_free(querier->index);
+        exit(6);
+    }
+
+    // a client that hangs up must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    // no SA_RESTART, so poll returns when signalled
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    fprintf(stderr, "Serving %d documents on %s\n", querier->numDocs, address);
+
+    // fds[0] is the listener, fds[c + 1] is conns[c]
+    struct pollfd fds[MAX_CONNECTIONS + 1];
+    connection_t conns[MAX_CONNECTIONS];
+    int numConns = 0;
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+
+    while (!stopping) {
+        // stop accepting while every slot is busy
+        fds[0].fd = numConns < MAX_CONNECTIONS ? listener : -1;
+        if (poll(fds, numConns + 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "ERROR: poll: %s\n", strerror(errno));
+            break;
+        }
+
+        // serve every connection that is ready, dropping the closed ones;
+        // one with answers unsent waits to write, not to read
+        for (int c = 0; c < numConns; c++) {
+            if (fds[c + 1].revents == 0) {
+                continue;
+            }
+            if (serve_read(querier, &conns[c])) {
+                fds[c + 1].events = conns[c].out != NULL ? POLLOUT : POLLIN;
+                continue;
+            }
+            serve_close(&conns[c]);
+            // the last connection takes the free slot
+            numConns--;
+            conns[c] = conns[numConns];
+            fds[c + 1] = fds[numConns + 1];
+            c--;
+        }
+
+        if (fds[0].fd >= 0 && (fds[0].revents & POLLIN)) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd < 0) {
+                continue;
+            }
+            // a client that does not read must not block the others
+            if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+                close(fd);
+                continue;
+            }
+            connection_t conn = { fd, NULL, 0, 0, false, NULL, 0, 0 };
+            conns[numConns] = conn;
+            fds[numConns + 1].fd = fd;
+            fds[numConns + 1].events = POLLIN;
+            fds[numConns + 1].revents = 0;
+            numConns++;
+        }
+    }
+
+    for (int c = 0; c < numConns; c++) {
+        serve_close(&conns[c]);
+    }
+    endpoint_close(address, listener);
+    fprintf(stderr, "Server on %s stopped\n", address);
+}
+
+/**************** serve_read() ****************/
+/* reads what conn has sent, if every answer so far is */
+/* sent, then answers and sends what it can without    */
+/* blocking (serve_answer); at end of input the last   */
+/* unterminated line is answered too                   */
+/* returns false once conn is finished or broken       */
+static bool
+serve_read(querier_t* querier, connection_t* conn)
+{
+    // a read of at most this size is answered before the next
+    const size_t CHUNK = 16384;
+    if (conn->out == NULL && !conn->eof) {
+        if (conn->cap - conn->len < CHUNK + 1) {
+            size_t cap = conn->cap == 0 ? 2 * CHUNK : 2 * conn->cap;
+            char* buf = mem_malloc_assert(cap, "connection buffer");
+            if (conn->buf != NULL) {
+                memcpy(buf, conn->buf, conn->len);
+                mem_free(conn->buf);
+            }
+            conn->buf = buf;
+            conn->cap = cap;
+        }
+        ssize_t got = read(conn->fd, &conn->buf[conn->len], CHUNK);
+        if (got < 0 && errno != EINTR && errno != EAGAIN) {
+            return false;
+        }
+        conn->eof = got == 0;
+        conn->len += got > 0 ? got : 0;
+        conn->buf[conn->len] = '\0';
+    }
+
+    // send the answers, answering more as they go, until the
+    // client must read them or send more
+    while (true) {
+        if (conn->out == NULL) {
+            serve_answer(querier, conn);
+            if (conn->out == NULL) {
+                return !conn->eof;
+            }
+        }
+        ssize_t sent = write(conn->fd, &conn->out[conn->outSent], conn->outLen - conn->outSent);
+        if (sent < 0) {
+            // full: wait for POLLOUT
+            return errno == EINTR || errno == EAGAIN;
+        }
+        conn->outSent += sent;
+        if (conn->outSent == conn->outLen) {
+            free(conn->out);
+            conn->out = NULL;
+        }
+    }
+}
+
+/**************** serve_answer() ****************/
+/* answers conn's complete lines in order, into conn->out, */
+/* until OUTPUT_MAX bytes of answers; conn->out stays NULL */
+/* if there was nothing to answer. A line longer than      */
+/* QUERY_MAX without a newline is answered as an error and */
+/* ends the connection, so conn->buf never outgrows        */
+/* QUERY_MAX and one read                                  */
+static void
+serve_answer(querier_t* querier, connection_t* conn)
+{
+    if (conn->len == 0) {
+        return;
+    }
+    char* out;
+    size_t outLen;
+    FILE* stream = mem_assert(open_memstream(&out, &outLen), "answers");
+    char* line = conn->buf;
+    char* stop = &conn->buf[conn->len];
+    while (line < stop && ftell(stream) < (long)OUTPUT_MAX) {
+        char* end = memchr(line, '\n', stop - line);
+        if (end == NULL) {
+            if (conn->eof) {
+                // conn->buf is NUL-terminated
+                serve_line(querier, line, stream);
+                line = stop;
+            } else if (stop - line > QUERY_MAX) {
+                fputs("{\"error\":\"query too long\"}\n", stream);
+                line = stop;
+                conn->eof = true;
+            }
+            break;
+        }
+        *end = '\0';
+        serve_line(querier, line, stream);
+        line = end + 1;
+    }
+    fclose(stream);
+    conn->len = stop - line;
+    memmove(conn->buf, line, conn->len);
+    conn->buf[conn->len] = '\0';
+
+    if (outLen == 0) {
+        free(out);
+        return;
+    }
+    conn->out = out;
+    conn->outLen = outLen;
+    conn->outSent = 0;
+}
+
+/**************** serve_close() ****************/
+/* closes conn, dropping what it has not sent or been sent */
+static void
+serve_close(connection_t* conn)
+{
+    close(conn->fd);
+    if (conn->buf != NULL) {
+        mem_free(conn->buf);
+    }
+    if (conn->out != NULL) {
+        free(conn->out);
+    }
+}
+
+/**************** serve_line() ****************/
+/* answers one query with a line of JSON:                    */
+/*   {"query":"...","hits":[{"score":S,"docID":D,"url":"..."}]} */
+/* or {"error":"..."} if the query is not valid              */
+static void
+serve_line(querier_t* querier, char* line, FILE* out)
+{
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r') {
+        line[--len] = '\0';
+    }
+    // words and error are on the stack
+    if (len > QUERY_MAX) {
+        fputs("{\"error\":\"query too long\"}\n", out);
+        return;
+    }
+    char* words[len + 1];
+    int numWords = 0;
+    char error[len + ERROR_MAX];
+    error[0] = '\0';
+    if (len == 0 || !parse_query(words, line, &numWords, error)) {
+        // the message without its leading blank line or "ERROR: "
+        char* message = error;
+        while (isspace(*message)) {
+            message++;
+        }
+        if (strncmp(message, "ERROR: ", strlen("ERROR: ")) == 0) {
+            message += strlen("ERROR: ");
+        }
+        size_t end = strlen(message);
+        while (end > 0 && isspace(message[end - 1])) {
+            message[--end] = '\0';
+        }
+        fputs("{\"error\":", out);
+        json_string(out, end > 0 ? message : "empty query");
+        fputs("}\n", out);
+        return;
+    }
+
+    hit_t* hits;
+    int numHits = search(querier, words, numWords, &hits);
+    fputs("{\"query\":\"", out);
+    for (int i = 0; i < numWords; i++) {
+        // query words are letters only
+        fprintf(out, i == 0 ? "%s" : " %s", words[i]);
+    }
+    fputs("\",\"hits\":[", out);
+    for (int h = 0; h < numHits; h++) {
+        char* URL = page_url(querier, hits[h].docID);
+        fprintf(out, "%s{\"score\":%d,\"docID\":%d,\"url\":",
+                h == 0 ? "" : ",", hits[h].score, hits[h].docID);
+        if (URL != NULL) {
+            json_string(out, URL);
+            mem_free(URL);
+        } else {
+            fputs("null", out);
+        }
+        fputs("}", out);
+    }
+    fputs("]}\n", out);
+    if (hits != NULL) {
+        mem_free(hits);
+    }
+}
+
+/**************** json_string() ****************/
+/* writes string as a quoted JSON string */
+static void
+json_string(FILE* out, const char* string)
+{
+    putc('"', out);
+    for (const unsigned char* c = (const unsigned char*)string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            putc('\\', out);
+            putc(*c, out);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            putc(*c, out);
+        }
+    }
+    putc('"', out);
+}
+
+/**************** on_signal() ****************/
+/* asks the server loop to stop */
+static void
+on_signal(int signal)
+{
+    stopping = 1;
+}
@@ -20,6 +20,11 @@ echo -e "\ntesting with three or more arguments"
 ./querier ../data/letters-10 arg2 arg3
 ./querier ../data/letters-10 arg2 arg3 arg4 arg5 a r g 6
 
+# invalid -k
+echo -e "\ntesting with invalid -k"
+./querier -k 0 ../data/letters-10 ../data/letters-10/index.ndx
+./querier -k ../data/letters-10 ../data/letters-10/index.ndx
+
 # invalid pageDirectory
 echo -e "\ntesting with invalid pageDirectory (non-existent path)"
 ./querier ../data/letters-100 ../data/letters-1/index.ndx
@@ -58,6 +63,36 @@ fi
 # cleanup files
 rm test1.out
 
+# -k keeps only the best-scoring document of each query
+echo -e "\ntesting on pageDirectory: $pdir with -k 1"
+./querier -k 1 $pdir $indx < test1
+
+# pruned and exhaustive top-k evaluation must agree
+echo -e "\ntesting on pageDirectory: $pdir, -k 3 pruned vs exhaustive (-e)"
+var="$(diff <(./querier -k 3 $pdir $indx < test1 2>&1) <(./querier -e -k 3 $pdir $indx < test1 2>&1))"
+if [ -z "$var" ]
+then
+      echo -e "\noutput matches!"
+else
+      echo -e "\nOUTPUT DOES NOT MATCH"
+fi
+
+# server mode answers the same queries over a socket, one JSON line each
+echo -e "\ntesting on pageDirectory: $pdir, server mode with qclient"
+./querier -k 3 -s test.sock $pdir $indx &
+sleep 1
+./qclient test.sock < test1
+served="$(./qclient test.sock < test1 | grep -o '"score":[0-9]*,"docID":[0-9]*' | sed 's/"score":\([0-9]*\),"docID":/\1 /')"
+direct="$(./querier -k 3 $pdir $indx < test1 2>/dev/null | grep '^Score:' | awk '{print $2, $4}')"
+kill %1
+wait
+if [ "$served" == "$direct" ]
+then
+      echo -e "\noutput matches!"
+else
+      echo -e "\nOUTPUT DOES NOT MATCH"
+fi
+
 # test2_correct.out was manually verified to contian correct behaviour
 echo -e "\ntesting on pageDirectory: $pdir with fuzzyquery"
 touch test2.out